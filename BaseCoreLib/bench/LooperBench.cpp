@@ -0,0 +1,427 @@
+/*****************************************************************************
+* FileName    : LooperBench.cpp
+* Description : Non-interactive benchmark of message queue and looper
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#include "../inc/os/Logger.h"
+#include "../inc/looper/MessageHandler.h"
+#include "../inc/looper/MessageQueue.h"
+#include "../inc/looper/LooperThread.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LOG_TAG
+#undef LOG_TAG
+#endif
+#define LOG_TAG (LooperBench):
+
+using namespace Root::Core;
+
+// usage: LooperBench [messages] [scenario] [output.json]
+// every scenario prints one json object with ops/s and latency percentiles of ns,
+// the result of all scenarios is a json array which is easy to diff between runs
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static uint64 nowNs(void)
+{
+    return (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct BenchResult
+{
+    std::string             mName;
+    long                    mOps;
+    uint64                  mElapsedNs;
+    std::vector<uint64>     mLatency;
+};
+
+struct BenchContext
+{
+    std::vector<uint64>     mStamp;     // send time or due time of message
+    std::vector<uint64>     mLatency;
+    std::atomic<long>       mDone;
+    uint64                  mEndNs;
+    long                    mTotal;
+    Handler                 mPeer;
+
+    explicit BenchContext(long n) : mStamp(n), mLatency(n), mDone(0), mEndNs(0), mTotal(n), mPeer(nullptr) { }
+};
+
+static void waitDone(BenchContext& ctx)
+{
+    while (ctx.mDone.load(std::memory_order_acquire) < ctx.mTotal)
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+static void onLatency(const Message& msg, void* context)
+{
+    BenchContext* ctx = static_cast<BenchContext*>(context);
+    uint64 now = nowNs();
+    uint64 stamp = ctx->mStamp[msg->mArg1];
+    ctx->mLatency[msg->mArg1] = now > stamp ? now - stamp : 0;
+    if (ctx->mDone.fetch_add(1, std::memory_order_acq_rel) + 1 == ctx->mTotal)
+        ctx->mEndNs = now;
+}
+
+static void sendStamped(BenchContext& ctx, const Handler& h, int index, long delayMillis)
+{
+    ctx.mStamp[index] = nowNs() + (uint64)delayMillis * 1000000;
+    h->sendMessageDelayed(Msg::obtain(0, index, 0, h), delayMillis);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static BenchResult benchSpsc(long n)
+{
+    LooperThread thr("bench_spsc");
+    BenchContext ctx(n);
+    Handler h = MsgHandler::createHandler(thr.getLooper(), onLatency, &ctx);
+
+    uint64 start = nowNs();
+    for (long i = 0; i < n; i++)
+        sendStamped(ctx, h, (int)i, 0);
+    waitDone(ctx);
+
+    thr.quit();
+    return BenchResult{ "spsc", n, ctx.mEndNs - start, ctx.mLatency };
+}
+
+//----------------------------------------------------------------------------------------------//
+static BenchResult benchMpsc(long n)
+{
+    const int producers = 4;
+    n -= n % producers;
+
+    LooperThread thr("bench_mpsc");
+    BenchContext ctx(n);
+    Handler h = MsgHandler::createHandler(thr.getLooper(), onLatency, &ctx);
+
+    uint64 start = nowNs();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++)
+    {
+        threads.push_back(std::thread([&ctx, &h, n, p, producers]() {
+            long per = n / producers;
+            for (long i = 0; i < per; i++)
+                sendStamped(ctx, h, (int)(p * per + i), 0);
+        }));
+    }
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+    waitDone(ctx);
+
+    thr.quit();
+    return BenchResult{ "mpsc_fan_in", n, ctx.mEndNs - start, ctx.mLatency };
+}
+
+//----------------------------------------------------------------------------------------------//
+static BenchResult benchDelayed(long n)
+{
+    // latency is lateness against due time, delays are spread over 50ms so most
+    // messages are inserted in the middle of queue
+    LooperThread thr("bench_delayed");
+    BenchContext ctx(n);
+    Handler h = MsgHandler::createHandler(thr.getLooper(), onLatency, &ctx);
+
+    std::mt19937 rng(1);
+    uint64 start = nowNs();
+    for (long i = 0; i < n; i++)
+        sendStamped(ctx, h, (int)i, (long)(rng() % 50));
+    waitDone(ctx);
+
+    thr.quit();
+    return BenchResult{ "delayed_heavy", n, ctx.mEndNs - start, ctx.mLatency };
+}
+
+//----------------------------------------------------------------------------------------------//
+static BenchResult benchRemove(long n)
+{
+    // removing walks the list, keep queue size reasonable
+    n = std::min(n, 20000L);
+
+    LooperThread thr("bench_remove");
+    BenchContext ctx(n);
+    Handler h = MsgHandler::createHandler(thr.getLooper(), onLatency, &ctx);
+
+    std::vector<int> order(n);
+    for (long i = 0; i < n; i++)
+    {
+        order[i] = (int)i;
+        h->sendMessageDelayed(Msg::obtain((int)i, h), 60000);
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(1));
+
+    uint64 start = nowNs();
+    for (long i = 0; i < n; i++)
+    {
+        uint64 t = nowNs();
+        h->removeMessage(order[i]);
+        ctx.mLatency[i] = nowNs() - t;
+    }
+    uint64 end = nowNs();
+
+    thr.quit();
+    return BenchResult{ "remove_heavy", n, end - start, ctx.mLatency };
+}
+
+//----------------------------------------------------------------------------------------------//
+static BenchResult benchCancel(long n)
+{
+    // same as remove_heavy, but messages are cancelled by handles
+    n = std::min(n, 20000L);
+
+    LooperThread thr("bench_cancel");
+    BenchContext ctx(n);
+    Handler h = MsgHandler::createHandler(thr.getLooper(), onLatency, &ctx);
+
+    std::vector<MsgHandle> handles(n);
+    std::vector<int> order(n);
+    for (long i = 0; i < n; i++)
+    {
+        order[i] = (int)i;
+        h->sendMessageDelayed(Msg::obtain((int)i, h), 60000, &handles[i]);
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(1));
+
+    uint64 start = nowNs();
+    for (long i = 0; i < n; i++)
+    {
+        uint64 t = nowNs();
+        handles[order[i]].cancel();
+        ctx.mLatency[i] = nowNs() - t;
+    }
+    uint64 end = nowNs();
+
+    thr.quit();
+    return BenchResult{ "handle_cancel", n, end - start, ctx.mLatency };
+}
+
+//----------------------------------------------------------------------------------------------//
+static BenchResult benchScan(long n)
+{
+    // every lookup misses, so it walks whole list and touches each message once.
+    // Messages carry param and are mixed with other allocations like in a real process
+    long depth = std::min(n, 20000L);
+    long loops = 500;
+
+    LooperThread thr("bench_scan");
+    BenchContext ctx(loops);
+    Handler h = MsgHandler::createHandler(thr.getLooper(), onLatency, &ctx);
+
+    std::vector<std::string*> noise;
+    for (long i = 0; i < depth; i++)
+    {
+        noise.push_back(new std::string(64 + i % 64, 'x'));
+        void* param = malloc(32);
+        h->sendMessageDelayed(Msg::obtain((int)i, 0, 0, param, 32, [](void* p, size_t) { free(p); }, h), 60000 + i % 1000);
+    }
+
+    uint64 start = nowNs();
+    for (long i = 0; i < loops; i++)
+    {
+        uint64 t = nowNs();
+        if (h->hasMessage(-1))
+            break;
+        ctx.mLatency[i] = nowNs() - t;
+    }
+    uint64 end = nowNs();
+
+    h->removeAllMessages();
+    for (size_t i = 0; i < noise.size(); i++)
+        delete noise[i];
+    thr.quit();
+    return BenchResult{ "scan_miss", loops, end - start, ctx.mLatency };
+}
+
+//----------------------------------------------------------------------------------------------//
+static void onPing(const Message& msg, void* context)
+{
+    BenchContext* ctx = static_cast<BenchContext*>(context);
+    ctx->mPeer->sendMessage(Msg::obtain(0, msg->mArg1, 0, ctx->mPeer));
+}
+
+static void onPong(const Message& msg, void* context)
+{
+    // latency of one hop is half of round trip
+    BenchContext* ctx = static_cast<BenchContext*>(context);
+    uint64 now = nowNs();
+    int i = msg->mArg1;
+    ctx->mLatency[i] = (now - ctx->mStamp[i]) / 2;
+    if (++i == ctx->mTotal)
+    {
+        ctx->mEndNs = now;
+        ctx->mDone.store(i, std::memory_order_release);
+        return;
+    }
+
+    ctx->mStamp[i] = nowNs();
+    ctx->mPeer->sendMessage(Msg::obtain(0, i, 0, ctx->mPeer));
+}
+
+static BenchResult benchPingPong(long n)
+{
+    LooperThread a("bench_ping");
+    LooperThread b("bench_pong");
+    BenchContext ctx(n);
+    BenchContext ping(0);
+    Handler ha = MsgHandler::createHandler(a.getLooper(), onPing, &ping);
+    Handler hb = MsgHandler::createHandler(b.getLooper(), onPong, &ctx);
+    ping.mPeer = hb;
+    ctx.mPeer = ha;
+
+    uint64 start = nowNs();
+    ctx.mStamp[0] = start;
+    ha->sendMessage(Msg::obtain(0, 0, 0, ha));
+    waitDone(ctx);
+
+    a.quit();
+    b.quit();
+    return BenchResult{ "ping_pong", n, ctx.mEndNs - start, ctx.mLatency };
+}
+
+//----------------------------------------------------------------------------------------------//
+static void onBlock(const Message& msg, void* context)
+{
+    std::atomic<bool>* release = static_cast<std::atomic<bool>*>(msg->getParam());
+    while (!release->load(std::memory_order_acquire))
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+static BenchResult benchDrain(long n)
+{
+    // block the looper until all messages are queued, then measure quitSafely drain
+    LooperThread thr("bench_drain");
+    BenchContext ctx(n);
+    Handler h = MsgHandler::createHandler(thr.getLooper(), onLatency, &ctx);
+
+    std::atomic<bool> release(false);
+    Message block = Msg::obtain(h);
+    block->mCallback = onBlock;
+    block->setParam(&release, sizeof(release));
+    h->sendMessage(std::move(block));
+
+    for (long i = 0; i < n; i++)
+        h->sendMessage(Msg::obtain(0, (int)i, 0, h));
+
+    uint64 start = nowNs();
+    for (long i = 0; i < n; i++)
+        ctx.mStamp[i] = start;
+    release.store(true, std::memory_order_release);
+    thr.quitSafely();
+    waitDone(ctx);
+
+    return BenchResult{ "quit_safely_drain", n, ctx.mEndNs - start, ctx.mLatency };
+}
+
+static BenchResult benchParallelDrain(long n)
+{
+    // same as drain, but handler is reentrant and 4 workers drain it. Quitting before
+    // releasing the looper lets drain take every message
+    LooperThread thr("bench_pdrain");
+    BenchContext ctx(n);
+    Handler h = MsgHandler::createHandler(thr.getLooper(), onLatency, &ctx);
+    h->setReentrant(true);
+    thr.getLooper()->setDrainPolicy(4);
+
+    std::atomic<bool> release(false);
+    Message block = Msg::obtain(h);
+    block->mCallback = onBlock;
+    block->setParam(&release, sizeof(release));
+    h->sendMessage(std::move(block));
+
+    for (long i = 0; i < n; i++)
+        h->sendMessage(Msg::obtain(0, (int)i, 0, h));
+
+    uint64 start = nowNs();
+    for (long i = 0; i < n; i++)
+        ctx.mStamp[i] = start;
+    thr.quitSafely();
+    release.store(true, std::memory_order_release);
+    waitDone(ctx);
+
+    return BenchResult{ "quit_safely_parallel_drain", n, ctx.mEndNs - start, ctx.mLatency };
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static uint64 percentile(const std::vector<uint64>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+static void report(FILE* fp, BenchResult& r, bool first)
+{
+    std::sort(r.mLatency.begin(), r.mLatency.end());
+    double seconds = r.mElapsedNs / 1e9;
+    fprintf(fp, "%s  {\"scenario\": \"%s\", \"ops\": %ld, \"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+                "\"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+            first ? "" : ",\n", r.mName.c_str(), r.mOps, seconds, seconds > 0 ? r.mOps / seconds : 0.0,
+            (unsigned long long)percentile(r.mLatency, 0.50), (unsigned long long)percentile(r.mLatency, 0.99),
+            (unsigned long long)percentile(r.mLatency, 0.999), (unsigned long long)(r.mLatency.empty() ? 0 : r.mLatency.back()));
+    fflush(fp);
+}
+
+typedef BenchResult (*benchFunc)(long n);
+
+struct BenchEntry
+{
+    const char* mName;
+    benchFunc   mFunc;
+};
+
+static const BenchEntry gBenches[] =
+{
+    { "spsc",       benchSpsc },
+    { "mpsc",       benchMpsc },
+    { "delayed",    benchDelayed },
+    { "remove",     benchRemove },
+    { "cancel",     benchCancel },
+    { "scan",       benchScan },
+    { "pingpong",   benchPingPong },
+    { "drain",      benchDrain },
+    { "pdrain",     benchParallelDrain },
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char** argv)
+{
+    long n = argc > 1 ? atol(argv[1]) : 100000;
+    const char* only = argc > 2 && strcmp(argv[2], "all") ? argv[2] : nullptr;
+    FILE* fp = argc > 3 ? fopen(argv[3], "w") : stdout;
+    if (n <= 0 || fp == nullptr)
+    {
+        fprintf(stderr, "usage: %s [messages] [all|spsc|mpsc|delayed|remove|cancel|scan|pingpong|drain|pdrain] [output.json]\n", argv[0]);
+        return 1;
+    }
+
+    bool first = true;
+    fprintf(fp, "[\n");
+    for (size_t i = 0; i < sizeof(gBenches) / sizeof(gBenches[0]); i++)
+    {
+        if (only && strcmp(only, gBenches[i].mName))
+            continue;
+
+        LOGI("run benchmark %s with %ld messages", gBenches[i].mName, n);
+        BenchResult r = gBenches[i].mFunc(n);
+        report(fp, r, first);
+        first = false;
+    }
+    fprintf(fp, "\n]\n");
+
+    if (fp != stdout)
+        fclose(fp);
+    return 0;
+}
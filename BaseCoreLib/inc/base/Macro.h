@@ -9,6 +9,7 @@
 #ifndef __Macro_h__
 #define __Macro_h__
 #include <stdio.h>
+#include <stdint.h>
 
 //---------------------------------------------------------------------------//
 #ifdef __cplusplus
@@ -106,7 +107,8 @@
     #define threadlocal         thread_local
 #else
     #define SNPRINTF            snprintf
-    #define threadlocal         __thread
+    // __thread can't hold object with constructor or destructor such as Looper
+    #define threadlocal         thread_local
 #endif
 
 __BEGIN__
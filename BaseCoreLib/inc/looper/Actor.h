@@ -0,0 +1,124 @@
+/*****************************************************************************
+* FileName    : Actor.h
+* Description : Actors sharing a fixed set of looper threads definition
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#ifndef __Actor_h__
+#define __Actor_h__
+#include "Message.h"
+#include "../os/Mutex.hpp"
+#include <atomic>
+#include <vector>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+    //-----------------------------------------------------------------------//
+    class ActorSystem;
+    class LooperThread;
+
+    //-----------------------------------------------------------------------//
+    // Note: an actor handles its messages one at a time in order they were told, so
+    // its state needs no lock. Mailbox is a lock free stack linked through messages,
+    // an idle actor costs only this object and no thread, queue or handler. Actor is
+    // bound to one looper of its system when it is spawned
+    class API_EXPORTS Actor : private Uncopyable
+    {
+        friend class ActorSystem;
+
+        public:
+            Actor(void);
+
+            // messages left in mailbox are recycled
+            virtual ~Actor(void);
+
+            // called on looper of actor, message is recycled after
+            virtual void onReceive(const Message& msg) = 0;
+
+            // any thread, return false if actor isn't spawned or stop() was called. Actor
+            // isn't deleted while a tell() is inside, but it must not be called once
+            // caller may know actor deleted
+            bool tell(Message msg);
+
+            bool tell(int what, int arg1 = 0, int arg2 = 0);
+
+            ActorSystem* getSystem(void) const { return mSystem; }
+
+        private:
+            // push into mailbox and give actor a turn if it is idle, caller counts itself
+            // in mTellers
+            void push(Msg* m);
+
+            // move mailbox to end of list of turn, return false if it is empty
+            bool takeMailbox(void);
+
+        private:
+            std::atomic<Msg*>   mMailbox;   // pushed by senders, newest first
+            Msg*                mHead;      // taken by looper, oldest first
+            Msg*                mTail;
+            std::atomic<int>    mScheduled; // a turn message is queued or running
+            std::atomic<int>    mTellers;   // tell() calls inside, actor isn't deleted meanwhile
+            std::atomic<bool>   mStopping;  // stop() was called, tell() fails
+            bool                mStopMarked;// stop mark was handled by looper
+            uint32              mLooper;    // index of looper of system
+            ActorSystem*        mSystem;
+            Actor*              mPrev;      // list of live actors of system
+            Actor*              mNext;
+    };
+
+    //-----------------------------------------------------------------------//
+    // Note: actors with messages get turns on a fixed set of looper threads, a turn
+    // handles up to batch messages then actor goes to back of queue of its looper, so
+    // a busy actor can't starve others. Spawned actors are linked in a list of system
+    // which is only touched by spawn, deleting and destructor
+    class API_EXPORTS ActorSystem : private Uncopyable
+    {
+        friend class Actor;
+
+        public:
+            ActorSystem(int threads, int batch = 16);
+
+            // loopers quit, turns not run are dropped. Actors which aren't deleted yet are
+            // deleted after loopers exited
+            ~ActorSystem(void);
+
+            // system owns actor until it is stopped, actors are spread over loopers
+            Actor* spawn(Actor* actor);
+
+            // tell() fails from now on, actor is deleted on its looper after messages told
+            // before stop and those told concurrently with it were handled
+            void stop(Actor* actor);
+
+            int getActorCount(void) const { return mActorCount.load(std::memory_order_relaxed); }
+
+            Looper getLooper(int index) const;
+
+            int getLooperCount(void) const { return (int)mThreads.size(); }
+
+        private:
+            void schedule(Actor* actor);
+
+            void runTurn(Actor* actor);
+
+            void remove(Actor* actor);
+
+            static void onTurn(const Message& msg, void* context);
+
+            static void onStop(const Message& msg, void* context);
+
+        private:
+            int                         mBatch;
+            std::vector<LooperThread*>  mThreads;
+            std::vector<Handler>        mHandlers;
+            std::atomic<uint32>         mNextLooper;
+            std::atomic<int>            mActorCount;
+            Actor*                      mActors;
+            Mutex                       mMutex;     // guards list of actors
+    };
+
+__END__
+
+#endif // __Actor_h__
@@ -0,0 +1,79 @@
+/*****************************************************************************
+* FileName    : EventBus.h
+* Description : Topic based publish and subscribe of handlers definition
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#ifndef __EventBus_h__
+#define __EventBus_h__
+#include "Message.h"
+#include "../os/Mutex.hpp"
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+    //-----------------------------------------------------------------------//
+    // Note: a publish copies payload once into a reference counted block, every
+    // subscriber gets a message whose param points to it, mWhat is topic. Block is
+    // freed when last message is recycled. Payload is shared, subscribers must not
+    // modify it, retain() keeps it after dispatching. Subscribers are grouped by
+    // queue, messages of one queue are enqueued under one lock with one wakeup
+    class API_EXPORTS EventBus : private Uncopyable
+    {
+        public:
+            EventBus(void);
+
+            ~EventBus(void);
+
+            bool subscribe(int topic, const Handler& handler);
+
+            void unsubscribe(int topic, const Handler& handler);
+
+            // remove handler from all topics
+            void unsubscribe(const Handler& handler);
+
+            // return count of subscribers which got the event
+            int publish(int topic, const void* data, size_t bytes, int arg1 = 0, int arg2 = 0);
+
+            int getSubscriberCount(int topic) const;
+
+            // param of event message, the block lives until every retain is released
+            static void* retain(void* payload);
+
+            static void release(void* payload);
+
+        private:
+            static void releasePayload(void* payload, size_t bytes);
+
+            // immutable after published, publish holds one while it enqueues
+            struct QueueGroup
+            {
+                Queue                   mQueue;
+                std::vector<Handler>    mHandlers;
+            };
+
+            struct Subscribers
+            {
+                std::vector<QueueGroup> mGroups;
+                int                     mCount;
+
+                Subscribers(void) : mGroups(), mCount(0) { }
+            };
+
+            typedef std::shared_ptr<const Subscribers>  SubscribersPtr;
+
+            void setSubscribers(int topic, Subscribers* subs);
+
+        private:
+            mutable Mutex                               mMutex;
+            std::unordered_map<int, SubscribersPtr>     mTopics;
+    };
+
+__END__
+
+#endif // __EventBus_h__
@@ -0,0 +1,337 @@
+/*****************************************************************************
+* FileName    : LooperCoroutine.h
+* Description : C++20 coroutines running on message loopers definition
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#ifndef __LooperCoroutine_h__
+#define __LooperCoroutine_h__
+#include "MessageHandler.h"
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+    //-----------------------------------------------------------------------//
+    // Note: a coroutine runs on the looper whose message resumed it, every hop is one
+    // pooled message with the frame as param, so nothing is allocated per await.
+    // Frames come from a cache of the thread which creates the coroutine, that is the
+    // looper of it, and they are given back to the cache of the thread which ends it
+    class API_EXPORTS LooperCoroutine
+    {
+        public:
+            static void* allocFrame(size_t bytes) noexcept;
+
+            static void freeFrame(void* frame, size_t bytes) noexcept;
+
+            // handler of looper of calling thread which resumes awaiting coroutines,
+            // nullptr if the thread has no looper
+            static MsgHandler* currentHandler(void);
+
+            // cached handler of looper if it is looper of calling thread, otherwise nullptr
+            static MsgHandler* handlerOf(const MsgLooper* looper);
+
+            // resume coroutine by a message of handler
+            static void post(MsgHandler* h, std::coroutine_handle<> co, long delayMillis = 0);
+
+            // run callback by a pooled message of handler, param is given as message param
+            static void post(MsgHandler* h, const runnable& r, void* param, long delayMillis = 0);
+
+        private:
+            static void onResume(const Message& msg, void* context);
+    };
+
+    //-----------------------------------------------------------------------//
+    template <typename T> class Task;
+
+    // promise parts which don't depend on result type
+    class TaskPromiseBase
+    {
+        public:
+            struct FinalAwaiter
+            {
+                bool await_ready(void) noexcept { return false; }
+
+                template <typename P>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<P> co) noexcept
+                {
+                    TaskPromiseBase& p = co.promise();
+                    std::coroutine_handle<> next = p.mContinuation;
+                    if (p.mDetached)
+                    {
+                        co.destroy();
+                        return std::noop_coroutine();
+                    }
+                    if (!next)
+                        return std::noop_coroutine();
+
+                    // awaiter goes back to its own looper if task moved away
+                    MsgHandler* home = p.mResumeOn;
+                    if (home && home != LooperCoroutine::currentHandler())
+                    {
+                        LooperCoroutine::post(home, next);
+                        return std::noop_coroutine();
+                    }
+                    return next;
+                }
+
+                void await_resume(void) noexcept { }
+            };
+
+            std::suspend_always initial_suspend(void) noexcept { return {}; }
+
+            FinalAwaiter final_suspend(void) noexcept { return {}; }
+
+            void unhandled_exception(void) noexcept { std::terminate(); }
+
+            static void* operator new(size_t bytes) noexcept { return LooperCoroutine::allocFrame(bytes); }
+
+            static void operator delete(void* frame, size_t bytes) noexcept { LooperCoroutine::freeFrame(frame, bytes); }
+
+        public:
+            std::coroutine_handle<> mContinuation;
+            MsgHandler*             mResumeOn = nullptr;
+            bool                    mDetached = false;
+    };
+
+    template <typename T>
+    class TaskPromise : public TaskPromiseBase
+    {
+        public:
+            Task<T> get_return_object(void) noexcept;
+
+            static Task<T> get_return_object_on_allocation_failure(void) noexcept { return Task<T>(); }
+
+            template <typename U>
+            void return_value(U&& value) { mValue.emplace(std::forward<U>(value)); }
+
+            T takeResult(void) { return std::move(*mValue); }
+
+        private:
+            std::optional<T>        mValue;
+    };
+
+    template <>
+    class TaskPromise<void> : public TaskPromiseBase
+    {
+        public:
+            Task<void> get_return_object(void) noexcept;
+
+            static Task<void> get_return_object_on_allocation_failure(void) noexcept;
+
+            void return_void(void) noexcept { }
+
+            void takeResult(void) { }
+    };
+
+    //-----------------------------------------------------------------------//
+    // Note: task is lazy, it runs when it is awaited or started. Awaiting coroutine is
+    // resumed on its own looper when task ends, inline if both are on same one.
+    // start() detaches task, the frame frees itself at end. Task which is destroyed
+    // without running destroys its frame
+    template <typename T = void>
+    class Task
+    {
+        public:
+            typedef TaskPromise<T>  promise_type;
+
+            Task(void) : mCo(nullptr) { }
+
+            explicit Task(std::coroutine_handle<promise_type> co) : mCo(co) { }
+
+            Task(Task&& other) noexcept : mCo(std::exchange(other.mCo, nullptr)) { }
+
+            Task& operator =(Task&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    if (mCo)
+                        mCo.destroy();
+                    mCo = std::exchange(other.mCo, nullptr);
+                }
+                return *this;
+            }
+
+            Task(const Task&) = delete;
+            Task& operator =(const Task&) = delete;
+
+            ~Task(void) { if (mCo) mCo.destroy(); }
+
+            bool isValid(void) const { return (bool)mCo; }
+
+            // run on calling thread until first suspension, co_await h->resumeOn() moves it
+            void start(void)
+            {
+                if (!mCo)
+                    return;
+
+                std::coroutine_handle<promise_type> co = std::exchange(mCo, nullptr);
+                co.promise().mDetached = true;
+                co.resume();
+            }
+
+            struct Awaiter
+            {
+                std::coroutine_handle<promise_type> mCo;
+
+                bool await_ready(void) noexcept { return !mCo || mCo.done(); }
+
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept
+                {
+                    mCo.promise().mContinuation = caller;
+                    mCo.promise().mResumeOn = LooperCoroutine::currentHandler();
+                    return mCo;
+                }
+
+                T await_resume(void) { return mCo.promise().takeResult(); }
+            };
+
+            Awaiter operator co_await(void) && noexcept { return Awaiter{ mCo }; }
+
+            Awaiter operator co_await(void) & noexcept { return Awaiter{ mCo }; }
+
+        private:
+            std::coroutine_handle<promise_type> mCo;
+    };
+
+    template <typename T>
+    inline Task<T> TaskPromise<T>::get_return_object(void) noexcept
+    {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object(void) noexcept
+    {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object_on_allocation_failure(void) noexcept
+    {
+        return Task<void>();
+    }
+
+    //-----------------------------------------------------------------------//
+    // co_await h->resumeOn(), continue on looper of handler. It always goes through
+    // the queue, so on same looper it lets pending messages run first
+    class LooperResume
+    {
+        public:
+            explicit LooperResume(MsgHandler* h) : mHandler(h) { }
+
+            bool await_ready(void) noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> co) { LooperCoroutine::post(mHandler, co); }
+
+            void await_resume(void) noexcept { }
+
+        private:
+            MsgHandler*     mHandler;
+    };
+
+    //-----------------------------------------------------------------------//
+    // co_await sleepFor(looper, ms), continue on looper after delay. Sleeping on
+    // looper of current thread uses its cached handler, other looper gets a new one
+    class LooperSleep
+    {
+        public:
+            LooperSleep(const Looper& looper, long delayMillis) : mLooper(looper), mHandler(nullptr), mDelay(delayMillis) { }
+
+            bool await_ready(void) noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> co)
+            {
+                MsgHandler* h = LooperCoroutine::handlerOf(mLooper.get());
+                if (h == nullptr)
+                {
+                    mHandler = MsgHandler::createHandler(mLooper);
+                    h = mHandler.get();
+                }
+                LooperCoroutine::post(h, co, mDelay);
+            }
+
+            void await_resume(void) noexcept { }
+
+        private:
+            Looper          mLooper;
+            Handler         mHandler;
+            long            mDelay;
+    };
+
+    inline LooperSleep sleepFor(const Looper& looper, long delayMillis) { return LooperSleep(looper, delayMillis); }
+
+    //-----------------------------------------------------------------------//
+    // co_await h->invoke(fn), run fn on looper of handler and come back with its
+    // result. Caller without looper continues on looper of handler
+    template <typename Fn>
+    class LooperInvoke
+    {
+        public:
+            typedef typename std::invoke_result<Fn>::type R;
+
+            LooperInvoke(MsgHandler* h, Fn fn) : mHandler(h), mFunc(std::move(fn)), mHome(nullptr), mCo(), mResult() { }
+
+            bool await_ready(void) noexcept { return false; }
+
+            void await_suspend(std::coroutine_handle<> co)
+            {
+                mCo = co;
+                mHome = LooperCoroutine::currentHandler();
+                LooperCoroutine::post(mHandler, onInvoke, this);
+            }
+
+            R await_resume(void)
+            {
+                if constexpr (!std::is_void<R>::value)
+                    return std::move(*mResult);
+            }
+
+        private:
+            static void onInvoke(const Message& msg, void* context)
+            {
+                LooperInvoke* self = static_cast<LooperInvoke*>(msg->getParam());
+                if constexpr (std::is_void<R>::value)
+                    self->mFunc();
+                else
+                    self->mResult.emplace(self->mFunc());
+
+                if (self->mHome && self->mHome != self->mHandler)
+                    LooperCoroutine::post(self->mHome, self->mCo);
+                else
+                    self->mCo.resume();
+            }
+
+        private:
+            typedef typename std::conditional<std::is_void<R>::value, char, R>::type resultType;
+
+            MsgHandler*                 mHandler;
+            Fn                          mFunc;
+            MsgHandler*                 mHome;
+            std::coroutine_handle<>     mCo;
+            std::optional<resultType>   mResult;
+    };
+
+    //-----------------------------------------------------------------------//
+    inline LooperResume MsgHandler::resumeOn(void)
+    {
+        return LooperResume(this);
+    }
+
+    template <typename Fn>
+    inline LooperInvoke<Fn> MsgHandler::invoke(Fn fn)
+    {
+        return LooperInvoke<Fn>(this, std::move(fn));
+    }
+
+__END__
+
+#endif // __cpp_impl_coroutine
+
+#endif // __LooperCoroutine_h__
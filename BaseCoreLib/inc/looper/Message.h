@@ -10,6 +10,7 @@
 #define __Message_h__
 #include "../base/Uncopyable.hpp"
 #include "../os/AutoMutex.hpp"
+#include "../os/Buffer.h"
 #include <memory>
 #include <typeinfo>
 
@@ -30,6 +31,7 @@ __BEGIN__
     class MsgHandler;
     class MsgLooper;
     class MsgQueue;
+    class MsgHandle;
 
     typedef std::unique_ptr<Msg, deleter<Msg>>  Message;
     typedef std::shared_ptr<MsgHandler>         Handler;
@@ -41,6 +43,7 @@ __BEGIN__
     typedef messageCallback messageHandlerFunc;
     typedef messageCallback runnable;
     typedef messageCallback msgQueueIdleHandler;
+    typedef messageCallback msgExpiredHandler;
 
     //-----------------------------------------------------------------------//
     class HandlerCallback
@@ -51,12 +54,28 @@ __BEGIN__
             virtual void onHandler(const Message& msg) = 0;
     };
 
+    //-----------------------------------------------------------------------//
+    #define MSG_CACHE_LINE  64
+
+    // size of param is kept in 32 bits of second cache line, a larger one is refused
+    #define MSG_MAX_PARAM_BYTES 0xFFFFFFFFu
+
     //-----------------------------------------------------------------------//
     // Note: message is not thread safety. I assume you don't using same message
-    // in multithreads
-    class API_EXPORTS Msg : private Uncopyable
+    // in multithreads.
+    // Fields used by sorting and matching of queue fill the first cache line, so
+    // scanning list touches one line per message. Bookkeeping of param, handle,
+    // period and journal is only read for a message that is being dispatched, it
+    // is in the second line. Copying is deleted below, Msg doesn't derive from
+    // Uncopyable whose vtable pointer would take space of first line
+    class API_EXPORTS Msg
     {
         friend class MsgQueue;
+        friend class MsgHandler;
+        friend class MsgTrace;
+        friend class LooperCoroutine;
+        friend class Actor;
+        friend class ActorSystem;
         friend struct deleter<Msg>;
         public:
             Msg(const Msg& msg) = delete;
@@ -64,9 +83,21 @@ __BEGIN__
             Msg& operator =(const Msg& msg) = delete;
             Msg& operator =(Msg&& msg) = delete;
 
-            // set parameters of message
-            void setParam(const void* param, size_t bytes, const paramDeleter& freeFn = nullptr)
-            { mParam = const_cast<void*>(param); mParamBytes = bytes; mParamFreeFunc = freeFn; }
+            // messages are cache line aligned and reused per thread, see Message.cpp
+            static void* operator new(size_t bytes) noexcept;
+            static void operator delete(void* p) noexcept;
+
+            // set parameters of message, return false and keep no param when bytes is
+            // larger than MSG_MAX_PARAM_BYTES, caller still owns param then
+            bool setParam(const void* param, size_t bytes, const paramDeleter& freeFn = nullptr);
+
+            // buffer as param without copying, getParam() and ParamSize() are its bytes.
+            // Message holds a reference until it is recycled, so forwarding it to other
+            // handlers only bumps the count
+            void setBuffer(BufferRef buffer);
+
+            // another reference of buffer of message, invalid if param isn't a buffer
+            BufferRef getBuffer(void) const;
 
             void* getParam(void) const { return mParam; }
             size_t ParamSize(void) const { return mParamBytes; }
@@ -99,24 +130,57 @@ __BEGIN__
             Msg(void);
             ~Msg(void);
 
+            void releaseBuffer(void);
+
+            // used by handler itself, it doesn't create a new owner of handler
+            static Message obtain(MsgHandler* h);
+
+        public:
+            // first cache line, hot. Alignment of it aligns the message
+            alignas(MSG_CACHE_LINE) Message mNext;
+            uint64              mWhen;
+            MsgHandler*         mTarget;
+            runnable            mCallback;
+            HandlerCallback*    mHandleCallback;
+        private:
+            Msg*                mPrev;      // list of queue is double linked, so unlinking is O(1)
         public:
             int                 mWhat;
             int                 mArg1;
             int                 mArg2;
-            runnable            mCallback;
-            HandlerCallback*    mHandleCallback;
-            MsgHandler*         mTarget;
-            uint64              mWhen;
+            int                 mSlack;     // millisecond it may be late to share wakeup, -1 is slack of handler
+
+            // second cache line, cold
             int                 mFlags;
-            Message             mNext;
             
         private:
             static int          FLAGINUSE;
             static int          FLAGASYNC;
+            static int          FLAGDURABLE;
+            static int          FLAGPERIODIC;       // requeued after dispatch, fixed delay
+            static int          FLAGFIXEDRATE;      // with FLAGPERIODIC, next time follows original schedule
+            static int          FLAGDISPATCHING;    // periodic message is out of list while dispatching
+            static int          FLAGCANCELED;
+            static int          FLAGRESCHEDULED;
+            static int          FLAGBUFFER;         // param is bytes of a Buffer
+            static int          FLAGDEADLINE;       // mDeadline is given, never with FLAGPERIODIC
+            static int          FLAGEXPIRED;        // deadline passed before dispatching
+            static int          FLAGTHROTTLED;      // waited for token of rate limit, it is taken
+            uint32              mHandle;    // slot of MsgHandle in queue + 1, 0 is no handle
+            union
+            {
+                uint32          mPeriod;    // millisecond of periodic message
+                uint32          mDeadline;  // low 32 bits of millisecond of deadline in deadline mode
+            };
+            uint32              mTraceId;   // only be given when MsgTrace is enabled
             // The 3 paramete are private, which purpose is avoiding forgetting to set  
+            uint32              mParamBytes;
+            uint32              mParamOffset;   // offset of param in its Buffer
             void*               mParam;
-            size_t              mParamBytes;
             paramDeleter        mParamFreeFunc;
+            Msg*                mLaneNext;  // list of same target in fair mode of queue, or mailbox of Actor
+            Msg*                mLanePrev;
+            uint64              mJournalSeq;// record of durable message in journal of queue
     };
 
 __END__
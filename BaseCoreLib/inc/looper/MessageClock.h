@@ -0,0 +1,86 @@
+/*****************************************************************************
+* FileName    : MessageClock.h
+* Description : Clock source of message queue definition
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#ifndef __MessageClock_h__
+#define __MessageClock_h__
+#include "Message.h"
+#include "../os/Mutex.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+    //-----------------------------------------------------------------------//
+    class MsgClock;
+    typedef std::shared_ptr<MsgClock>   Clock;
+
+    //-----------------------------------------------------------------------//
+    // Note: queue without clock reads system time, that is the fast path. A clock set
+    // by MsgLooper::setClock() gives the time of sending and dispatching messages
+    class API_EXPORTS MsgClock : private Uncopyable
+    {
+        public:
+            MsgClock(void) = default;
+            virtual ~MsgClock(void) { }
+
+            virtual uint64 nowMillis(void) = 0;
+
+            // looper has nothing to do until whenMillis, return true if the clock moved
+            // there itself, otherwise the looper sleeps for it
+            virtual bool advanceTo(uint64 whenMillis) { return false; }
+
+            // time doesn't go by itself, the looper waits for advancing instead of sleeping
+            virtual bool isVirtual(void) const { return false; }
+
+            virtual void attach(const Queue& queue) { }
+    };
+
+    //-----------------------------------------------------------------------//
+    // Note: virtual time only moves when asked. Auto advance jumps to next due message
+    // as soon as the looper is idle, so hours of timeouts and retries run in no time.
+    // Manual mode is stepped by advance() from test thread. Auto advance doesn't wait
+    // for other threads, so seed messages in manual mode and turn it on after. Loopers
+    // sharing a clock share its time, auto advance of one of them moves all.
+    class API_EXPORTS VirtualClock : public MsgClock
+    {
+        public:
+            VirtualClock(uint64 startMillis = 0, bool autoAdvance = true);
+
+            ~VirtualClock(void);
+
+            uint64 nowMillis(void) override { return mNow.load(std::memory_order_acquire); }
+
+            bool advanceTo(uint64 whenMillis) override;
+
+            bool isVirtual(void) const override { return true; }
+
+            void attach(const Queue& queue) override;
+
+            void advance(uint64 millis);
+
+            void setAutoAdvance(bool enable);
+
+            // times that time jumped forward
+            uint64 getJumpCount(void) const { return mJumps.load(std::memory_order_relaxed); }
+
+        private:
+            void moveTo(uint64 whenMillis);
+
+        private:
+            std::atomic<uint64>             mNow;
+            std::atomic<bool>               mAuto;
+            std::atomic<uint64>             mJumps;
+            Mutex                           mMutex;
+            std::vector<std::weak_ptr<MsgQueue>> mQueues;
+    };
+
+__END__
+
+#endif // __MessageClock_h__
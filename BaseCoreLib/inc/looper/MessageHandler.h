@@ -10,6 +10,11 @@
 #define __MessageHandler_h__
 #include "Message.h"
 #include "../os/Mutex.hpp"
+#include <atomic>
+#include <initializer_list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 //---------------------------------------------------------------------------//
 __BEGIN__
@@ -23,11 +28,29 @@ __BEGIN__
             virtual void operator()(const Message& msg, void* context) = 0;
     };
 
+    //-----------------------------------------------------------------------//
+    // Note: looper and queue of handler are published same way as its callbacks, a
+    // sender which read the old record enqueues into old queue, which forwards the
+    // message, see MsgHandler::migrateTo()
+    struct MsgBinding
+    {
+        Looper          mLooper;
+        Queue           mQueue;
+        MsgBinding*     mRetired;
+    };
+
+    #if defined(__cpp_impl_coroutine)
+    class LooperResume;
+    template <typename Fn> class LooperInvoke;
+    #endif
+
     //----------------------------------------------------------------------//
     class API_EXPORTS MsgHandler : private Uncopyable
     {
         friend struct deleter<MsgHandler>;
         friend class Msg;
+        friend class EventBus;
+        friend class MsgQueue;
 
         public:
             static Handler createHandler(void* context = nullptr);
@@ -40,30 +63,94 @@ __BEGIN__
 
             messageCallback getCallback(void) const;
 
+            Looper getLooper(void) const { return mBinding.load(std::memory_order_acquire)->mLooper; }
+
+            // pending messages of handler move to queue of looper in their order with their
+            // times, and later sends go there. Handles of moved messages are released and
+            // durable ones move to journal of new queue. A message being dispatched on old
+            // looper may overlap with new one unless this is called on old looper. Return
+            // count of moved messages, -1 if looper is null
+            int migrateTo(const Looper& looper);
+
             void post(const runnable& r);
 
-            void post(const runnable& r, long delayMillis);
+            // handle, if it isn't null, refers to the pending message after sending,
+            // it cancels or reschedules the message without searching queue
+            void post(const runnable& r, long delayMillis, MsgHandle* handle = nullptr);
 
-            void sendMessage(Message msg);
+            void sendMessage(Message msg, MsgHandle* handle = nullptr);
 
             void sendEmptyMessage(int what);
 
-            void sendEmptyMessage(int what, long delayMillis);
+            void sendEmptyMessage(int what, long delayMillis, MsgHandle* handle = nullptr);
 
-            void postAtTime(Message msg, long uptimeMillis);
+            void postAtTime(Message msg, long uptimeMillis, MsgHandle* handle = nullptr);
 
-            void postAtTime(const runnable& r, long uptimeMillis);
+            void postAtTime(const runnable& r, long uptimeMillis, MsgHandle* handle = nullptr);
 
-            void sendMessageDelayed(Message msg, long delayMillis);
+            void sendMessageDelayed(Message msg, long delayMillis, MsgHandle* handle = nullptr);
 
             void sendMessageAtFrontOfQueue(Message msg);
 
+            // in deadline mode of queue, the ready message of nearest deadline runs first
+            // and one whose deadline passed may be expired. Deadline counts from now, not
+            // from delay. In other modes it is same as sendMessageDelayed
+            void sendMessageWithDeadline(Message msg, long delayMillis, long deadlineMillis, MsgHandle* handle = nullptr);
+
+            // one message is reused for every tick, fixed rate keeps original schedule and
+            // skips ticks missed under overload, fixed delay waits period after each run.
+            // It runs until it is cancelled by handle or handler's messages are removed
+            void postAtFixedRate(const runnable& r, long initialDelayMillis, long periodMillis, MsgHandle* handle = nullptr);
+
+            void postWithFixedDelay(const runnable& r, long initialDelayMillis, long delayMillis, MsgHandle* handle = nullptr);
+
+            // message is kept in journal of queue until it is dispatched or removed, so it
+            // survives restart. Its param must be plain bytes, runnable and callback object
+            // can't be saved. Without journal it is same as sendMessageDelayed
+            void sendDurableMessageDelayed(Message msg, long delayMillis);
+
+            // durable id binds messages of journal with handler after restart, setting it
+            // enqueues recovered messages which were sent by handler with same id
+            void setDurableId(int id);
+
+            int getDurableId(void) const { return mDurableId; }
+
+            // default tolerance of delayed messages of handler, they may be dispatched
+            // up to slack later so the looper wakes once for nearby deadlines. Message
+            // whose mSlack isn't -1 uses its own
+            void setTimerSlack(long slackMillis) { mTimerSlack = slackMillis > 0 ? slackMillis : 0; }
+
+            long getTimerSlack(void) const { return mTimerSlack; }
+
+            // reentrant handler may dispatch on several threads at once, so parallel drain
+            // of safe quit takes its messages, see MsgLooper::setDrainPolicy()
+            void setReentrant(bool reentrant) { mReentrant = reentrant; }
+
+            bool isReentrant(void) const { return mReentrant; }
+
+            // token bucket of handler, its messages are dispatched at most ratePerSec with
+            // bursts of burst, the others wait in queue for their tokens in order they
+            // were sent. Rate 0 removes it
+            void setRateLimit(double ratePerSec, int burst = 1);
+
+            // messages that waited for a token
+            uint64 getThrottledCount(void) const;
+
             void setMsgHandlerFunc(const messageHandlerFunc& fn);
 
             void setMsgHandlerFunc(const MsgHandlerObj& obj);
 
             void setMsgCallbackObject(const HandlerCallback* callbackObj);
 
+            // message of what is dispatched to fn with context of handler instead of a
+            // switch in default callback, callbacks of message itself still come first.
+            // Codes 0 to 1023 are indexed, others are hashed. Null fn removes it. Table
+            // is copied on change, so register while setting up
+            void on(int what, const messageCallback& fn);
+
+            // whole table is copied and published once, register many codes by this
+            void on(std::initializer_list<std::pair<int, messageCallback> > table);
+
             bool hasMessage(const Message& msg);
 
             bool hasMessage(const runnable& r);
@@ -91,22 +178,76 @@ __BEGIN__
             void removeAllMessages(void);
 
             void dispatchMessage(const Message& msg);
+
+        #if defined(__cpp_impl_coroutine)
+            // awaitables of LooperCoroutine.h: co_await resumeOn() continues on looper of
+            // handler, co_await invoke(fn) runs fn there and returns its result
+            LooperResume resumeOn(void);
+
+            template <typename Fn>
+            LooperInvoke<Fn> invoke(Fn fn);
+        #endif
         
         private:
             MsgHandler(void);
             ~MsgHandler(void);
 
-            void sendMessageAtTime(Message msg, uint64 uptimeMillis);
+            void sendMessageAtTime(Message msg, uint64 uptimeMillis, MsgHandle* handle = nullptr);
+
+            void postPeriodic(const runnable& r, long initialDelayMillis, long periodMillis, bool fixedRate, MsgHandle* handle);
+
+            // Note: callbacks record is immutable after it been published, setters copy
+            // it and publish the new one, so dispatchMessage only loads it between a pair
+            // of mReaders counts. Replaced records are retired, and freed by the writer or
+            // by the last reader leaving once no reader is left who may hold one. Each
+            // record has its own what table, a table of many codes is set by one on()
+            // call, not one per code.
+            struct Callbacks
+            {
+                messageCallback     mCallback;          // defalut message handler function
+                messageHandlerFunc  mMessageHandlerFn;  // user messge handler function
+                MsgHandlerObj*      mMsgHandlerObj;     // user message handler object
+                HandlerCallback*    mmsgCallbackObj;
+                std::vector<messageCallback>            mWhatTable; // index is what
+                std::unordered_map<int, messageCallback> mWhatMap;  // codes out of table
+                Callbacks*          mRetired;
+
+                messageCallback findWhat(int what) const
+                {
+                    if ((unsigned)what < mWhatTable.size())
+                        return mWhatTable[what];
+                    if (mWhatMap.empty())
+                        return nullptr;
+                    std::unordered_map<int, messageCallback>::const_iterator it = mWhatMap.find(what);
+                    return it != mWhatMap.end() ? it->second : nullptr;
+                }
+            };
+
+            Callbacks* cloneCallbacks(void) const;
+
+            void publishCallbacks(Callbacks* callbacks);
+
+            // frees retired records if no reader is inside, caller must hold mMutex
+            void reclaimCallbacks(void);
+
+            const Callbacks* enterCallbacks(void) const;
+
+            void leaveCallbacks(void) const;
+
+            static void setWhat(Callbacks* callbacks, int what, const messageCallback& fn);
+
+            const Queue& queue(void) const { return mBinding.load(std::memory_order_acquire)->mQueue; }
 
         private:
-            Looper              mLooper;
-            Queue               mQueue;
-            messageCallback     mCallback;          // defalut message handler function
-            messageHandlerFunc  mMessageHandlerFn;  // user messge handler function
-            MsgHandlerObj*      mMsgHandlerObj; // user message handler object
-            HandlerCallback*    mmsgCallbackObj;
-            void*               mContext;
-            mutable Mutex*      mMutex;
+            std::atomic<const MsgBinding*>  mBinding;
+            std::atomic<const Callbacks*>   mCallbacks;
+            std::atomic<Callbacks*>         mRetiredCallbacks;
+            mutable std::atomic<int>        mReaders;   // dispatches holding a record
+            void*                           mContext;
+            int                             mDurableId;
+            long                            mTimerSlack;
+            bool                            mReentrant;
+            mutable Mutex                   mMutex;     // serializes callbacks and binding writers only
     };
 
 __END__
@@ -0,0 +1,121 @@
+/*****************************************************************************
+* FileName    : MessageJournal.h
+* Description : Durable journal of delayed messages definition
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#ifndef __MessageJournal_h__
+#define __MessageJournal_h__
+#include "../base/Uncopyable.hpp"
+#include "../os/Mutex.hpp"
+#include "../os/Condition.hpp"
+#include <string>
+#include <thread>
+#include <vector>
+#include <map>
+#include <set>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+    //-----------------------------------------------------------------------//
+    struct JournalHeader;
+
+    // a message recovered from journal, param is a copy of its bytes
+    struct JournalEntry
+    {
+        uint64              mSeq;
+        uint64              mWhen;
+        int                 mDurableId;
+        int                 mWhat;
+        int                 mArg1;
+        int                 mArg2;
+        std::vector<char>   mParam;
+    };
+
+    //-----------------------------------------------------------------------//
+    // Note: the journal is an append-only mmap'ed file, enqueueing a durable message
+    // appends an add record and dispatching or removing it appends a done record.
+    // A record is committed when the tail of header moves over it, so a torn record
+    // after crash is ignored. Due time of record is wall clock, a message whose time
+    // passed during restart is dispatched at once. Appending only writes into mapped
+    // space, so it is safe under lock of queue. A worker thread syncs dirty pages,
+    // grows the file when it is half full and rewrites it with live records when most
+    // are done. A record finding no room isn't written, its message isn't durable.
+    class API_EXPORTS MsgJournal : private Uncopyable
+    {
+        public:
+            static MsgJournal* open(const char* path);
+
+            ~MsgJournal(void);
+
+            // return sequence of the record, 0 is failure
+            uint64 append(uint64 when, int durableId, int what, int arg1, int arg2, const void* param, size_t bytes);
+
+            void done(uint64 seq);
+
+            // move recovered messages of durable id out, they are still live until done
+            void takeRecovered(int durableId, std::vector<JournalEntry>& entries);
+
+            // idle queue hints worker to rewrite a file of mostly done records
+            void maintain(void);
+
+            int getLiveCount(void) const;
+
+        private:
+            MsgJournal(const std::string& path);
+
+            bool map(int fd, size_t size);
+
+            void unmap(void);
+
+            bool load(void);
+
+            size_t write(uint32 type, uint64 seq, uint64 when, int durableId, int what, int arg1, int arg2,
+                         const void* param, size_t bytes, size_t* nextOff = nullptr);
+
+            void kick(void);
+
+            void workLoop(void);
+
+            // called on worker with lock held, they unlock it around system calls
+            void grow(void);
+
+            bool compact(void);
+
+            void sync(void);
+
+            void flushPendingDone(void);
+
+        private:
+            std::string                 mPath;
+            int                         mFd;
+            char*                       mAddr;
+            size_t                      mSize;
+            JournalHeader*              mHeader;
+            mutable Mutex               mMutex;
+            std::map<uint64, size_t>    mLive;      // sequence -> offset of add record
+            std::set<uint64>            mRecovered;
+            size_t                      mLiveBytes;
+            bool                        mDirty;
+            uint64                      mLastSync;
+            std::thread*                mWorker;
+            Condition                   mWork;
+            bool                        mStop;
+            bool                        mKicked;
+            bool                        mCompactHint;
+            bool                        mFull;      // a record found no room, logged once
+            std::vector<uint64>         mPendingDone;
+            // file being compacted, records are written into both until it replaces current
+            int                         mNextFd;
+            char*                       mNextAddr;
+            size_t                      mNextSize;
+            JournalHeader*              mNextHeader;
+            std::map<uint64, size_t>    mNextLive;
+    };
+
+__END__
+
+#endif // __MessageJournal_h__
@@ -10,48 +10,114 @@
 #define __MessageLooper_h__
 #include "MessageQueue.h"
 #include "../os/Mutex.hpp"
+#include <atomic>
 #include <memory>
 #include <thread>
+#include <vector>
 
 //---------------------------------------------------------------------------//
 __BEGIN__
     
+    //-----------------------------------------------------------------------//
+    struct LooperStats
+    {
+        uint64  mDispatched;    // messages dispatched by looper
+        uint64  mBusyNanos;     // time spent in dispatching while busy timing is on
+        uint64  mWakeups;       // see MsgQueue::getWakeupCount()
+        int     mQueueSize;
+    };
+
+    //-----------------------------------------------------------------------//
+    struct DrainReport
+    {
+        uint64  mSerial;        // dispatched by looper during drain
+        uint64  mParallel;      // dispatched by drain workers
+        uint64  mDiscarded;     // left at deadline, durable ones stay in journal
+        uint64  mMillis;        // time of drain
+    };
+
+    struct LooperDrain;
+
     //-----------------------------------------------------------------------//
     class API_EXPORTS MsgLooper : private Uncopyable
     {
         friend struct deleter<MsgLooper>;
+        friend class Msg;
+        friend class LooperCoroutine;
 
         public:            
 
-            static Looper prepare(int msgQueuePoolMaxSize = 50);
+            // durable messages of queue are saved in journal file if path is given, and
+            // messages saved last time are recovered, see MsgHandler::setDurableId()
+            static Looper prepare(int msgQueuePoolMaxSize = 50, const char* journalPath = nullptr);
 
+            // lock free, it only reads the looper of current thread
             static Looper myLooper(void);
 
+            // enumerate all live loopers of process, it isn't on the message path
+            static void getLoopers(std::vector<Looper>& loopers);
+
             static Queue& myQueue(void) { return myLooper()->getMsgQueue(); }
 
             void loop(void);
 
-            Queue& getMsgQueue(void) { AutoMutex lock(&mMutex); return mQueue; }
+            Queue& getMsgQueue(void) { return mQueue; }
 
             void quit(bool safely = false);
 
+            // clock of messages of this looper, nullptr is system time. VirtualClock runs
+            // delayed messages without real waiting
+            void setClock(const Clock& clock);
+
             bool hadExit(void) { return mExit; }
 
-            uint64 getThredId(void) const { AutoMutex lock(&mMutex); return mThreadId; }
+            // counters for balancing handlers between loopers, any thread may read them,
+            // see MsgHandler::migrateTo()
+            void getStats(LooperStats& stats) const;
+
+            // timing reads clock twice per message, so it is off by default
+            void setBusyTiming(bool enable) { mBusyTiming.store(enable, std::memory_order_relaxed); }
+
+            // safe quit drains queue by policy, due messages of reentrant handlers are
+            // dispatched by temporary workers and the others by looper in order. Messages
+            // left at deadline are discarded and reported. It is set before quitting, 0
+            // workers keeps serial drain and deadline 0 waits for every message
+            void setDrainPolicy(int workers, long deadlineMillis = 0);
+
+            // result of last drain, valid after loop() returned
+            void getDrainReport(DrainReport& report) const { report = mDrainReport; }
+
+            uint64 getThredId(void) const { return mThreadId; }
 
             void setTestWaitTime(long outTimeMillisExit) { getMsgQueue()->setTestOutTimeMillisExit(outTimeMillisExit); }
 
+            static uint64 getCurrentThreadId(void);
+
         private:
             MsgLooper(const char* msgQueueName, int msgQueuePoolMaxSize, uint64 tid);
             ~MsgLooper(void);
+
+            void startDrain(void);
+
+            void finishDrain(void);
+
+            static void drainWorker(LooperDrain* drain);
             
         private:
             threadlocal static Looper mThreadLocal;
+            static Mutex              mLoopersMutex;
+            static std::vector<std::weak_ptr<MsgLooper>> mLoopers;
             Queue                     mQueue;
             volatile uint64           mThreadId;
-            static Mutex              mMutex;
             volatile bool             mExit;
             bool                      mPromoteThrLevel;
+            std::atomic<uint64>       mDispatched;    // written by looper thread only
+            std::atomic<uint64>       mBusyNanos;
+            std::atomic<bool>         mBusyTiming;
+            int                       mDrainWorkers;
+            long                      mDrainDeadline;
+            LooperDrain*              mDrain;
+            DrainReport               mDrainReport;
     };
 
 __END__
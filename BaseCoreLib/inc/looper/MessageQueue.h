@@ -9,12 +9,15 @@
 #ifndef __MessageQueue_h__
 #define __MessageQueue_h__
 #include "Message.h"
+#include "MessageClock.h"
 #include "../os/AutoMutex.hpp"
 #include "../os/Condition.hpp"
 #include <string>
 #include <list>
 #include <memory>
 #include <thread>
+#include <vector>
+#include <unordered_map>
 #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
 #include <Windows.h>
 #include <process.h>
@@ -26,10 +29,91 @@
 //---------------------------------------------------------------------------//
 __BEGIN__
 
+    //-----------------------------------------------------------------------//
+    class MsgJournal;
+    class MsgRecorder;
+    class SharedMsgQueue;
+    struct MsgBinding;
+
+    //-----------------------------------------------------------------------//
+    // compact copy of a queued message, see MsgQueue::snapshot(). A message sent at
+    // front of queue has no due time (when is 0), it is counted as due and not overdue
+    struct MsgDescriptor
+    {
+        int         mWhat;
+        MsgHandler* mTarget;
+        uint64      mWhen;
+        uint64      mOverdue;   // millisecond past its due time, 0 until it is due
+        bool        mWaiting;   // delayed message not due yet
+    };
+
+    struct MsgWhatCount
+    {
+        int         mWhat;
+        int         mCount;
+        int         mWaiting;   // of count, not due yet
+        uint64      mMaxOverdue;
+    };
+
+    struct MsgTargetCount
+    {
+        MsgHandler* mTarget;
+        int         mCount;
+        int         mWaiting;   // of count, not due yet
+        uint64      mMaxOverdue;
+    };
+
+    // Note: descriptors are copied under lock of queue and histograms are built after
+    // it is released. Reusing a snapshot keeps its capacity, so copying doesn't allocate
+    struct MsgQueueSnapshot
+    {
+        uint64                      mTakenAt;   // millisecond of clock of queue
+        int                         mPoolSize;
+        std::vector<MsgDescriptor>  mMessages;  // in order of queue
+        std::vector<MsgWhatCount>   mByWhat;    // most messages first
+        std::vector<MsgTargetCount> mByTarget;  // most messages first
+
+        // log histograms and up to top entries of each, nothing is locked
+        void dump(const char* name, int top = 16) const;
+    };
+
+    //-----------------------------------------------------------------------//
+    // Note: handle refers to a pending message by slot and generation, slot is
+    // released and its generation changes once the message leaves the queue, so a
+    // stale handle is detected and never touches a recycled message. cancel and
+    // isPending are O(1), reschedule is O(1) to unlink plus insertion searching
+    // from the tail of queue. Handle of periodic message keeps valid across ticks
+    // until it is cancelled.
+    class API_EXPORTS MsgHandle
+    {
+        friend class MsgQueue;
+        friend class MsgHandler;
+
+        public:
+            MsgHandle(void) : mQueue(), mIndex(0), mGen(0) { }
+
+            bool cancel(void);
+
+            bool reschedule(long delayMillis);
+
+            bool isPending(void) const;
+
+            void reset(void) { mQueue.reset(); mIndex = 0; mGen = 0; }
+
+        private:
+            std::weak_ptr<MsgQueue> mQueue;
+            uint32                  mIndex;
+            uint32                  mGen;
+    };
+
     //-----------------------------------------------------------------------//
     class API_EXPORTS MsgQueue : private Uncopyable
     {
         friend class MsgLooper;
+        friend class MsgHandle;
+        friend class MsgHandler;
+        friend class VirtualClock;
+        friend class SharedMsgQueue;
         friend struct deleter<MsgQueue>;
         
         public:
@@ -39,7 +123,12 @@ __BEGIN__
 
             const char* getQueueName(void) const { return mName.c_str(); }
 
-            bool enqueueMessage(Message message, uint64 delayDoneTime = 0);
+            bool enqueueMessage(Message message, uint64 delayDoneTime = 0, MsgHandle* handle = nullptr);
+
+            // enqueue messages whose target is set under one lock with one wakeup, return
+            // count of added ones. Invalid messages are left in array, messages refused
+            // by exited queue are recycled
+            int enqueueMessages(Message* messages, int count, uint64 delayDoneTime = 0);
 
             Message obtain(void);
 
@@ -77,13 +166,67 @@ __BEGIN__
 
             int getMsgPoolSize(void) const;
 
+            // millisecond of clock of queue, system time if no clock is set
+            uint64 uptimeMillis(void) const;
+
+            Clock getClock(void) const { return mClock; }
+
+            // times that looper woke up to check queue, timer slack of messages lowers it
+            uint64 getWakeupCount(void) const;
+
             void addIdleHandler(const msgQueueIdleHandler& handler);
             void removeIdleHandler(void);
 
+            // copy descriptors of queued messages, lock is held only while copying them
+            void snapshot(MsgQueueSnapshot& snap) const;
+
+            // both copy under lock and log after it is released
             void dumpQueueList(void) const;
 
             void dumpQueuePool(void) const;
 
+            // fair mode keeps a lane of messages per target handler, ready lanes are served
+            // in turn so a flooding handler can't delay others, order of each handler is
+            // unchanged. Weight is count of messages a handler dispatches in its turn
+            void setFairMode(bool enable);
+
+            bool isFairMode(void) const { return mFair; }
+
+            // weight 1 is default and removes it
+            void setHandlerWeight(MsgHandler* handler, int weight);
+
+            int getHandlerWeight(MsgHandler* handler) const;
+
+            // deadline mode dispatches the ready message of earliest deadline first, see
+            // MsgHandler::sendMessageWithDeadline(), messages without deadline follow in
+            // time order. With expire, a message whose deadline passed goes to expired
+            // handler instead of its target. It takes priority over fair mode
+            void setDeadlineMode(bool enable, bool expire = true);
+
+            bool isDeadlineMode(void) const { return mDeadlineMode; }
+
+            // called on looper thread with expired message, it is recycled after
+            void setExpiredHandler(const msgExpiredHandler& handler, void* context = nullptr);
+
+            uint64 getExpiredCount(void) const;
+
+            // see MsgHandler::setRateLimit(), a message without token is moved to time of
+            // its token once, it doesn't hold up messages of other handlers
+            void setRateLimit(MsgHandler* handler, double ratePerSec, int burst = 1);
+
+            // throttled messages of handler, or of all handlers if it is null
+            uint64 getThrottledCount(MsgHandler* handler = nullptr) const;
+
+            // enqueue messages recovered from journal for durable id of handler
+            int recoverJournal(MsgHandler* handler);
+
+            bool hasJournal(void) const { return mJournal != nullptr; }
+
+            // write every enqueued message into file, see MsgReplayer
+            bool startRecording(const char* path);
+
+            void stopRecording(void);
+
         private:
             MsgQueue(const std::string& name, int MaxMsgPoolSize = 50);
             ~MsgQueue(void);
@@ -92,12 +235,118 @@ __BEGIN__
 
             void recycleMsg(Message msg)  noexcept;
 
+            // been call by looper after dispatching, periodic message is requeued
+            void finishMessage(Message msg)  noexcept;
+
+            // been call by looper before dispatching, expired message is taken and recycled
+            bool expireMessage(Message& msg)  noexcept;
+
+            // safe quit of looper, see MsgLooper::setDrainPolicy()
+            int takeReentrantMessages(std::vector<Message>& messages, uint64 now);
+
+            // messages due at or after time are dropped, durable ones stay in journal
+            int discardMessages(uint64 from);
+
+            void discardMessage(Message msg)  noexcept;
+
+            // publish binding of handler and move its messages, see MsgHandler::migrateTo()
+            int migrateHandler(MsgHandler* handler, MsgQueue* to, MsgBinding* binding);
+
             void clearMsgPool(void);
 
             void quit(bool safely = true);
 
             void setTestOutTimeMillisExit(long t);
 
+            bool openJournal(const char* path);
+
+            // set before messages are sent, see MsgLooper::setClock()
+            void setClock(const Clock& clock);
+
+            // virtual time moved, looper rechecks head
+            void onClockChanged(void);
+
+            // ring of other processes taken by looper, see SharedMsgQueue::startReceiving()
+            bool attachShared(SharedMsgQueue* shared);
+
+            void detachShared(SharedMsgQueue* shared);
+
+            // must hold mLock, looper sleeps on ring's futex when one is attached
+            void waitLooper(long timeoutMillis);
+
+            void notifyLooper(void);
+
+            // must hold mLock, messages of handlers on other queues are left in forward
+            void receiveShared(std::vector<Message>& forward);
+
+            // list operations, must hold mLock
+            void acceptMessage(Message message, uint64 delayDoneTime);
+
+            void insertMessage(Message message);
+
+            Message unlinkMessage(Msg* msg);
+
+            uint64 coalescedWakeTime(void) const;
+
+            void releaseHandle(Msg* msg);
+
+            Msg* findHandle(uint32 index, uint32 gen) const;
+
+            // periodic message of handler (any handler if null) being dispatched, it isn't
+            // in list, a matching remove sets FLAGCANCELED so finishMessage() drops it
+            Msg* dispatchingOf(MsgHandler* handler) const;
+
+            bool cancelHandle(uint32 index, uint32 gen);
+
+            bool rescheduleHandle(uint32 index, uint32 gen, uint64 when);
+
+            void laneInsert(Msg* msg);
+
+            void laneRemove(Msg* msg);
+
+            Msg* nextFairMessage(uint64 now);
+
+            void deadlineInsert(Msg* msg);
+
+            void deadlineRemove(Msg* msg);
+
+            Msg* nextDeadlineMessage(uint64 now);
+
+            bool throttleMessage(Msg* msg, uint64 now);
+
+            // generic cell rate algorithm, a token bucket kept as one time in microsecond
+            struct RateLimit
+            {
+                uint64  mTat;           // theoretical arrival time of next message
+                uint64  mInterval;      // time of one token
+                uint64  mTolerance;     // burst - 1 tokens
+                uint64  mThrottled;
+            };
+
+            // heap entry, key is time for pending heap and deadline for ready heap
+            struct DeadlineEntry
+            {
+                uint64  mKey;
+                Msg*    mMsg;
+
+                bool operator >(const DeadlineEntry& other) const { return mKey > other.mKey; }
+            };
+
+            struct Lane
+            {
+                Msg*    mHead;
+                Msg*    mTail;
+                int     mWeight;
+                int     mCredit;    // messages left in current turn
+            };
+
+            struct HandleSlot
+            {
+                Msg*    mMsg;
+                uint32  mGen;
+                uint32  mNextFree;
+            };
+
         private:
             std::string         mName;
             Message             mMsgQueueHead;
@@ -115,6 +364,30 @@ __BEGIN__
             bool                mQuit;
             bool                mNotEnqueMsg;
             long                mOutTimeTest;
+            MsgJournal*         mJournal;
+            MsgRecorder*        mRecorder;
+            std::vector<HandleSlot> mHandles;
+            uint32              mFreeHandle;    // index + 1 of first free slot
+            Msg*                mDispatching;   // periodic message out of list while it runs
+            uint64              mWakeups;
+            Clock               mClock;
+            bool                mFair;
+            std::unordered_map<MsgHandler*, Lane>   mLanes;
+            std::vector<MsgHandler*>                mLaneOrder;     // ring of non-empty lanes
+            size_t                                  mLaneCursor;
+            std::unordered_map<MsgHandler*, int>    mWeights;
+            bool                                    mDeadlineMode;
+            bool                                    mExpire;
+            std::vector<DeadlineEntry>              mPendingDeadlines;  // min heap by time
+            std::vector<DeadlineEntry>              mReadyDeadlines;    // min heap by deadline
+            uint64                                  mExpiredCount;
+            msgExpiredHandler                       mExpiredHandler;
+            void*                                   mExpiredContext;
+            std::unordered_map<MsgHandler*, RateLimit>  mRateLimits;
+            uint64                                  mThrottled;
+            SharedMsgQueue*                         mShared;
+            bool                                    mSharedWaiting;     // looper is on futex without lock
+            std::vector<Message>                    mSharedBatch;
     };
 
 
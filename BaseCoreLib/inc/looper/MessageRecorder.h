@@ -0,0 +1,83 @@
+/*****************************************************************************
+* FileName    : MessageRecorder.h
+* Description : Record messages of queue into file and replay them definition
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#ifndef __MessageRecorder_h__
+#define __MessageRecorder_h__
+#include "Message.h"
+#include "../os/Mutex.hpp"
+#include <stdio.h>
+#include <map>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+    //-----------------------------------------------------------------------//
+    // Note: recorder is attached to a queue by MsgQueue::startRecording(), every
+    // enqueued message is written with what, args, param bytes, target and the time
+    // relative to start of recording. Times are taken by clock of queue, so a queue
+    // driven by virtual clock records its virtual timeline. Targets are numbered in
+    // the order of their first message. Runnable and callback object can't be saved,
+    // such message is recorded with its what only, so the shape of traffic is still
+    // same.
+    class API_EXPORTS MsgRecorder : private Uncopyable
+    {
+        friend class MsgQueue;
+
+        public:
+            // startMillis is uptime of queue, see MsgQueue::uptimeMillis()
+            static MsgRecorder* create(const char* path, uint64 startMillis);
+
+            ~MsgRecorder(void);
+
+            long getRecordCount(void) const { return mCount; }
+
+        private:
+            MsgRecorder(FILE* fp, uint64 startMillis);
+
+            // when and now are uptime of queue
+            void record(const Msg* msg, uint64 when, uint64 now);
+
+        private:
+            FILE*                       mFile;
+            uint64                      mStartMillis;
+            long                        mCount;
+            std::map<MsgHandler*, int>  mTargets;
+            Mutex                       mMutex;
+    };
+
+    //-----------------------------------------------------------------------//
+    // Note: replayer sends recorded messages by handlers bound with their target
+    // ids, messages of unbound target go to default handler or are skipped. Speed
+    // 1 keeps original intervals, N is N times faster and 0 sends as fast as
+    // possible, delay of message is scaled by same speed.
+    class API_EXPORTS MsgReplayer : private Uncopyable
+    {
+        public:
+            static MsgReplayer* open(const char* path);
+
+            ~MsgReplayer(void);
+
+            void bindHandler(int target, const Handler& h);
+
+            void setDefaultHandler(const Handler& h) { mDefault = h; }
+
+            // blocking in calling thread, return count of messages sent
+            long replay(double speed = 1.0);
+
+        private:
+            MsgReplayer(FILE* fp);
+
+        private:
+            FILE*                       mFile;
+            std::map<int, Handler>      mHandlers;
+            Handler                     mDefault;
+    };
+
+__END__
+
+#endif // __MessageRecorder_h__
@@ -0,0 +1,61 @@
+/*****************************************************************************
+* FileName    : MessageTrace.h
+* Description : Message lifecycle tracing, exported as chrome trace-event json
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#ifndef __MessageTrace_h__
+#define __MessageTrace_h__
+#include "../base/Macro.h"
+#include <atomic>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+    //-----------------------------------------------------------------------//
+    class Msg;
+    class MsgQueue;
+
+    typedef enum
+    {
+        TRACE_ENQUEUE           = 0,
+        TRACE_DEQUEUE           = 1,
+        TRACE_DISPATCH_BEGIN    = 2,
+        TRACE_DISPATCH_END      = 3,
+        TRACE_RECYCLE           = 4,
+    } MsgTraceEvent;
+
+    //-----------------------------------------------------------------------//
+    // Note: every thread that touches a message records into its own lock-free
+    // ring buffer, the ring is only allocated the first time the thread records
+    // an event after enable(). When disabled, the cost of a trace point is one
+    // relaxed atomic load. A full ring drops new events, see getDroppedEvents().
+    class API_EXPORTS MsgTrace
+    {
+        public:
+            static void enable(void);
+
+            static void disable(void);
+
+            static bool isEnabled(void) { return mEnabled.load(std::memory_order_relaxed); }
+
+            static void record(MsgTraceEvent event, Msg* msg, const MsgQueue* queue);
+
+            // drain all rings into a chrome trace-event json file that can be
+            // opened in perfetto or about:tracing, return count of events written
+            static long flush(const char* path);
+
+            static uint64 getDroppedEvents(void);
+
+        private:
+            static std::atomic<bool>    mEnabled;
+    };
+
+    #define MSG_TRACE(event, msg, queue) \
+        do { if (MsgTrace::isEnabled()) MsgTrace::record(event, msg, queue); } while (0)
+
+__END__
+
+#endif // __MessageTrace_h__
@@ -0,0 +1,106 @@
+/*****************************************************************************
+* FileName    : Pipeline.h
+* Description : Multi-stage pipeline linked with SPSC rings definition
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#ifndef __Pipeline_h__
+#define __Pipeline_h__
+#include "Message.h"
+#include <atomic>
+#include <functional>
+#include <vector>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+    //-----------------------------------------------------------------------//
+    class fixed_thread_pool;
+    struct PipeStage;
+    struct PipeLink;
+
+    // return item passed to next stage, nullptr drops it. Return of last stage is ignored
+    typedef std::function<void*(void* item)> pipelineStage;
+
+    //-----------------------------------------------------------------------//
+    // Note: every two stages are linked by a RingQueue which has exactly one producer
+    // and one consumer, so a hop costs no lock, sorting or condition of MsgQueue. A
+    // stage runs on a looper or on a thread pool, it gets one message or task per
+    // batch instead of one per item and never more than one at a time. When ring of
+    // next stage is full the stage keeps its output and returns, the next stage posts
+    // it again after taking items, so no looper or pool thread waits. A slow stage
+    // holds back all stages before it and push() of source at last. Items are
+    // pointers owned by stage functions.
+    class API_EXPORTS Pipeline : private Uncopyable
+    {
+        public:
+            enum WaitStrategy
+            {
+                WAIT_SPIN,      // busy spin, lowest latency and a full core per waiter
+                WAIT_YIELD,     // spin then yield cpu
+                WAIT_BLOCK,     // spin, yield then sleep until notified
+            };
+
+            Pipeline(WaitStrategy wait = WAIT_BLOCK, int batch = 64);
+
+            ~Pipeline(void);
+
+            // stage runs on looper, stages are added before start
+            Pipeline& addStage(const pipelineStage& fn, const Looper& looper);
+
+            // stage runs on threads of pool, which must outlive the pipeline
+            Pipeline& addStage(const pipelineStage& fn, fixed_thread_pool* pool);
+
+            bool start(void);
+
+            // feed first stage from one thread, it waits while ring of first stage is full
+            bool push(void* item);
+
+            bool tryPush(void* item);
+
+            // close source and wait until every pushed item went through all stages. Must
+            // not be called on looper or pool thread of a stage
+            void stop(void);
+
+            int getStageCount(void) const { return (int)mStages.size(); }
+
+            uint64 getProcessedCount(int stage) const;
+
+        private:
+            Pipeline& addStage(PipeStage* stage);
+
+            int drainStage(PipeStage* stage);
+
+            void runStage(PipeStage* stage);
+
+            bool parkStage(PipeStage* stage);
+
+            bool pushLink(PipeLink* link, void* item, bool block);
+
+            void wakeConsumer(PipeLink* link);
+
+            void postStage(PipeStage* stage);
+
+            void finishStage(PipeStage* stage);
+
+            static void onLooperDrain(const Message& msg, void* context);
+
+            static void onPoolDrain(void* context);
+
+            static void onLooperFence(const Message& msg, void* context);
+
+        private:
+            WaitStrategy                mWait;
+            int                         mBatch;
+            bool                        mStarted;
+            bool                        mStopped;
+            bool                        mInvalid;   // a stage was added without looper or pool
+            std::vector<PipeStage*>     mStages;
+            std::vector<PipeLink*>      mLinks;     // link i is input of stage i
+    };
+
+__END__
+
+#endif // __Pipeline_h__
@@ -0,0 +1,122 @@
+/*****************************************************************************
+* FileName    : SharedMessageQueue.h
+* Description : Cross-process message queue in shared memory definition
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#ifndef __SharedMessageQueue_h__
+#define __SharedMessageQueue_h__
+#include "Message.h"
+#include "../os/Mutex.hpp"
+#include <atomic>
+#include <map>
+#include <vector>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+    //-----------------------------------------------------------------------//
+    struct SharedQueueHeader;
+    struct SharedQueueSlot;
+
+    //-----------------------------------------------------------------------//
+    // Note: the queue is a bounded ring of fixed-size slots placed in a POSIX shm
+    // or memfd segment, senders of any process claim a slot lock-free and the
+    // receiver sleeps on a futex in the segment, so a message costs no syscall
+    // unless the receiver is asleep. The process that creates the queue receives,
+    // the ring is attached to a looper which takes messages from it on its own
+    // thread and dispatches them to the handler bound with the target id. A slot
+    // claimed by a sender that died before publishing it is skipped. Only Linux
+    // is supported.
+    class API_EXPORTS SharedMsgQueue : private Uncopyable
+    {
+        friend class MsgQueue;
+
+        public:
+            // receiver side, name nullptr creates an anonymous memfd segment which
+            // is inherited by forked children through getFd()
+            static SharedMsgQueue* create(const char* name, int slotCount = 1024, int maxParamBytes = 256);
+
+            // sender side
+            static SharedMsgQueue* open(const char* name);
+
+            static SharedMsgQueue* attach(int fd);
+
+            static void unlink(const char* name);
+
+            ~SharedMsgQueue(void);
+
+            int getFd(void) const { return mFd; }
+
+            int getMaxParamBytes(void) const;
+
+            // same as MsgHandler's, param bytes of message are copied into the slot,
+            // return false when the queue is full or param is too large
+            bool sendMessage(Message msg, int target = 0);
+
+            bool sendMessageDelayed(Message msg, long delayMillis, int target = 0);
+
+            bool sendEmptyMessage(int what, int target = 0);
+
+            bool sendEmptyMessage(int what, long delayMillis, int target = 0);
+
+            // receiver: messages with target id are forwarded to handler
+            void bindHandler(const Handler& h, int target = 0);
+
+            void unbindHandler(int target = 0);
+
+            // attach ring to looper, it waits on the ring as well as its queue and takes
+            // messages between local ones. A looper receives one ring at most
+            bool startReceiving(const Looper& looper);
+
+            void stopReceiving(void);
+
+            int getQueueSize(void) const;
+
+        private:
+            SharedMsgQueue(int fd, void* addr, size_t bytes, bool owner);
+
+            bool enqueue(int what, int arg1, int arg2, const void* param, size_t bytes, uint64 when, int target);
+
+            // an entry of sender table in segment for this process, claims name it
+            bool registerSender(void);
+
+            bool claimAlive(uint64 claim) const;
+
+            // receiver side, called by looper of receiving queue under its lock
+            bool headReady(void);
+
+            bool dequeue(Message& msg, int& target);
+
+            int takeMessages(std::vector<Message>& messages, int maxCount);
+
+            void waitMessage(Mutex* lock, long timeoutMillis);
+
+            void wake(void);
+
+            SharedQueueSlot* slotAt(uint64 pos) const;
+
+        private:
+            int                     mFd;
+            SharedQueueHeader*      mHeader;
+            size_t                  mBytes;
+            bool                    mOwner;
+            Mutex                   mHandlersMutex;
+            std::map<int, Handler>  mHandlers;
+            Queue                   mReceiver;
+            uint64                  mStuckPos;      // head slot claimed but not published
+            uint64                  mStuckSince;
+            uint32                  mSlotCount;     // copied from header once it is checked
+            uint32                  mSlotBytes;
+            uint32                  mMaxParamBytes;
+            Mutex                   mSenderMutex;
+            uint64                  mSenderId;      // generation << 32 | pid of entry
+            std::atomic<uint64>     mSenderClaim;   // generation << 8 | index of entry
+            std::atomic<uint32>     mForkGen;
+    };
+
+__END__
+
+#endif // __SharedMessageQueue_h__
@@ -0,0 +1,137 @@
+/*****************************************************************************
+* FileName    : Buffer.h
+* Description : Reference counted buffer definition
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#ifndef __Buffer_h__
+#define __Buffer_h__
+#include "../base/Uncopyable.hpp"
+#include <atomic>
+#include <stddef.h>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+    //-----------------------------------------------------------------------//
+    class BufferRef;
+    class BufferPool;
+    struct BufferPoolCore;
+
+    //-----------------------------------------------------------------------//
+    // Note: block of bytes with a reference count, bytes follow the header in same
+    // allocation. It is only reached through BufferRef, the last reference frees it
+    // or gives it back to its pool
+    class API_EXPORTS Buffer : private Uncopyable
+    {
+        friend class BufferRef;
+        friend class BufferPool;
+        friend class Msg;
+
+        public:
+            static BufferRef create(size_t capacity);
+
+            size_t capacity(void) const { return mCapacity; }
+
+            char* data(void) { return (char*)this + headerSize(); }
+
+        private:
+            Buffer(size_t capacity, BufferPoolCore* pool);
+            ~Buffer(void) = default;
+
+            static Buffer* alloc(size_t capacity, BufferPoolCore* pool);
+
+            static size_t headerSize(void) { return (sizeof(Buffer) + 15) & ~(size_t)15; }
+
+            static Buffer* fromData(void* data) { return (Buffer*)((char*)data - headerSize()); }
+
+            void addRef(void) { mRefs.fetch_add(1, std::memory_order_relaxed); }
+
+            void release(void);
+
+        private:
+            std::atomic<int>    mRefs;
+            size_t              mCapacity;
+            BufferPoolCore*     mPool;
+    };
+
+    //-----------------------------------------------------------------------//
+    // Note: a view of a buffer, copying it only bumps the count. Slices share the
+    // bytes, so a buffer is filled while it is unique and read only after it is
+    // passed on. Msg::setBuffer() carries it to other loopers without copying
+    class API_EXPORTS BufferRef
+    {
+        friend class Buffer;
+        friend class BufferPool;
+        friend class Msg;
+
+        public:
+            BufferRef(void) : mBuffer(nullptr), mOffset(0), mSize(0) { }
+
+            BufferRef(const BufferRef& other);
+
+            BufferRef(BufferRef&& other) noexcept;
+
+            BufferRef& operator =(const BufferRef& other);
+
+            BufferRef& operator =(BufferRef&& other) noexcept;
+
+            ~BufferRef(void) { reset(); }
+
+            bool isValid(void) const { return mBuffer != nullptr; }
+
+            char* data(void) const { return mBuffer ? mBuffer->data() + mOffset : nullptr; }
+
+            size_t size(void) const { return mSize; }
+
+            // bytes from offset of view to end of buffer
+            size_t capacity(void) const { return mBuffer ? mBuffer->mCapacity - mOffset : 0; }
+
+            // size is set after filling, it can't pass capacity
+            bool setSize(size_t size);
+
+            // a view of part of this one, it shares the bytes
+            BufferRef slice(size_t offset, size_t length) const;
+
+            // no other reference, writing bytes is safe
+            bool isUnique(void) const;
+
+            void reset(void);
+
+        private:
+            // takes one reference of buffer
+            BufferRef(Buffer* buffer, size_t offset, size_t size) : mBuffer(buffer), mOffset(offset), mSize(size) { }
+
+        private:
+            Buffer*     mBuffer;
+            size_t      mOffset;
+            size_t      mSize;
+    };
+
+    //-----------------------------------------------------------------------//
+    // Note: buffers of fixed block size, released ones are kept for next obtain so
+    // a steady flow of messages doesn't allocate. Buffers may outlive the pool, they
+    // are freed instead of cached then
+    class API_EXPORTS BufferPool : private Uncopyable
+    {
+        public:
+            BufferPool(size_t blockSize, int maxCached = 64);
+
+            ~BufferPool(void);
+
+            // a bigger request than block size gets a buffer out of the pool
+            BufferRef obtain(size_t bytes = 0);
+
+            size_t getBlockSize(void) const;
+
+            int getCachedCount(void) const;
+
+        private:
+            BufferPoolCore*     mCore;
+    };
+
+__END__
+
+#endif // __Buffer_h__
@@ -9,6 +9,7 @@
 #ifndef __CircularQueue_h__
 #define __CircularQueue_h__
 #include "../base/Macro.h"
+#include <array>
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
@@ -43,7 +43,7 @@ __BEGIN__
                 int ret =  pthread_cond_init(&mCond, nullptr);
                  if(ret != 0)
                  {
-                     LOGE("%s", "fail to pthread_cond_init: %s", stderr(ret));
+                     LOGE("fail to pthread_cond_init: %s", strerror(ret));
                     exit(EXIT_FAILURE);
                  }
 #endif
@@ -76,7 +76,7 @@ __BEGIN__
                 int ret =  pthread_cond_init(&mCond, nullptr);
                  if(ret != 0)
                  {
-                     LOGE("%s", "fail to pthread_cond_init: %s", stderr(ret));
+                     LOGE("fail to pthread_cond_init: %s", strerror(ret));
                      exit(EXIT_FAILURE);
                  }
 #endif
@@ -157,13 +157,13 @@ __BEGIN__
                     timeval now;
                     gettimeofday(&now, nullptr);
                     abstime.tv_sec = now.tv_sec;
-                    abstime.tv_nsec = now.tv_usec;
+                    abstime.tv_nsec = now.tv_usec * 1000;
 #else
                     (void)clock_gettime(CLOCK_REALTIME, &abstime);
 #endif
                     if (timeout)
                     {
-                        long nsec = abstime.tv_usec * 1000 + (millisecond % 1000) * 1000000;
+                        long nsec = abstime.tv_nsec + (millisecond % 1000) * 1000000;
                         abstime.tv_sec += nsec / 1000000000 + millisecond / 1000;
                         abstime.tv_nsec = nsec % 1000000000;
                     }
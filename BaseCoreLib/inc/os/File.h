@@ -9,6 +9,7 @@
 #ifndef __File_h__
 #define __File_h__
 #include "../base/Macro.h"
+#include "Buffer.h"
 #include <stdio.h>
 #include <string>
 #include <vector>
@@ -75,6 +76,11 @@ __BEGIN__
             static uint64 readFile(File* file, std::string& buffer);
             
             static void *readFile(const char* filePath, uint64* size);
+
+            // read into one buffer without copying, it comes from pool if it fits a block
+            static uint64 readFile(const char* filePath, BufferRef& buffer, BufferPool* pool = nullptr);
+
+            static uint64 readFile(File* file, BufferRef& buffer, BufferPool* pool = nullptr);
             
             static bool saveFile(const char* filePath, void* data, uint64 size);
             
@@ -29,11 +29,11 @@ __BEGIN__
     } LogPriority;
     
     // Note: you should define LOG_TAG before using follow macros
-    #define LOG_TAGD(LOG_TAG)   STR(D:)##STR(LOG_TAG)
-    #define LOG_TAGI(LOG_TAG)   STR(I:)##STR(LOG_TAG)
-    #define LOG_TAGW(LOG_TAG)   STR(W:)##STR(LOG_TAG)
-    #define LOG_TAGE(LOG_TAG)   STR(E:)##STR(LOG_TAG)
-    #define LOG_TAGF(LOG_TAG)   STR(F:)##STR(LOG_TAG)
+    #define LOG_TAGD(LOG_TAG)   STR(D:) STR(LOG_TAG)
+    #define LOG_TAGI(LOG_TAG)   STR(I:) STR(LOG_TAG)
+    #define LOG_TAGW(LOG_TAG)   STR(W:) STR(LOG_TAG)
+    #define LOG_TAGE(LOG_TAG)   STR(E:) STR(LOG_TAG)
+    #define LOG_TAGF(LOG_TAG)   STR(F:) STR(LOG_TAG)
     
     void logPrint(LogPriority prio, const char* tag, const char* fmt, ...);
     
@@ -64,8 +64,8 @@ __BEGIN__
 
             ~Mutex(void)
             {
-                if (!mMutex) return;
 #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+                if (!mMutex) return;
                 delete mMutex; mMutex = nullptr;
 #else
                 pthread_mutex_destroy(&mMutex);
@@ -74,8 +74,8 @@ __BEGIN__
 
             void lock(void)
             {
-                if (!mMutex) return;
 #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+                if (!mMutex) return;
                 if (mMutexType == PTHREAD_MUTEX_TIMED_NP)
                     ((std::mutex*)mMutex)->lock();
                 else if (mMutexType == PTHREAD_MUTEX_ADAPTIVE_NP)
@@ -91,9 +91,9 @@ __BEGIN__
 
             int trylock(void)
             {
-                if (!mMutex) return -1;
                 bool ret = false;
 #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+                if (!mMutex) return -1;
                 if (mMutexType == PTHREAD_MUTEX_TIMED_NP)
                     ret = ((std::mutex*)mMutex)->try_lock();
                 else if (mMutexType == PTHREAD_MUTEX_ADAPTIVE_NP)
@@ -110,8 +110,8 @@ __BEGIN__
 
             void unlock(void)
             {
-                if (!mMutex) return;
 #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+                if (!mMutex) return;
                 if (mMutexType == PTHREAD_MUTEX_TIMED_NP)
                     ((std::mutex*)mMutex)->unlock();
                 else if (mMutexType == PTHREAD_MUTEX_ADAPTIVE_NP)
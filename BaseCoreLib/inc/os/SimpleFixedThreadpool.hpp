@@ -9,6 +9,8 @@
 #ifndef __SimpleFixedThreadpool_h__
 #define __SimpleFixedThreadpool_h__
 #include "../base/Macro.h"
+#include <algorithm>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
@@ -34,7 +36,7 @@ __BEGIN__
 							auto iter = std::find_if(data->funParams.begin(), data->funParams.end(),
 								[func](const auto& item) {
 									void (* const* ptrf)(void*) = func.target<void(*)(void*)>();
-									void (* const* ptrf1)(void*) = item.second.target<void(*)(void*)>();
+									void (* const* ptrf1)(void*) = item.second.template target<void(*)(void*)>();
 									if (ptrf && ptrf1 && *ptrf == *ptrf1)
 										return true;
 									return false;
@@ -105,7 +107,7 @@ __BEGIN__
 		}
 	};
 	
-	void threadFunc(void* args) {
+	inline void poolThreadFunc(void* args) {
 		if (args) {
 			struct param* cl = (struct param*)args;
 			
@@ -118,7 +120,7 @@ __BEGIN__
 	
 	//example:
 	//fixed_thread_pool* threadpoolPtr = new fixed_thread_pool(10);
-	//threadpoolPtr->execute(std::function<void(void*)>(threadFunc), new struct param());
+	//threadpoolPtr->execute(std::function<void(void*)>(poolThreadFunc), new struct param());
 	//delete threadpoolPtr;
 
 __END__
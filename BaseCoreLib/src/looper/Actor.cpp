@@ -0,0 +1,306 @@
+/*****************************************************************************
+* FileName    : Actor.cpp
+* Description : Actors sharing a fixed set of looper threads implemention
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#include "../../inc/looper/Actor.h"
+#include "../../inc/looper/LooperThread.h"
+#include "../../inc/looper/MessageHandler.h"
+#include "../../inc/os/AutoMutex.hpp"
+#include "../../inc/os/Logger.h"
+#include <stdio.h>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+   //------------------------------------------------------------------------//
+    #ifdef LOG_TAG
+        #undef LOG_TAG
+    #endif
+    #define LOG_TAG (Actor):
+
+    //------------------------------------------------------------------------//
+    Actor::Actor(void)
+    : mMailbox(nullptr)
+    , mHead(nullptr)
+    , mTail(nullptr)
+    , mScheduled(0)
+    , mTellers(0)
+    , mStopping(false)
+    , mStopMarked(false)
+    , mLooper(0)
+    , mSystem(nullptr)
+    , mPrev(nullptr)
+    , mNext(nullptr)
+    {
+    }
+
+    //------------------------------------------------------------------------//
+    Actor::~Actor(void)
+    {
+        takeMailbox();
+        while (mHead)
+        {
+            Msg* m = mHead;
+            mHead = m->mLaneNext;
+            m->mLaneNext = nullptr;
+            Message(m).reset();
+        }
+
+        mTail = nullptr;
+        mSystem = nullptr;
+    }
+
+    //------------------------------------------------------------------------//
+    bool Actor::tell(Message msg)
+    {
+        if (msg.get() == nullptr || mSystem == nullptr)
+        {
+            LOGE("%s", "message is null or actor isn't spawned");
+            return false;
+        }
+
+        // counted before stopping is checked, looper which sees no teller after stop mark
+        // knows every later tell() fails here
+        mTellers.fetch_add(1);
+        if (mStopping.load())
+        {
+            mTellers.fetch_sub(1);
+            LOGW("%s", "actor is stopping, message is dropped");
+            return false;
+        }
+
+        push(msg.release());
+        mTellers.fetch_sub(1);      // actor may be deleted from here
+        return true;
+    }
+
+    //------------------------------------------------------------------------//
+    bool Actor::tell(int what, int arg1 /* = 0 */, int arg2 /* = 0 */)
+    {
+        return tell(Msg::obtain(what, arg1, arg2));
+    }
+
+    //------------------------------------------------------------------------//
+    void Actor::push(Msg* m)
+    {
+        // mailbox is only taken whole, so pushing has no ABA problem
+        Msg* head = mMailbox.load(std::memory_order_relaxed);
+        do
+        {
+            m->mLaneNext = head;
+        } while (!mMailbox.compare_exchange_weak(head, m));
+
+        // first sender after actor went idle gives it a turn
+        if (mScheduled.exchange(1) == 0)
+            mSystem->schedule(this);
+    }
+
+    //------------------------------------------------------------------------//
+    bool Actor::takeMailbox(void)
+    {
+        Msg* m = mMailbox.exchange(nullptr);
+        if (m == nullptr)
+            return false;
+
+        // stack is newest first, reversing it gives order of telling
+        Msg* list = nullptr;
+        Msg* last = m;
+        while (m)
+        {
+            Msg* next = m->mLaneNext;
+            m->mLaneNext = list;
+            list = m;
+            m = next;
+        }
+
+        if (mTail)
+            mTail->mLaneNext = list;
+        else
+            mHead = list;
+        mTail = last;
+        return true;
+    }
+
+    //------------------------------------------------------------------------//
+    ActorSystem::ActorSystem(int threads, int batch /* = 16 */)
+    : mBatch(batch > 0 ? batch : 1)
+    , mThreads()
+    , mHandlers()
+    , mNextLooper(0)
+    , mActorCount(0)
+    , mActors(nullptr)
+    , mMutex()
+    {
+        if (threads < 1)
+            threads = 1;
+
+        char name[32];
+        for (int i = 0; i < threads; i++)
+        {
+            snprintf(name, sizeof(name), "actor-%d", i);
+            LooperThread* t = new LooperThread(name);
+            mThreads.push_back(t);
+            mHandlers.push_back(MsgHandler::createHandler(t->getLooper(), this));
+        }
+    }
+
+    //------------------------------------------------------------------------//
+    ActorSystem::~ActorSystem(void)
+    {
+        for (size_t i = 0; i < mThreads.size(); i++)
+            mThreads[i]->quit();
+
+        // a running turn may schedule again, handlers are kept until loopers exited
+        for (size_t i = 0; i < mThreads.size(); i++)
+            delete mThreads[i];
+        mThreads.clear();
+        mHandlers.clear();
+
+        AutoMutex critical(&mMutex);
+        while (mActors)
+        {
+            Actor* actor = mActors;
+            mActors = actor->mNext;
+            delete actor;
+        }
+        mActorCount.store(0, std::memory_order_relaxed);
+    }
+
+    //------------------------------------------------------------------------//
+    Actor* ActorSystem::spawn(Actor* actor)
+    {
+        if (actor == nullptr || actor->mSystem)
+        {
+            LOGE("%s", "actor is null or spawned already");
+            return nullptr;
+        }
+
+        actor->mLooper = mNextLooper.fetch_add(1, std::memory_order_relaxed) % (uint32)mThreads.size();
+        actor->mSystem = this;
+        {
+            AutoMutex critical(&mMutex);
+            actor->mNext = mActors;
+            if (mActors)
+                mActors->mPrev = actor;
+            mActors = actor;
+        }
+        mActorCount.fetch_add(1, std::memory_order_relaxed);
+        return actor;
+    }
+
+    //------------------------------------------------------------------------//
+    void ActorSystem::stop(Actor* actor)
+    {
+        if (actor == nullptr || actor->mSystem != this)
+            return;
+
+        // mark goes through mailbox, so messages told before it are handled first
+        actor->mTellers.fetch_add(1);
+        if (!actor->mStopping.exchange(true))
+            actor->push(Msg::obtain(onStop).release());
+        actor->mTellers.fetch_sub(1);
+    }
+
+    //------------------------------------------------------------------------//
+    void ActorSystem::remove(Actor* actor)
+    {
+        {
+            AutoMutex critical(&mMutex);
+            if (actor->mPrev)
+                actor->mPrev->mNext = actor->mNext;
+            else
+                mActors = actor->mNext;
+            if (actor->mNext)
+                actor->mNext->mPrev = actor->mPrev;
+        }
+
+        mActorCount.fetch_sub(1, std::memory_order_relaxed);
+        delete actor;
+    }
+
+    //------------------------------------------------------------------------//
+    Looper ActorSystem::getLooper(int index) const
+    {
+        if (index < 0 || index >= (int)mThreads.size())
+            return Looper(nullptr);
+
+        return mThreads[index]->getLooper();
+    }
+
+    //------------------------------------------------------------------------//
+    void ActorSystem::schedule(Actor* actor)
+    {
+        MsgHandler* h = mHandlers[actor->mLooper].get();
+        Message m = Msg::obtain(onTurn);
+        m->setParam(actor, 0);
+        h->sendMessage(std::move(m));
+    }
+
+    //------------------------------------------------------------------------//
+    void ActorSystem::runTurn(Actor* actor)
+    {
+        for (int i = 0; i < mBatch; i++)
+        {
+            if (actor->mHead == nullptr && !actor->takeMailbox())
+                break;
+
+            Msg* m = actor->mHead;
+            actor->mHead = m->mLaneNext;
+            if (actor->mHead == nullptr)
+                actor->mTail = nullptr;
+            m->mLaneNext = nullptr;
+
+            Message msg(m);
+            if (msg->mCallback == onStop)
+            {
+                actor->mStopMarked = true;
+                continue;
+            }
+
+            actor->onReceive(msg);
+        }
+
+        // a teller which passed stopping check before stop() still pushes, its message
+        // is handled in next turn. Tellers counted zero first, so what they pushed is
+        // seen. Stopped actor keeps its turn until it is deleted
+        if (actor->mStopMarked)
+        {
+            if (actor->mTellers.load() == 0 && actor->mHead == nullptr && actor->mMailbox.load() == nullptr)
+                remove(actor);
+            else
+                schedule(actor);
+            return;
+        }
+
+        // more messages, actor goes to back of queue of looper
+        if (actor->mHead || actor->mMailbox.load())
+        {
+            schedule(actor);
+            return;
+        }
+
+        // a sender which pushed before this store saw a turn and didn't schedule, so
+        // mailbox is checked again after actor is marked idle
+        actor->mScheduled.store(0);
+        if (actor->mMailbox.load() && actor->mScheduled.exchange(1) == 0)
+            schedule(actor);
+    }
+
+    //------------------------------------------------------------------------//
+    void ActorSystem::onTurn(const Message& msg, void* context)
+    {
+        Actor* actor = (Actor*)msg->getParam();
+        actor->mSystem->runTurn(actor);
+    }
+
+    //------------------------------------------------------------------------//
+    void ActorSystem::onStop(const Message& msg, void* context)
+    {
+        // only a mark in mailbox, runTurn() deletes actor
+    }
+
+__END__
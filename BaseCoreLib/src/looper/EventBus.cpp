@@ -0,0 +1,250 @@
+/*****************************************************************************
+* FileName    : EventBus.cpp
+* Description : Topic based publish and subscribe of handlers implemention
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#include "../../inc/looper/EventBus.h"
+#include "../../inc/looper/MessageHandler.h"
+#include "../../inc/looper/MessageQueue.h"
+#include "../../inc/os/AutoMutex.hpp"
+#include "../../inc/os/Logger.h"
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+   //------------------------------------------------------------------------//
+    #ifdef LOG_TAG
+        #undef LOG_TAG
+    #endif
+    #define LOG_TAG (EventBus):
+
+    //------------------------------------------------------------------------//
+    // header in front of payload bytes, the size keeps bytes aligned for any type
+    struct EventPayload
+    {
+        std::atomic<int>    mRefs;
+        size_t              mBytes;
+    };
+
+    #define EVENT_PAYLOAD_HEADER    ((sizeof(EventPayload) + 15) & ~(size_t)15)
+
+    static inline EventPayload* payloadHeader(void* payload)
+    {
+        return (EventPayload*)((char*)payload - EVENT_PAYLOAD_HEADER);
+    }
+
+    //------------------------------------------------------------------------//
+    EventBus::EventBus(void)
+    : mMutex()
+    , mTopics()
+    {
+    }
+
+    //------------------------------------------------------------------------//
+    EventBus::~EventBus(void)
+    {
+        AutoMutex lock(&mMutex);
+        mTopics.clear();
+    }
+
+    //------------------------------------------------------------------------//
+    void EventBus::setSubscribers(int topic, Subscribers* subs)
+    {
+        if (subs->mCount == 0)
+        {
+            delete subs;
+            mTopics.erase(topic);
+            return;
+        }
+
+        mTopics[topic] = SubscribersPtr(subs);
+    }
+
+    //------------------------------------------------------------------------//
+    bool EventBus::subscribe(int topic, const Handler& handler)
+    {
+        if (handler.get() == nullptr || handler->queue().get() == nullptr)
+        {
+            LOGE("%s", "handler is null or without looper, it can't subscribe");
+            return false;
+        }
+
+        AutoMutex lock(&mMutex);
+        std::unordered_map<int, SubscribersPtr>::iterator it = mTopics.find(topic);
+        Subscribers* subs = it != mTopics.end() ? new Subscribers(*it->second) : new Subscribers();
+
+        QueueGroup* group = nullptr;
+        for (size_t i = 0; i < subs->mGroups.size(); i++)
+        {
+            if (subs->mGroups[i].mQueue == handler->queue())
+            {
+                group = &subs->mGroups[i];
+                break;
+            }
+        }
+
+        if (group == nullptr)
+        {
+            subs->mGroups.push_back(QueueGroup());
+            group = &subs->mGroups.back();
+            group->mQueue = handler->queue();
+        }
+
+        for (size_t i = 0; i < group->mHandlers.size(); i++)
+        {
+            if (group->mHandlers[i] == handler)
+            {
+                delete subs;
+                return true;
+            }
+        }
+
+        group->mHandlers.push_back(handler);
+        subs->mCount++;
+        setSubscribers(topic, subs);
+        return true;
+    }
+
+    //------------------------------------------------------------------------//
+    void EventBus::unsubscribe(int topic, const Handler& handler)
+    {
+        AutoMutex lock(&mMutex);
+        std::unordered_map<int, SubscribersPtr>::iterator it = mTopics.find(topic);
+        if (it == mTopics.end())
+            return;
+
+        Subscribers* subs = new Subscribers(*it->second);
+        for (size_t i = 0; i < subs->mGroups.size(); i++)
+        {
+            std::vector<Handler>& handlers = subs->mGroups[i].mHandlers;
+            for (size_t j = 0; j < handlers.size(); j++)
+            {
+                if (handlers[j] != handler)
+                    continue;
+
+                handlers.erase(handlers.begin() + j);
+                subs->mCount--;
+                if (handlers.empty())
+                    subs->mGroups.erase(subs->mGroups.begin() + i);
+                setSubscribers(topic, subs);
+                return;
+            }
+        }
+
+        delete subs;
+    }
+
+    //------------------------------------------------------------------------//
+    void EventBus::unsubscribe(const Handler& handler)
+    {
+        std::vector<int> topics;
+        {
+            AutoMutex lock(&mMutex);
+            for (std::unordered_map<int, SubscribersPtr>::iterator it = mTopics.begin(); it != mTopics.end(); ++it)
+                topics.push_back(it->first);
+        }
+
+        for (size_t i = 0; i < topics.size(); i++)
+            unsubscribe(topics[i], handler);
+    }
+
+    //------------------------------------------------------------------------//
+    int EventBus::getSubscriberCount(int topic) const
+    {
+        AutoMutex lock(&mMutex);
+        std::unordered_map<int, SubscribersPtr>::const_iterator it = mTopics.find(topic);
+        return it != mTopics.end() ? it->second->mCount : 0;
+    }
+
+    //------------------------------------------------------------------------//
+    int EventBus::publish(int topic, const void* data, size_t bytes, int arg1 /* = 0 */, int arg2 /* = 0 */)
+    {
+        SubscribersPtr subs;
+        {
+            AutoMutex lock(&mMutex);
+            std::unordered_map<int, SubscribersPtr>::iterator it = mTopics.find(topic);
+            if (it == mTopics.end())
+                return 0;
+            subs = it->second;
+        }
+
+        // one copy for all subscribers, each message holds a reference
+        void* payload = nullptr;
+        if (data && bytes > 0)
+        {
+            EventPayload* p = (EventPayload*)malloc(EVENT_PAYLOAD_HEADER + bytes);
+            if (p == nullptr)
+            {
+                LOGE("%s", "out of memory, event isn't published");
+                return 0;
+            }
+
+            new (&p->mRefs) std::atomic<int>(subs->mCount);
+            p->mBytes = bytes;
+            payload = (char*)p + EVENT_PAYLOAD_HEADER;
+            memcpy(payload, data, bytes);
+        }
+
+        int sent = 0;
+        std::vector<Message> batch;
+        for (size_t i = 0; i < subs->mGroups.size(); i++)
+        {
+            const QueueGroup& group = subs->mGroups[i];
+            batch.clear();
+            for (size_t j = 0; j < group.mHandlers.size(); j++)
+            {
+                MsgHandler* h = group.mHandlers[j].get();
+                Message m = Msg::obtain(group.mHandlers[j]);
+                m->mWhat = topic;
+                m->mArg1 = arg1;
+                m->mArg2 = arg2;
+                m->mTarget = h;
+                m->mSlack = (int)h->mTimerSlack;
+                if (payload)
+                    m->setParam(payload, bytes, releasePayload);
+                batch.push_back(std::move(m));
+            }
+
+            // messages which aren't added release their reference when batch is cleared
+            sent += group.mQueue->enqueueMessages(batch.data(), (int)batch.size(), group.mQueue->uptimeMillis());
+        }
+
+        return sent;
+    }
+
+    //------------------------------------------------------------------------//
+    void* EventBus::retain(void* payload)
+    {
+        if (payload)
+            payloadHeader(payload)->mRefs.fetch_add(1, std::memory_order_relaxed);
+        return payload;
+    }
+
+    //------------------------------------------------------------------------//
+    void EventBus::release(void* payload)
+    {
+        if (payload == nullptr)
+            return;
+
+        EventPayload* p = payloadHeader(payload);
+        if (p->mRefs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            p->mRefs.~atomic<int>();
+            free(p);
+        }
+    }
+
+    //------------------------------------------------------------------------//
+    void EventBus::releasePayload(void* payload, size_t bytes)
+    {
+        release(payload);
+    }
+
+__END__
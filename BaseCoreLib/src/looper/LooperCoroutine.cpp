@@ -0,0 +1,164 @@
+/*****************************************************************************
+* FileName    : LooperCoroutine.cpp
+* Description : C++20 coroutines running on message loopers implemention
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#include "../../inc/looper/LooperCoroutine.h"
+#include "../../inc/looper/MessageLooper.h"
+#include "../../inc/os/Logger.h"
+#include <stdlib.h>
+
+#if defined(__cpp_impl_coroutine)
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+   //------------------------------------------------------------------------//
+    #ifdef LOG_TAG
+        #undef LOG_TAG
+    #endif
+    #define LOG_TAG (LooperCoroutine):
+
+    //------------------------------------------------------------------------//
+    #define COROUTINE_FRAME_GRAIN       64      // frames are cached by size in steps of it
+    #define COROUTINE_FRAME_CLASSES     32      // bigger frames go to malloc directly
+    #define COROUTINE_FRAME_CACHED      16      // cached frames of each size
+
+    //------------------------------------------------------------------------//
+    // Frames are plain malloc blocks, so a coroutine may end on another looper than
+    // the one created it, the block goes to cache of that thread or back to heap.
+    // Handler of looper is created once per thread for resuming awaiters
+    struct CoThreadContext
+    {
+        void*       mFrames[COROUTINE_FRAME_CLASSES];
+        int         mCounts[COROUTINE_FRAME_CLASSES];
+        MsgLooper*  mLooper;
+        Handler     mHandler;
+
+        CoThreadContext(void) : mLooper(nullptr), mHandler(nullptr)
+        {
+            for (int i = 0; i < COROUTINE_FRAME_CLASSES; i++)
+            {
+                mFrames[i] = nullptr;
+                mCounts[i] = 0;
+            }
+        }
+
+        ~CoThreadContext(void)
+        {
+            for (int i = 0; i < COROUTINE_FRAME_CLASSES; i++)
+            {
+                while (mFrames[i])
+                {
+                    void* p = mFrames[i];
+                    mFrames[i] = *(void**)p;
+                    free(p);
+                }
+            }
+        }
+    };
+
+    static threadlocal CoThreadContext gCoContext;
+
+    //------------------------------------------------------------------------//
+    void* LooperCoroutine::allocFrame(size_t bytes) noexcept
+    {
+        size_t cls = (bytes + COROUTINE_FRAME_GRAIN - 1) / COROUTINE_FRAME_GRAIN;
+        if (cls >= COROUTINE_FRAME_CLASSES)
+            return malloc(bytes);
+
+        CoThreadContext& ctx = gCoContext;
+        void* p = ctx.mFrames[cls];
+        if (p)
+        {
+            ctx.mFrames[cls] = *(void**)p;
+            ctx.mCounts[cls]--;
+            return p;
+        }
+
+        // whole class size, so the block fits any frame of same class when it is reused
+        p = malloc(cls * COROUTINE_FRAME_GRAIN);
+        if (p == nullptr)
+            LOGE("%s", "out of memory, coroutine frame can't be allocated");
+        return p;
+    }
+
+    //------------------------------------------------------------------------//
+    void LooperCoroutine::freeFrame(void* frame, size_t bytes) noexcept
+    {
+        if (frame == nullptr)
+            return;
+
+        size_t cls = (bytes + COROUTINE_FRAME_GRAIN - 1) / COROUTINE_FRAME_GRAIN;
+        CoThreadContext& ctx = gCoContext;
+        if (cls >= COROUTINE_FRAME_CLASSES || ctx.mCounts[cls] >= COROUTINE_FRAME_CACHED)
+        {
+            free(frame);
+            return;
+        }
+
+        *(void**)frame = ctx.mFrames[cls];
+        ctx.mFrames[cls] = frame;
+        ctx.mCounts[cls]++;
+    }
+
+    //------------------------------------------------------------------------//
+    MsgHandler* LooperCoroutine::currentHandler(void)
+    {
+        // read the thread local looper directly, copying it costs an atomic refcount per await
+        MsgLooper* l = MsgLooper::mThreadLocal.get();
+        if (l == nullptr)
+            return nullptr;
+
+        CoThreadContext& ctx = gCoContext;
+        if (ctx.mLooper != l)
+        {
+            ctx.mHandler = MsgHandler::createHandler(MsgLooper::mThreadLocal);
+            ctx.mLooper = l;
+        }
+
+        return ctx.mHandler.get();
+    }
+
+    //------------------------------------------------------------------------//
+    MsgHandler* LooperCoroutine::handlerOf(const MsgLooper* looper)
+    {
+        if (looper == nullptr || looper != MsgLooper::mThreadLocal.get())
+            return nullptr;
+
+        return currentHandler();
+    }
+
+    //------------------------------------------------------------------------//
+    void LooperCoroutine::post(MsgHandler* h, std::coroutine_handle<> co, long delayMillis /* = 0 */)
+    {
+        if (h == nullptr)
+        {
+            LOGE("%s", "handler is null, coroutine is resumed on current thread");
+            co.resume();
+            return;
+        }
+
+        post(h, onResume, co.address(), delayMillis);
+    }
+
+    //------------------------------------------------------------------------//
+    void LooperCoroutine::post(MsgHandler* h, const runnable& r, void* param, long delayMillis /* = 0 */)
+    {
+        Message m = Msg::obtain(h);
+        m->mCallback = r;
+        m->setParam(param, 0);
+        h->sendMessageDelayed(std::move(m), delayMillis);
+    }
+
+    //------------------------------------------------------------------------//
+    void LooperCoroutine::onResume(const Message& msg, void* context)
+    {
+        std::coroutine_handle<>::from_address(msg->getParam()).resume();
+    }
+
+__END__
+
+#endif // __cpp_impl_coroutine
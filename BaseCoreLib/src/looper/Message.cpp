@@ -12,32 +12,112 @@
 #include "../../inc/looper/MessageLooper.h"
 #include "../../inc/os/AutoMutex.hpp"
 #include <assert.h>
+#include <stdlib.h>
+#if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+    #include <malloc.h>
+#endif
 
 //---------------------------------------------------------------------------//
 __BEGIN__
     
     int Msg::FLAGINUSE   = 1 << 0;
     int Msg::FLAGASYNC  = 1 << 1;
+    int Msg::FLAGDURABLE = 1 << 2;
+    int Msg::FLAGPERIODIC = 1 << 3;
+    int Msg::FLAGFIXEDRATE = 1 << 4;
+    int Msg::FLAGDISPATCHING = 1 << 5;
+    int Msg::FLAGCANCELED = 1 << 6;
+    int Msg::FLAGRESCHEDULED = 1 << 7;
+    int Msg::FLAGBUFFER = 1 << 8;
+    int Msg::FLAGDEADLINE = 1 << 9;
+    int Msg::FLAGEXPIRED = 1 << 10;
+    int Msg::FLAGTHROTTLED = 1 << 11;
+
+    // a new field must not push hot ones out of first cache line, see Msg
+    static_assert(sizeof(void*) != 8 || sizeof(Msg) == 2 * MSG_CACHE_LINE, "Msg grows out of two cache lines");
     
     #ifdef LOG_TAG
         #undef LOG_TAG
     #endif
     #define LOG_TAG (Message):
 
+    //------------------------------------------------------------------------//
+    // Aligned allocation of each message is slower than malloc, so freed messages
+    // are kept in a cache of the freeing thread for its next new, no lock is taken.
+    // Beyond MSG_THREAD_CACHE_COUNT, and when thread exits, they go back to system.
+    // Messages sent to a looper are freed there, senders allocate from system which
+    // keeps caches per thread too. Pool of queue is still the first place to reuse
+    #define MSG_THREAD_CACHE_COUNT  256
+
+    static thread_local void* gMsgCacheHead = nullptr;
+    static thread_local int gMsgCacheCount = 0;
+    static thread_local bool gMsgCacheClosed = false;
+
+    static void* allocMsg(void)
+    {
+        void* p = nullptr;
+    #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+        p = _aligned_malloc(sizeof(Msg), MSG_CACHE_LINE);
+    #else
+        if (posix_memalign(&p, MSG_CACHE_LINE, sizeof(Msg)) != 0)
+            p = nullptr;
+    #endif
+        return p;
+    }
+
+    static void freeMsg(void* p)
+    {
+    #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+        _aligned_free(p);
+    #else
+        free(p);
+    #endif
+    }
+
+    // touched when first message is cached, so the cache is emptied at thread exit.
+    // Messages freed by later thread local destructors bypass the closed cache
+    struct MsgCacheCloser
+    {
+        bool mArmed;
+
+        ~MsgCacheCloser(void)
+        {
+            gMsgCacheClosed = true;
+            while (gMsgCacheHead)
+            {
+                void* p = gMsgCacheHead;
+                gMsgCacheHead = *(void**)p;
+                freeMsg(p);
+            }
+            gMsgCacheCount = 0;
+        }
+    };
+
+    static thread_local MsgCacheCloser gMsgCacheCloser;
+
    //------------------------------------------------------------------------//
     Msg::Msg(void)
-    : mWhat(0)
-    , mArg1(0)
-    , mArg2(0)
+    : mNext(nullptr)
+    , mWhen(0)
+    , mTarget(nullptr)
     , mCallback(0)
     , mHandleCallback(0)
-    , mTarget(nullptr)
-    , mWhen(0)
+    , mPrev(nullptr)
+    , mWhat(0)
+    , mArg1(0)
+    , mArg2(0)
+    , mSlack(-1)
     , mFlags(0)
-    , mNext(nullptr)
-    , mParam(0)
+    , mHandle(0)
+    , mPeriod(0)
+    , mTraceId(0)
     , mParamBytes(0)
+    , mParamOffset(0)
+    , mParam(0)
     , mParamFreeFunc(0)  
+    , mLaneNext(nullptr)
+    , mLanePrev(nullptr)
+    , mJournalSeq(0)
     { 
     }
 
@@ -48,6 +128,43 @@ __BEGIN__
         LOGD("%s", "Message been destroyed!");
     }
 
+   //------------------------------------------------------------------------//
+    void* Msg::operator new(size_t bytes) noexcept
+    {
+        assert(bytes == sizeof(Msg));
+        void* p = gMsgCacheHead;
+        if (p)
+        {
+            gMsgCacheHead = *(void**)p;
+            gMsgCacheCount--;
+            return p;
+        }
+
+        p = allocMsg();
+        if (p == nullptr)
+            LOGE("%s", "out of memory, message can't be created");
+        return p;
+    }
+
+   //------------------------------------------------------------------------//
+    void Msg::operator delete(void* p) noexcept
+    {
+        if (p == nullptr)
+            return;
+
+        if (gMsgCacheClosed || gMsgCacheCount >= MSG_THREAD_CACHE_COUNT)
+        {
+            freeMsg(p);
+            return;
+        }
+
+        if (gMsgCacheCount == 0)
+            gMsgCacheCloser.mArmed = true;
+        *(void**)p = gMsgCacheHead;
+        gMsgCacheHead = p;
+        gMsgCacheCount++;
+    }
+
    //------------------------------------------------------------------------//
     bool Msg::isInUse(void)
     {
@@ -75,8 +192,9 @@ __BEGIN__
    //------------------------------------------------------------------------//
     Message Msg::obtain(void)
     {
-        Queue q = MsgLooper::myLooper()->getMsgQueue();
-        Message m = q ? q->obtain() : Message(nullptr);
+        // read the thread local looper directly, copying it costs an atomic refcount per message
+        MsgLooper* l = MsgLooper::mThreadLocal.get();
+        Message m = l ? l->getMsgQueue()->obtain() : Message(nullptr);
        
         if(m.get() == nullptr)
             m = Message(new Msg());
@@ -92,18 +210,21 @@ __BEGIN__
             LOGW("%s", "handler is null, create a new message");
             return obtain();
         }
-        else
+        
+        return obtain(h.get());
+    }
+
+   //------------------------------------------------------------------------//
+    Message Msg::obtain(MsgHandler* h)
+    {
+        Message m = h->queue()->obtain();
+        if(m.get() == nullptr)
         {
-            Message m = h->mQueue ? h->mQueue->obtain() : Message(nullptr);
-            if(m.get() == nullptr)
-            {
-                LOGW("%s", "Message pool queue is not full or empty, create a new message");
-                return Message(new Msg());
-            }
+            LOGW("%s", "Message pool queue is not full or empty, create a new message");
+            return Message(new Msg());
+        }
 
-            return m;
-        }    
-        
+        return m;
     }
 
    //------------------------------------------------------------------------//
@@ -139,9 +260,7 @@ __BEGIN__
         m->mWhat = what;
         m->mArg1 = arg1;
         m->mArg2 = arg2;
-        m->mParam = const_cast<void*>(param);
-        m->mParamBytes = bytes;
-        m->mParamFreeFunc = freeFn;
+        m->setParam(param, bytes, freeFn);
 
         return m;
     }
@@ -154,13 +273,77 @@ __BEGIN__
         m->mArg1 = arg1;
         m->mArg2 = arg2;
         m->mHandleCallback = const_cast<HandlerCallback*>(callback);
-        m->mParam = const_cast<void*>(param);
-        m->mParamBytes = bytes;
-        m->mParamFreeFunc = freeFn;
+        m->setParam(param, bytes, freeFn);
 
         return m;
     }
 
+   //------------------------------------------------------------------------//
+    bool Msg::setParam(const void* param, size_t bytes, const paramDeleter& freeFn /* = nullptr */)
+    {
+        if (mFlags & FLAGBUFFER)
+            releaseBuffer();
+
+        // journal, recorder and bus copy ParamSize() bytes, a cut size must never reach them
+        if (bytes > MSG_MAX_PARAM_BYTES)
+        {
+            LOGE("param of %zu bytes is larger than a message holds, it isn't set", bytes);
+            assert(bytes <= MSG_MAX_PARAM_BYTES);
+            mParam = nullptr;
+            mParamBytes = 0;
+            mParamFreeFunc = nullptr;
+            return false;
+        }
+
+        mParam = const_cast<void*>(param);
+        mParamBytes = (uint32)bytes;
+        mParamFreeFunc = freeFn;
+        return true;
+    }
+
+   //------------------------------------------------------------------------//
+    void Msg::setBuffer(BufferRef buffer)
+    {
+        setParam(nullptr, 0);
+        if (!buffer.isValid())
+            return;
+
+        if (buffer.mSize > MSG_MAX_PARAM_BYTES || buffer.mOffset > MSG_MAX_PARAM_BYTES)
+        {
+            LOGE("buffer of %zu bytes at %zu is larger than a message holds, it isn't set", buffer.mSize, buffer.mOffset);
+            assert(buffer.mSize <= MSG_MAX_PARAM_BYTES && buffer.mOffset <= MSG_MAX_PARAM_BYTES);
+            return;
+        }
+
+        // the reference of buffer moves into message
+        mParam = buffer.data();
+        mParamBytes = (uint32)buffer.mSize;
+        mParamOffset = (uint32)buffer.mOffset;
+        mFlags |= FLAGBUFFER;
+        buffer.mBuffer = nullptr;
+    }
+
+   //------------------------------------------------------------------------//
+    BufferRef Msg::getBuffer(void) const
+    {
+        if ((mFlags & FLAGBUFFER) == 0)
+            return BufferRef();
+
+        Buffer* b = Buffer::fromData((char*)mParam - mParamOffset);
+        b->addRef();
+        return BufferRef(b, mParamOffset, mParamBytes);
+    }
+
+   //------------------------------------------------------------------------//
+    void Msg::releaseBuffer(void)
+    {
+        Buffer::fromData((char*)mParam - mParamOffset)->release();
+        mParam = nullptr;
+        mParamBytes = 0;
+        mParamOffset = 0;
+        mFlags &= ~FLAGBUFFER;
+    }
+
    //------------------------------------------------------------------------//
     void Msg::recycleUnchecked(void)
     {
@@ -169,6 +352,8 @@ __BEGIN__
             mParamFreeFunc(mParam, mParamBytes);
             mParam = nullptr;
         }
+        else if (mFlags & FLAGBUFFER)
+            releaseBuffer();
 
         mWhat = 0;
         mArg1 = 0;
@@ -178,8 +363,17 @@ __BEGIN__
         mTarget = nullptr;
         mWhen = 0;
         mFlags = 0;
+        mSlack = -1;
         mParamBytes = 0;
+        mParamOffset = 0;
         mParamFreeFunc = nullptr;
+        mTraceId = 0;
+        mJournalSeq = 0;
+        mPrev = nullptr;
+        mHandle = 0;
+        mPeriod = 0;
+        mLaneNext = nullptr;
+        mLanePrev = nullptr;
     }   
      
 __END__
@@ -0,0 +1,101 @@
+/*****************************************************************************
+* FileName    : MessageClock.cpp
+* Description : Clock source of message queue implemention
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#include "../../inc/looper/MessageClock.h"
+#include "../../inc/looper/MessageQueue.h"
+#include "../../inc/os/AutoMutex.hpp"
+#include "../../inc/os/Logger.h"
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+   //------------------------------------------------------------------------//
+    #ifdef LOG_TAG
+        #undef LOG_TAG
+    #endif
+    #define LOG_TAG (MessageClock):
+
+    //------------------------------------------------------------------------//
+    VirtualClock::VirtualClock(uint64 startMillis /* = 0 */, bool autoAdvance /* = true */)
+    : mNow(startMillis)
+    , mAuto(autoAdvance)
+    , mJumps(0)
+    , mMutex()
+    , mQueues()
+    {
+    }
+
+    //------------------------------------------------------------------------//
+    VirtualClock::~VirtualClock(void)
+    {
+        LOGD("virtual clock stopped at %llu ms after %llu jumps",
+             (unsigned long long)mNow.load(), (unsigned long long)mJumps.load());
+    }
+
+    //------------------------------------------------------------------------//
+    void VirtualClock::moveTo(uint64 whenMillis)
+    {
+        // time never goes back, another looper may have moved it further
+        uint64 now = mNow.load(std::memory_order_relaxed);
+        while (now < whenMillis)
+        {
+            if (mNow.compare_exchange_weak(now, whenMillis, std::memory_order_acq_rel))
+            {
+                mJumps.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+    }
+
+    //------------------------------------------------------------------------//
+    bool VirtualClock::advanceTo(uint64 whenMillis)
+    {
+        if (!mAuto.load(std::memory_order_acquire))
+            return false;
+
+        moveTo(whenMillis);
+        return true;
+    }
+
+    //------------------------------------------------------------------------//
+    void VirtualClock::attach(const Queue& queue)
+    {
+        AutoMutex lock(&mMutex);
+        mQueues.push_back(queue);
+    }
+
+    //------------------------------------------------------------------------//
+    void VirtualClock::advance(uint64 millis)
+    {
+        moveTo(mNow.load(std::memory_order_relaxed) + millis);
+
+        // loopers of manual clock wait for this instead of a timeout
+        AutoMutex lock(&mMutex);
+        for (size_t i = 0; i < mQueues.size(); )
+        {
+            Queue q = mQueues[i].lock();
+            if (q.get() == nullptr)
+            {
+                mQueues.erase(mQueues.begin() + i);
+                continue;
+            }
+
+            q->onClockChanged();
+            i++;
+        }
+    }
+
+    //------------------------------------------------------------------------//
+    void VirtualClock::setAutoAdvance(bool enable)
+    {
+        mAuto.store(enable, std::memory_order_release);
+        if (enable)
+            advance(0);
+    }
+
+__END__
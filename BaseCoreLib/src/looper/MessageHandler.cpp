@@ -22,30 +22,59 @@ __BEGIN__
     #endif
     #define LOG_TAG (MessgeHandler):
 
+    // codes of what below it are kept in indexed table of handler
+    #define MSG_WHAT_TABLE_SIZE     1024
+
    //------------------------------------------------------------------------//
     MsgHandler::MsgHandler(void)
-    : mLooper(nullptr)
-    , mQueue(nullptr)
-    , mCallback(nullptr)
-    , mMessageHandlerFn(nullptr)
-    , mMsgHandlerObj(nullptr)
-    , mmsgCallbackObj(nullptr)
+    : mBinding(nullptr)
+    , mCallbacks(nullptr)
+    , mRetiredCallbacks(nullptr)
+    , mReaders(0)
     , mContext(nullptr)
-    , mMutex(nullptr)
+    , mDurableId(-1)
+    , mTimerSlack(0)
+    , mReentrant(false)
+    , mMutex()
     { 
-        mMutex = new Mutex(PTHREAD_MUTEX_RECURSIVE_NP);
+        Callbacks* c = new Callbacks();
+        c->mCallback = nullptr;
+        c->mMessageHandlerFn = nullptr;
+        c->mMsgHandlerObj = nullptr;
+        c->mmsgCallbackObj = nullptr;
+        c->mRetired = nullptr;
+        mCallbacks.store(c, std::memory_order_release);
     }
 
    //------------------------------------------------------------------------//
     MsgHandler::~MsgHandler(void)
     {
-        mCallback = nullptr;
-        mMessageHandlerFn = nullptr;
-        mMsgHandlerObj = nullptr;
-        mmsgCallbackObj = nullptr;
+        delete mCallbacks.exchange(nullptr, std::memory_order_acquire);
+        Callbacks* c = mRetiredCallbacks.exchange(nullptr, std::memory_order_acquire);
+        while (c)
+        {
+            Callbacks* retired = c->mRetired;
+            delete c;
+            c = retired;
+        }
+
+        // queue keys limit and weight by address of handler, a later handler may be given
+        // same one. Current binding is where migrateTo() moved them
+        const MsgBinding* b = mBinding.load(std::memory_order_acquire);
+        if (b && b->mQueue)
+        {
+            b->mQueue->setRateLimit(this, 0);
+            b->mQueue->setHandlerWeight(this, 1);
+        }
+
+        b = mBinding.exchange(nullptr, std::memory_order_acquire);
+        while (b)
+        {
+            const MsgBinding* retired = b->mRetired;
+            delete b;
+            b = retired;
+        }
         mContext = nullptr;
-        delete mMutex;
-        mMutex = nullptr;
 
         LOGD("%s", "Handler been destroyed!");
     }
@@ -53,27 +82,38 @@ __BEGIN__
    //------------------------------------------------------------------------//
     Handler MsgHandler::createHandler(void* context/* = nullptr */)
     { 
-        Handler h =  Handler(new MsgHandler(), deleter<MsgHandler>());
-        h->mLooper = MsgLooper::myLooper();
-        h->mQueue = h->mLooper->getMsgQueue();
-        h->mContext = context;
-        return h;
+        return createHandler(MsgLooper::myLooper(), context);
     }
 
    //------------------------------------------------------------------------//
     Handler MsgHandler::createHandler(const messageCallback& callback, void* context/* = nullptr */)
     { 
         Handler h = createHandler(context);
-        h->mCallback = callback;
+        if (h)
+        {
+            AutoMutex critical(&h->mMutex);
+            Callbacks* c = h->cloneCallbacks();
+            c->mCallback = callback;
+            h->publishCallbacks(c);
+        }
         return h;
     }
 
    //------------------------------------------------------------------------//
     Handler MsgHandler::createHandler(const Looper& looper, void* context/* = nullptr */)
     { 
+        if (looper.get() == nullptr)
+        {
+            LOGE("%s", "Error: looper is null, couldn't create handler");
+            return Handler(nullptr);
+        }
+
         Handler h = Handler(new MsgHandler(), deleter<MsgHandler>());
-        h->mLooper = looper;
-        h->mQueue = h->mLooper->getMsgQueue();
+        MsgBinding* b = new MsgBinding();
+        b->mLooper = looper;
+        b->mQueue = looper->getMsgQueue();
+        b->mRetired = nullptr;
+        h->mBinding.store(b, std::memory_order_release);
         h->mContext = context;
         return h;
     }
@@ -82,67 +122,98 @@ __BEGIN__
     Handler MsgHandler::createHandler(const Looper& looper, const messageCallback& callback, void* context/* = nullptr */)
     {
         Handler h = createHandler(looper, context);
-        h->mCallback = callback;
+        if (h)
+        {
+            AutoMutex critical(&h->mMutex);
+            Callbacks* c = h->cloneCallbacks();
+            c->mCallback = callback;
+            h->publishCallbacks(c);
+        }
         return h;
     }
 
    //------------------------------------------------------------------------//
     messageCallback MsgHandler::getCallback(void) const
     {
-        return mCallback;
+        messageCallback fn = enterCallbacks()->mCallback;
+        leaveCallbacks();
+        return fn;
     }
 
    //------------------------------------------------------------------------//
+    // Note: the internal send path obtains message by raw handler pointer, wrapping
+    // this into a new Handler would allocate a control block per message and 
+    // make a second owner which deletes the handler when the message is sent
     void MsgHandler::post(const runnable& r)
     {
-        sendMessageDelayed(Msg::obtain(r, Handler(this, deleter<MsgHandler>())), 0);
+        post(r, 0);
     }
 
    //------------------------------------------------------------------------//
-    void MsgHandler::post(const runnable& r, long delayMillis)
+    void MsgHandler::post(const runnable& r, long delayMillis, MsgHandle* handle /* = nullptr */)
     {
-        sendMessageDelayed(Msg::obtain(r, Handler(this, deleter<MsgHandler>())), delayMillis);
+        Message msg = Msg::obtain(this);
+        msg->mCallback = r;
+        sendMessageDelayed(std::move(msg), delayMillis, handle);
     }
 
    //------------------------------------------------------------------------//
-    void MsgHandler::sendMessage(Message msg)
+    void MsgHandler::sendMessage(Message msg, MsgHandle* handle /* = nullptr */)
     {
-        sendMessageDelayed(std::move(msg), 0);
+        sendMessageDelayed(std::move(msg), 0, handle);
     }
 
    //------------------------------------------------------------------------//
     void MsgHandler::sendEmptyMessage(int what)
     {
-        sendMessageDelayed(Msg::obtain(what, Handler(this, deleter<MsgHandler>())), 0);
+        sendEmptyMessage(what, 0);
     }
 
    //------------------------------------------------------------------------//
-    void MsgHandler::sendEmptyMessage(int what, long delayMillis)
+    void MsgHandler::sendEmptyMessage(int what, long delayMillis, MsgHandle* handle /* = nullptr */)
     {
-        sendMessageDelayed(Msg::obtain(what, Handler(this, deleter<MsgHandler>())), delayMillis);
+        Message msg = Msg::obtain(this);
+        msg->mWhat = what;
+        sendMessageDelayed(std::move(msg), delayMillis, handle);
     }
 
    //------------------------------------------------------------------------//
-    void MsgHandler::postAtTime(Message msg, long uptimeMillis)
+    void MsgHandler::postAtTime(Message msg, long uptimeMillis, MsgHandle* handle /* = nullptr */)
     {
-        sendMessageAtTime(std::move(msg), uptimeMillis);
+        sendMessageAtTime(std::move(msg), uptimeMillis, handle);
     }
 
    //------------------------------------------------------------------------//
-    void MsgHandler::postAtTime(const runnable& r, long uptimeMillis)
+    void MsgHandler::postAtTime(const runnable& r, long uptimeMillis, MsgHandle* handle /* = nullptr */)
     {
-        sendMessageAtTime(Msg::obtain(r, Handler(this, deleter<MsgHandler>())), uptimeMillis);
+        Message msg = Msg::obtain(this);
+        msg->mCallback = r;
+        sendMessageAtTime(std::move(msg), uptimeMillis, handle);
     }
 
    //------------------------------------------------------------------------//
-    void MsgHandler::sendMessageDelayed(Message msg, long delayMillis)
+    void MsgHandler::sendMessageDelayed(Message msg, long delayMillis, MsgHandle* handle /* = nullptr */)
     {
         // No lock required
         if(delayMillis < 0)
             delayMillis = 0;
 
-        uint64 t = getNowTimeOfNs() / PER_SEC_USEC;
-        sendMessageAtTime(std::move(msg), t + delayMillis);
+        uint64 t = queue()->uptimeMillis();
+        sendMessageAtTime(std::move(msg), t + delayMillis, handle);
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::sendMessageWithDeadline(Message msg, long delayMillis, long deadlineMillis, MsgHandle* handle /* = nullptr */)
+    {
+        if (delayMillis < 0)
+            delayMillis = 0;
+        if (deadlineMillis < 0)
+            deadlineMillis = 0;
+
+        uint64 t = queue()->uptimeMillis();
+        msg->mDeadline = (uint32)(t + deadlineMillis);
+        msg->mFlags |= Msg::FLAGDEADLINE;
+        sendMessageAtTime(std::move(msg), t + delayMillis, handle);
     }
 
    //------------------------------------------------------------------------//
@@ -151,103 +222,241 @@ __BEGIN__
         sendMessageAtTime(std::move(msg), 0);
     }
 
+   //------------------------------------------------------------------------//
+    void MsgHandler::postAtFixedRate(const runnable& r, long initialDelayMillis, long periodMillis, MsgHandle* handle /* = nullptr */)
+    {
+        postPeriodic(r, initialDelayMillis, periodMillis, true, handle);
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::postWithFixedDelay(const runnable& r, long initialDelayMillis, long delayMillis, MsgHandle* handle /* = nullptr */)
+    {
+        postPeriodic(r, initialDelayMillis, delayMillis, false, handle);
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::postPeriodic(const runnable& r, long initialDelayMillis, long periodMillis, bool fixedRate, MsgHandle* handle)
+    {
+        if (r == nullptr || periodMillis <= 0)
+        {
+            LOGE("%s", "runnable is null or period isn't positive");
+            return;
+        }
+
+        Message msg = Msg::obtain(this);
+        msg->mCallback = r;
+        msg->mPeriod = (uint32)periodMillis;
+        msg->mFlags |= Msg::FLAGPERIODIC | (fixedRate ? Msg::FLAGFIXEDRATE : 0);
+        sendMessageDelayed(std::move(msg), initialDelayMillis, handle);
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::sendDurableMessageDelayed(Message msg, long delayMillis)
+    {
+        if (mDurableId < 0 || msg->mCallback || msg->mHandleCallback)
+            LOGW("%s", "message can't be durable, handler has no durable id or message has callback");
+        else if (queue()->hasJournal())
+            msg->mFlags |= Msg::FLAGDURABLE;
+
+        sendMessageDelayed(std::move(msg), delayMillis);
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::setDurableId(int id)
+    {
+        mDurableId = id;
+        queue()->recoverJournal(this);
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::setRateLimit(double ratePerSec, int burst /* = 1 */)
+    {
+        queue()->setRateLimit(this, ratePerSec, burst);
+    }
+
+   //------------------------------------------------------------------------//
+    uint64 MsgHandler::getThrottledCount(void) const
+    {
+        return queue()->getThrottledCount((MsgHandler*)this);
+    }
+
+   //------------------------------------------------------------------------//
+    int MsgHandler::migrateTo(const Looper& looper)
+    {
+        if (looper.get() == nullptr)
+        {
+            LOGE("%s", "looper is null, handler isn't migrated");
+            return -1;
+        }
+
+        AutoMutex critical(&mMutex);
+        const MsgBinding* old = mBinding.load(std::memory_order_relaxed);
+        if (old->mQueue == looper->getMsgQueue())
+            return 0;
+
+        // old record is retired, a sender may still hold its queue
+        MsgBinding* b = new MsgBinding();
+        b->mLooper = looper;
+        b->mQueue = looper->getMsgQueue();
+        b->mRetired = const_cast<MsgBinding*>(old);
+        int moved = old->mQueue->migrateHandler(this, b->mQueue.get(), b);
+        if (moved < 0)
+            delete b;
+        return moved;
+    }
+
    //------------------------------------------------------------------------//
     void MsgHandler::setMsgHandlerFunc(const messageHandlerFunc& fn)
     {
-        AutoMutex critical(mMutex);
-        mMessageHandlerFn = fn;
+        AutoMutex critical(&mMutex);
+        if (mCallbacks.load(std::memory_order_relaxed)->mMessageHandlerFn == fn)
+            return;
+
+        Callbacks* c = cloneCallbacks();
+        c->mMessageHandlerFn = fn;
+        publishCallbacks(c);
     }
 
     //------------------------------------------------------------------------//
     void MsgHandler::setMsgHandlerFunc(const MsgHandlerObj& obj)
     {
-        AutoMutex critical(mMutex);
-        mMsgHandlerObj = const_cast<MsgHandlerObj*>(&obj);
+        AutoMutex critical(&mMutex);
+        if (mCallbacks.load(std::memory_order_relaxed)->mMsgHandlerObj == &obj)
+            return;
+
+        Callbacks* c = cloneCallbacks();
+        c->mMsgHandlerObj = const_cast<MsgHandlerObj*>(&obj);
+        publishCallbacks(c);
     }
 
    //------------------------------------------------------------------------//
     void MsgHandler::setMsgCallbackObject(const HandlerCallback* callbackObj)
     {
-        AutoMutex critical(mMutex);
-        mmsgCallbackObj = const_cast<HandlerCallback*>(callbackObj);
+        AutoMutex critical(&mMutex);
+        if (mCallbacks.load(std::memory_order_relaxed)->mmsgCallbackObj == callbackObj)
+            return;
+
+        Callbacks* c = cloneCallbacks();
+        c->mmsgCallbackObj = const_cast<HandlerCallback*>(callbackObj);
+        publishCallbacks(c);
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::on(int what, const messageCallback& fn)
+    {
+        AutoMutex critical(&mMutex);
+        if (mCallbacks.load(std::memory_order_relaxed)->findWhat(what) == fn)
+            return;
+
+        Callbacks* c = cloneCallbacks();
+        setWhat(c, what, fn);
+        publishCallbacks(c);
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::on(std::initializer_list<std::pair<int, messageCallback> > table)
+    {
+        AutoMutex critical(&mMutex);
+        Callbacks* c = cloneCallbacks();
+        for (const std::pair<int, messageCallback>& entry : table)
+            setWhat(c, entry.first, entry.second);
+        publishCallbacks(c);
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::setWhat(Callbacks* c, int what, const messageCallback& fn)
+    {
+        if (what >= 0 && what < MSG_WHAT_TABLE_SIZE)
+        {
+            if ((size_t)what >= c->mWhatTable.size())
+                c->mWhatTable.resize(what + 1, nullptr);
+
+            c->mWhatTable[what] = fn;
+            while (!c->mWhatTable.empty() && c->mWhatTable.back() == nullptr)
+                c->mWhatTable.pop_back();
+        }
+        else if (fn)
+            c->mWhatMap[what] = fn;
+        else
+            c->mWhatMap.erase(what);
     }
     
    //------------------------------------------------------------------------//
     bool MsgHandler::hasMessage(const Message& msg)
     {
-        return mQueue->hasMessage(msg, this);
+        return queue()->hasMessage(msg, this);
     }
 
    //------------------------------------------------------------------------//
     bool MsgHandler::hasMessage(const runnable& r)
     {
-        return mQueue->hasMessage(r, this);
+        return queue()->hasMessage(r, this);
     }
 
    //------------------------------------------------------------------------//
     bool MsgHandler::hasMessage(int what)
     {
-        return mQueue->hasMessage(what, this);
+        return queue()->hasMessage(what, this);
     }
 
    //------------------------------------------------------------------------//
     bool MsgHandler::hasMessage(const HandlerCallback* callback)
     {
-        return mQueue->hasMessage(callback, this);
+        return queue()->hasMessage(callback, this);
     }
 
    //------------------------------------------------------------------------//
     void MsgHandler::removeMessage(runnable& r)
     {
-        mQueue->removeMessage(r, this);
+        queue()->removeMessage(r, this);
     }
 
    //------------------------------------------------------------------------//
     void MsgHandler::removeMessage(int what)
     {
-        mQueue->removeMessage(what, this);
+        queue()->removeMessage(what, this);
     }
 
    //------------------------------------------------------------------------//
     void MsgHandler::removeMessage(int minWhat, int maxWhat, messageCallback& c)
     {
-        mQueue->removeMessage(minWhat, maxWhat, c, this);
+        queue()->removeMessage(minWhat, maxWhat, c, this);
     }
 
    //------------------------------------------------------------------------//
     void MsgHandler::removeMessage(int what, int arg1, int arg2, messageCallback& c)
     {
-        mQueue->removeMessage(what, arg1, arg2, c, this);
+        queue()->removeMessage(what, arg1, arg2, c, this);
     }
 
    //------------------------------------------------------------------------//
     void MsgHandler::removeMessage(HandlerCallback* callback)
     {
-        mQueue->removeMessage(callback, this);
+        queue()->removeMessage(callback, this);
     }
 
    //------------------------------------------------------------------------//
     void MsgHandler::removeMessage(int what, HandlerCallback *callback)
     {
-        mQueue->removeMessage(what, callback, this);
+        queue()->removeMessage(what, callback, this);
     }
 
    //------------------------------------------------------------------------//
     void MsgHandler::removeMessage(int minWhat, int maxWhat, HandlerCallback* callback)
     {
-        mQueue->removeMessage(minWhat, maxWhat, callback, this);
+        queue()->removeMessage(minWhat, maxWhat, callback, this);
     }
 
    //------------------------------------------------------------------------//
     void MsgHandler::removeMessage(int what, int arg1, int arg2, HandlerCallback* callback)
     {
-        mQueue->removeMessage(what, arg1, arg2, callback, this);        
+        queue()->removeMessage(what, arg1, arg2, callback, this);        
     }
 
    //------------------------------------------------------------------------//
     void MsgHandler::removeAllMessages(void)
     {
-        mQueue->removeAllMessages(this);
+        queue()->removeAllMessages(this);
     }
 
    //------------------------------------------------------------------------//
@@ -265,25 +474,97 @@ __BEGIN__
             msg->mHandleCallback->onHandler(msg);
         else
         {
-            // presume your do not change the callback when this function is doing
-          AutoMutex critical(mMutex);
+            // callbacks may be changed concurrently, the record loaded here stays valid
+            // until leaveCallbacks()
+            const Callbacks* c = enterCallbacks();
+            messageCallback fn = c->findWhat(msg->mWhat);
+            if (fn)
+                fn(msg, mContext);
             // defalut callback of handler
-          if (mCallback)
-              mCallback(msg, mContext);
-          else  if (mMessageHandlerFn)
-              mMessageHandlerFn(msg, mContext);
-          else if (mMsgHandlerObj)
-              (*mMsgHandlerObj)(msg, mContext);
-          else if (mmsgCallbackObj)
-              mmsgCallbackObj->onHandler(msg);
+            else if (c->mCallback)
+                c->mCallback(msg, mContext);
+            else  if (c->mMessageHandlerFn)
+                c->mMessageHandlerFn(msg, mContext);
+            else if (c->mMsgHandlerObj)
+                (*c->mMsgHandlerObj)(msg, mContext);
+            else if (c->mmsgCallbackObj)
+                c->mmsgCallbackObj->onHandler(msg);
+            leaveCallbacks();
         }    
     }
 
    //------------------------------------------------------------------------//
-    void MsgHandler::sendMessageAtTime(Message msg, uint64 uptimeMillis)
+    MsgHandler::Callbacks* MsgHandler::cloneCallbacks(void) const
+    {
+        // caller must hold mMutex
+        Callbacks* c = new Callbacks(*mCallbacks.load(std::memory_order_relaxed));
+        c->mRetired = nullptr;
+        return c;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::publishCallbacks(Callbacks* callbacks)
+    {
+        // caller must hold mMutex, the old record is retired but not freed because
+        // a looper may still be dispatching with it
+        Callbacks* old = const_cast<Callbacks*>(mCallbacks.load(std::memory_order_relaxed));
+        old->mRetired = mRetiredCallbacks.load(std::memory_order_relaxed);
+        mRetiredCallbacks.store(old, std::memory_order_relaxed);
+        mCallbacks.store(callbacks, std::memory_order_seq_cst);
+        reclaimCallbacks();
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::reclaimCallbacks(void)
+    {
+        // a reader counted after this load loads the record published before it, one
+        // counted before keeps the retired records until it leaves and reclaims them
+        if (mReaders.load(std::memory_order_seq_cst) != 0)
+            return;
+
+        Callbacks* c = mRetiredCallbacks.exchange(nullptr, std::memory_order_relaxed);
+        while (c)
+        {
+            Callbacks* retired = c->mRetired;
+            delete c;
+            c = retired;
+        }
+    }
+
+   //------------------------------------------------------------------------//
+    const MsgHandler::Callbacks* MsgHandler::enterCallbacks(void) const
+    {
+        mReaders.fetch_add(1, std::memory_order_seq_cst);
+        return mCallbacks.load(std::memory_order_seq_cst);
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::leaveCallbacks(void) const
+    {
+        // last reader frees what writers retired while it was inside, a writer holding
+        // the mutex reclaims itself after publishing
+        if (mReaders.fetch_sub(1, std::memory_order_seq_cst) != 1
+            || mRetiredCallbacks.load(std::memory_order_relaxed) == nullptr)
+            return;
+
+        MsgHandler* self = const_cast<MsgHandler*>(this);
+        if (self->mMutex.trylock() == 0)
+        {
+            self->reclaimCallbacks();
+            self->mMutex.unlock();
+        }
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgHandler::sendMessageAtTime(Message msg, uint64 uptimeMillis, MsgHandle* handle /* = nullptr */)
     {
         msg->mTarget = this;
-        mQueue->enqueueMessage(std::move(msg), uptimeMillis);
+        if (msg->mSlack < 0)
+            msg->mSlack = (int)mTimerSlack;
+        const Queue& q = queue();
+        if (handle)
+            handle->mQueue = q;
+        q->enqueueMessage(std::move(msg), uptimeMillis, handle);
     }
 
 __END__
@@ -0,0 +1,647 @@
+/*****************************************************************************
+* FileName    : MessageJournal.cpp
+* Description : Durable journal of delayed messages implemention
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#include "../../inc/looper/MessageJournal.h"
+#include "../../inc/os/AutoMutex.hpp"
+#include "../../inc/os/Logger.h"
+#include "../../inc/base/TimeUtil.h"
+#include <atomic>
+#include <errno.h>
+#include <string.h>
+#if !(defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+   //------------------------------------------------------------------------//
+    #ifdef LOG_TAG
+        #undef LOG_TAG
+    #endif
+    #define LOG_TAG (MessageJournal):
+
+    //------------------------------------------------------------------------//
+    #define JOURNAL_MAGIC           0x4C4E524A  // "JRNL"
+    #define JOURNAL_VERSION         1
+    #define JOURNAL_RECORD_ADD      1
+    #define JOURNAL_RECORD_DONE     2
+    #define JOURNAL_INIT_SIZE       (1 << 20)
+    #define JOURNAL_COMPACT_SIZE    (1 << 16)   // never compact a small file
+    #define JOURNAL_SYNC_MSEC       1000
+    #define JOURNAL_ALIGN(n)        (((n) + 7) & ~(size_t)7)
+
+    struct JournalHeader
+    {
+        uint32  mMagic;
+        uint32  mVersion;
+        uint64  mTail;      // end of committed records
+        uint64  mNextSeq;
+        uint64  mReserved;
+    };
+
+    struct JournalRecord
+    {
+        uint32  mType;
+        uint32  mBytes;
+        uint32  mCheck;
+        uint32  mReserved;
+        uint64  mSeq;
+        uint64  mWhen;
+        int     mDurableId;
+        int     mWhat;
+        int     mArg1;
+        int     mArg2;
+    };
+
+    //------------------------------------------------------------------------//
+    static uint32 checkRecord(const JournalRecord* r)
+    {
+        // FNV-1a of record except check field, and of its param
+        uint32 h = 2166136261u;
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(r);
+        for (size_t i = 0; i < sizeof(JournalRecord) + r->mBytes; i++)
+        {
+            if (i >= offsetof(JournalRecord, mCheck) && i < offsetof(JournalRecord, mCheck) + sizeof(uint32))
+                continue;
+            h = (h ^ p[i]) * 16777619u;
+        }
+        return h;
+    }
+
+    //------------------------------------------------------------------------//
+    static void commitTail(JournalHeader* header, uint64 tail)
+    {
+        // record must be in memory before the tail which makes it visible
+        std::atomic_thread_fence(std::memory_order_release);
+        header->mTail = tail;
+    }
+
+    //------------------------------------------------------------------------//
+    MsgJournal::MsgJournal(const std::string& path)
+    : mPath(path)
+    , mFd(-1)
+    , mAddr(nullptr)
+    , mSize(0)
+    , mHeader(nullptr)
+    , mMutex()
+    , mLive()
+    , mRecovered()
+    , mLiveBytes(0)
+    , mDirty(false)
+    , mLastSync(0)
+    , mWorker(nullptr)
+    , mWork(nullptr)
+    , mStop(false)
+    , mKicked(false)
+    , mCompactHint(false)
+    , mFull(false)
+    , mPendingDone()
+    , mNextFd(-1)
+    , mNextAddr(nullptr)
+    , mNextSize(0)
+    , mNextHeader(nullptr)
+    , mNextLive()
+    {
+    }
+
+    //------------------------------------------------------------------------//
+    MsgJournal::~MsgJournal(void)
+    {
+        if (mWorker)
+        {
+            {
+                AutoMutex lock(&mMutex);
+                mStop = true;
+                mWork.notifyAll();
+            }
+            mWorker->join();
+            delete mWorker;
+            mWorker = nullptr;
+        }
+
+        // worker is gone, nothing else uses mapping
+#if !(defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+        if (mAddr && mDirty)
+            msync(mAddr, (size_t)mHeader->mTail, MS_SYNC);
+#endif
+        unmap();
+        LOGD("%s", "Message journal been closed!");
+    }
+
+    //------------------------------------------------------------------------//
+    MsgJournal* MsgJournal::open(const char* path)
+    {
+#if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+        LOGE("%s", "message journal doesn't support windows");
+        return nullptr;
+#else
+        int fd = ::open(path, O_RDWR | O_CREAT, 0600);
+        if (fd < 0)
+        {
+            LOGE("fail to open journal %s: %s", path, strerror(errno));
+            return nullptr;
+        }
+
+        struct stat st;
+        fstat(fd, &st);
+        size_t size = (size_t)st.st_size;
+        bool fresh = size < sizeof(JournalHeader);
+        if (fresh)
+        {
+            size = JOURNAL_INIT_SIZE;
+            if (ftruncate(fd, size) != 0)
+            {
+                LOGE("fail to resize journal %s: %s", path, strerror(errno));
+                close(fd);
+                return nullptr;
+            }
+        }
+
+        MsgJournal* j = new MsgJournal(path);
+        if (!j->map(fd, size))
+        {
+            delete j;
+            return nullptr;
+        }
+
+        if (fresh)
+        {
+            j->mHeader->mVersion = JOURNAL_VERSION;
+            j->mHeader->mNextSeq = 1;
+            j->mHeader->mMagic = JOURNAL_MAGIC;
+            commitTail(j->mHeader, JOURNAL_ALIGN(sizeof(JournalHeader)));
+        }
+        else if (!j->load())
+        {
+            delete j;
+            return nullptr;
+        }
+
+        j->mWorker = new std::thread(&MsgJournal::workLoop, j);
+        LOGI("open journal %s, recover %d messages", path, (int)j->mRecovered.size());
+        return j;
+#endif
+    }
+
+    //------------------------------------------------------------------------//
+    bool MsgJournal::map(int fd, size_t size)
+    {
+#if !(defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            LOGE("fail to map journal %s: %s", mPath.c_str(), strerror(errno));
+            close(fd);
+            return false;
+        }
+
+        unmap();
+        mFd = fd;
+        mAddr = static_cast<char*>(addr);
+        mSize = size;
+        mHeader = reinterpret_cast<JournalHeader*>(mAddr);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgJournal::unmap(void)
+    {
+#if !(defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+        if (mAddr)
+            munmap(mAddr, mSize);
+        if (mFd >= 0)
+            close(mFd);
+#endif
+        mAddr = nullptr;
+        mHeader = nullptr;
+        mSize = 0;
+        mFd = -1;
+    }
+
+    //------------------------------------------------------------------------//
+    bool MsgJournal::load(void)
+    {
+        if (mHeader->mMagic != JOURNAL_MAGIC || mHeader->mVersion != JOURNAL_VERSION)
+        {
+            LOGE("%s isn't a message journal or its version is different", mPath.c_str());
+            return false;
+        }
+
+        size_t off = JOURNAL_ALIGN(sizeof(JournalHeader));
+        size_t tail = mHeader->mTail > mSize ? mSize : (size_t)mHeader->mTail;
+        while (off + sizeof(JournalRecord) <= tail)
+        {
+            const JournalRecord* r = reinterpret_cast<const JournalRecord*>(mAddr + off);
+            size_t len = JOURNAL_ALIGN(sizeof(JournalRecord) + r->mBytes);
+            if (off + len > tail || r->mCheck != checkRecord(r))
+            {
+                LOGW("journal %s is broken at %zu, drop records after it", mPath.c_str(), off);
+                break;
+            }
+
+            if (r->mType == JOURNAL_RECORD_ADD)
+            {
+                mLive[r->mSeq] = off;
+                mLiveBytes += len;
+            }
+            else if (r->mType == JOURNAL_RECORD_DONE)
+            {
+                std::map<uint64, size_t>::iterator it = mLive.find(r->mSeq);
+                if (it != mLive.end())
+                {
+                    const JournalRecord* add = reinterpret_cast<const JournalRecord*>(mAddr + it->second);
+                    mLiveBytes -= JOURNAL_ALIGN(sizeof(JournalRecord) + add->mBytes);
+                    mLive.erase(it);
+                }
+            }
+
+            if (r->mSeq >= mHeader->mNextSeq)
+                mHeader->mNextSeq = r->mSeq + 1;
+            off += len;
+        }
+
+        commitTail(mHeader, off);
+        for (std::map<uint64, size_t>::iterator it = mLive.begin(); it != mLive.end(); ++it)
+            mRecovered.insert(it->first);
+
+        return true;
+    }
+
+    //------------------------------------------------------------------------//
+    static size_t putRecord(char* addr, JournalHeader* header, uint32 type, uint64 seq, uint64 when, int durableId,
+                            int what, int arg1, int arg2, const void* param, size_t bytes)
+    {
+        size_t off = (size_t)header->mTail;
+        JournalRecord* r = reinterpret_cast<JournalRecord*>(addr + off);
+        r->mType = type;
+        r->mBytes = (uint32)bytes;
+        r->mReserved = 0;
+        r->mSeq = seq;
+        r->mWhen = when;
+        r->mDurableId = durableId;
+        r->mWhat = what;
+        r->mArg1 = arg1;
+        r->mArg2 = arg2;
+        if (bytes)
+            memcpy(r + 1, param, bytes);
+        r->mCheck = checkRecord(r);
+
+        commitTail(header, off + JOURNAL_ALIGN(sizeof(JournalRecord) + bytes));
+        return off;
+    }
+
+    //------------------------------------------------------------------------//
+    size_t MsgJournal::write(uint32 type, uint64 seq, uint64 when, int durableId, int what, int arg1, int arg2,
+                             const void* param, size_t bytes, size_t* nextOff /* = nullptr */)
+    {
+        // only space already mapped is used, the worker grows and compacts the file
+        size_t len = JOURNAL_ALIGN(sizeof(JournalRecord) + bytes);
+        if (mHeader->mTail + len > mSize || (mNextHeader && mNextHeader->mTail + len > mNextSize))
+        {
+            if (!mFull)
+                LOGW("journal %s is full, records aren't written until it grows", mPath.c_str());
+            mFull = true;
+            kick();
+            return 0;
+        }
+
+        size_t off = putRecord(mAddr, mHeader, type, seq, when, durableId, what, arg1, arg2, param, bytes);
+        if (mNextHeader)
+        {
+            size_t n = putRecord(mNextAddr, mNextHeader, type, seq, when, durableId, what, arg1, arg2, param, bytes);
+            if (nextOff)
+                *nextOff = n;
+        }
+
+        mFull = false;
+        mDirty = true;
+        if (mSize - (size_t)mHeader->mTail < mSize / 2)
+            kick();
+        return off;
+    }
+
+    //------------------------------------------------------------------------//
+    uint64 MsgJournal::append(uint64 when, int durableId, int what, int arg1, int arg2, const void* param, size_t bytes)
+    {
+        AutoMutex lock(&mMutex);
+        if (mHeader == nullptr)
+            return 0;
+
+        uint64 seq = mHeader->mNextSeq;
+        size_t nextOff = 0;
+        size_t off = write(JOURNAL_RECORD_ADD, seq, when, durableId, what, arg1, arg2, param, bytes, &nextOff);
+        if (off == 0)
+            return 0;
+
+        mHeader->mNextSeq = seq + 1;
+        mLive[seq] = off;
+        mLiveBytes += JOURNAL_ALIGN(sizeof(JournalRecord) + bytes);
+        if (mNextHeader)
+        {
+            mNextHeader->mNextSeq = seq + 1;
+            mNextLive[seq] = nextOff;
+        }
+        return seq;
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgJournal::done(uint64 seq)
+    {
+        AutoMutex lock(&mMutex);
+        std::map<uint64, size_t>::iterator it = mLive.find(seq);
+        if (mHeader == nullptr || it == mLive.end())
+            return;
+
+        const JournalRecord* add = reinterpret_cast<const JournalRecord*>(mAddr + it->second);
+        mLiveBytes -= JOURNAL_ALIGN(sizeof(JournalRecord) + add->mBytes);
+        mLive.erase(it);
+        mNextLive.erase(seq);
+        mRecovered.erase(seq);
+
+        // worker writes it when there is room, till then message comes back after crash
+        if (write(JOURNAL_RECORD_DONE, seq, 0, 0, 0, 0, 0, nullptr, 0) == 0)
+            mPendingDone.push_back(seq);
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgJournal::takeRecovered(int durableId, std::vector<JournalEntry>& entries)
+    {
+        AutoMutex lock(&mMutex);
+        for (std::set<uint64>::iterator it = mRecovered.begin(); it != mRecovered.end();)
+        {
+            const JournalRecord* r = reinterpret_cast<const JournalRecord*>(mAddr + mLive[*it]);
+            if (r->mDurableId != durableId)
+            {
+                ++it;
+                continue;
+            }
+
+            JournalEntry e;
+            e.mSeq = r->mSeq;
+            e.mWhen = r->mWhen;
+            e.mDurableId = r->mDurableId;
+            e.mWhat = r->mWhat;
+            e.mArg1 = r->mArg1;
+            e.mArg2 = r->mArg2;
+            e.mParam.assign(reinterpret_cast<const char*>(r + 1), reinterpret_cast<const char*>(r + 1) + r->mBytes);
+            entries.push_back(std::move(e));
+
+            it = mRecovered.erase(it);
+        }
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgJournal::maintain(void)
+    {
+        AutoMutex lock(&mMutex);
+        if (mHeader == nullptr || mCompactHint)
+            return;
+
+        size_t used = (size_t)mHeader->mTail - JOURNAL_ALIGN(sizeof(JournalHeader));
+        if (used > JOURNAL_COMPACT_SIZE && used > 4 * mLiveBytes)
+        {
+            mCompactHint = true;
+            kick();
+        }
+    }
+
+    //------------------------------------------------------------------------//
+    int MsgJournal::getLiveCount(void) const
+    {
+        AutoMutex lock(&mMutex);
+        return (int)mLive.size();
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgJournal::kick(void)
+    {
+        if (mKicked)
+            return;
+
+        mKicked = true;
+        mWork.notifyOne();
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgJournal::workLoop(void)
+    {
+        AutoMutex lock(&mMutex);
+        while (!mStop)
+        {
+            if (!mKicked)
+                mWork.wait(&mMutex, JOURNAL_SYNC_MSEC);
+            if (mStop)
+                break;
+
+            size_t head = JOURNAL_ALIGN(sizeof(JournalHeader));
+            size_t used = (size_t)mHeader->mTail - head;
+            bool filling = mSize - (size_t)mHeader->mTail < mSize / 2;
+            mKicked = false;
+
+            // most records are done, rewriting the file is cheaper than growing it
+            if ((filling && used > 2 * mLiveBytes) || mCompactHint)
+            {
+                if (!compact() && filling)
+                    grow();
+            }
+            else if (filling)
+                grow();
+            mCompactHint = false;
+
+            flushPendingDone();
+
+            uint64 now = getNowTimeOfMs();
+            if (mDirty && now - mLastSync >= JOURNAL_SYNC_MSEC)
+                sync();
+        }
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgJournal::grow(void)
+    {
+#if !(defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+        size_t size = mSize << 1;
+        int fd = mFd;
+        mMutex.unlock();
+
+        // writers go on in old mapping meanwhile, it shares pages of file with new one
+        void* addr = MAP_FAILED;
+        if (ftruncate(fd, size) == 0)
+            addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int err = errno;
+
+        mMutex.lock();
+        if (addr == MAP_FAILED)
+        {
+            LOGE("fail to grow journal %s: %s", mPath.c_str(), strerror(err));
+            return;
+        }
+
+        char* old = mAddr;
+        size_t oldSize = mSize;
+        mAddr = static_cast<char*>(addr);
+        mSize = size;
+        mHeader = reinterpret_cast<JournalHeader*>(mAddr);
+        mMutex.unlock();
+
+        // only worker unmaps, nobody holds old address out of lock
+        munmap(old, oldSize);
+        mMutex.lock();
+#endif
+    }
+
+    //------------------------------------------------------------------------//
+    bool MsgJournal::compact(void)
+    {
+#if !(defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+        // copy live records into a new file and rename it over the old one, the old
+        // file stays valid until rename, so a crash while compacting loses nothing
+        size_t headBytes = JOURNAL_ALIGN(sizeof(JournalHeader));
+        size_t size = JOURNAL_INIT_SIZE;
+        while (headBytes + 2 * mLiveBytes > size)
+            size <<= 1;
+
+        std::string tmp = mPath + ".compact";
+        mMutex.unlock();
+
+        char* addr = nullptr;
+        int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd >= 0 && ftruncate(fd, size) == 0)
+        {
+            void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED)
+                addr = static_cast<char*>(p);
+        }
+        int err = errno;
+
+        mMutex.lock();
+        if (addr && headBytes + mLiveBytes <= size)
+        {
+            // copy is memory only, from now on writers write each record into both
+            JournalHeader* header = reinterpret_cast<JournalHeader*>(addr);
+            header->mVersion = JOURNAL_VERSION;
+            header->mNextSeq = mHeader->mNextSeq;
+            size_t off = headBytes;
+            for (std::map<uint64, size_t>::iterator it = mLive.begin(); it != mLive.end(); ++it)
+            {
+                const JournalRecord* r = reinterpret_cast<const JournalRecord*>(mAddr + it->second);
+                size_t len = JOURNAL_ALIGN(sizeof(JournalRecord) + r->mBytes);
+                memcpy(addr + off, r, len);
+                mNextLive[it->first] = off;
+                off += len;
+            }
+            header->mMagic = JOURNAL_MAGIC;
+            commitTail(header, off);
+
+            mNextFd = fd;
+            mNextAddr = addr;
+            mNextSize = size;
+            mNextHeader = header;
+        }
+        else
+        {
+            LOGE("fail to create journal %s: %s", tmp.c_str(), addr ? "live records grew" : strerror(err));
+            mMutex.unlock();
+            if (addr)
+                munmap(addr, size);
+            if (fd >= 0)
+            {
+                close(fd);
+                unlink(tmp.c_str());
+            }
+            mMutex.lock();
+            return false;
+        }
+        size_t copied = (size_t)mNextHeader->mTail;
+        mMutex.unlock();
+
+        // synced before it replaces old file, records mirrored since are synced later
+        msync(addr, copied, MS_SYNC);
+        bool renamed = rename(tmp.c_str(), mPath.c_str()) == 0;
+        err = errno;
+
+        mMutex.lock();
+        size_t before = (size_t)mHeader->mTail;
+        char* oldAddr = addr;
+        size_t oldSize = size;
+        int oldFd = fd;
+        if (renamed)
+        {
+            oldAddr = mAddr;
+            oldSize = mSize;
+            oldFd = mFd;
+            mFd = fd;
+            mAddr = addr;
+            mSize = size;
+            mHeader = mNextHeader;
+            mLive.swap(mNextLive);
+            mDirty = true;
+        }
+        else
+            LOGE("fail to replace journal %s: %s", mPath.c_str(), strerror(err));
+
+        size_t after = (size_t)mHeader->mTail;
+        mNextLive.clear();
+        mNextFd = -1;
+        mNextAddr = nullptr;
+        mNextSize = 0;
+        mNextHeader = nullptr;
+        mMutex.unlock();
+
+        munmap(oldAddr, oldSize);
+        close(oldFd);
+        if (!renamed)
+            unlink(tmp.c_str());
+        else
+            LOGD("compact journal %s from %zu to %zu bytes", mPath.c_str(), before, after);
+
+        mMutex.lock();
+        return renamed;
+#else
+        return false;
+#endif
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgJournal::sync(void)
+    {
+#if !(defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+        if (mAddr == nullptr || !mDirty)
+            return;
+
+        char* addr = mAddr;
+        size_t len = (size_t)mHeader->mTail;
+        mDirty = false;
+        mLastSync = getNowTimeOfMs();
+        mMutex.unlock();
+
+        // writers go on while pages are written, mapping stays as only worker unmaps
+        msync(addr, len, MS_SYNC);
+        mMutex.lock();
+#else
+        mDirty = false;
+#endif
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgJournal::flushPendingDone(void)
+    {
+        size_t n = 0;
+        while (n < mPendingDone.size() && write(JOURNAL_RECORD_DONE, mPendingDone[n], 0, 0, 0, 0, 0, nullptr, 0) != 0)
+            n++;
+        mPendingDone.erase(mPendingDone.begin(), mPendingDone.begin() + n);
+    }
+
+__END__
@@ -9,8 +9,10 @@
 #include "../../inc/looper/MessageLooper.h"
 #include "../../inc/looper/MessageQueue.h"
 #include "../../inc/looper/MessageHandler.h"
+#include "../../inc/looper/MessageTrace.h"
 #include "../../inc/os/AutoMutex.hpp"
 #include "../../inc/os/Logger.h"
+#include "../../inc/base/TimeUtil.h"
 #include <algorithm>
 #include <iostream>
 #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
@@ -36,7 +38,7 @@ __BEGIN__
     #define LOG_TAG (MessageLooper):
 
    //------------------------------------------------------------------------//
-    static uint64 getCurrentThreadId(void)
+    uint64 MsgLooper::getCurrentThreadId(void)
     {
 #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
         return GetCurrentThreadId();
@@ -53,9 +55,28 @@ __BEGIN__
 #endif
     }
 
+   //------------------------------------------------------------------------//
+    // messages of reentrant handlers taken by drain, workers claim them by index
+    struct LooperDrain
+    {
+        std::vector<Message>        mMessages;
+        std::atomic<size_t>         mNext;
+        std::atomic<uint64>         mParallel;
+        std::atomic<uint64>         mDiscarded;
+        std::vector<std::thread>    mWorkers;
+        MsgQueue*                   mQueue;
+        uint64                      mBegin;
+        uint64                      mDeadline;      // 0 is no deadline
+        uint64                      mSerialBase;    // dispatched count of looper at begin
+
+        LooperDrain(void) : mMessages(), mNext(0), mParallel(0), mDiscarded(0), mWorkers(), mQueue(nullptr)
+        , mBegin(0), mDeadline(0), mSerialBase(0) { }
+    };
+
    //------------------------------------------------------------------------//
     threadlocal Looper MsgLooper::mThreadLocal(nullptr);
-    Mutex MsgLooper::mMutex(PTHREAD_MUTEX_RECURSIVE_NP);
+    Mutex MsgLooper::mLoopersMutex;
+    std::vector<std::weak_ptr<MsgLooper>> MsgLooper::mLoopers;
 
    //------------------------------------------------------------------------//
     MsgLooper::MsgLooper(const char* msgQueueName, int msgQueuePoolMaxSize, uint64 tid)
@@ -63,6 +84,13 @@ __BEGIN__
     , mThreadId(0)
     , mExit(false)
     , mPromoteThrLevel(false)
+    , mDispatched(0)
+    , mBusyNanos(0)
+    , mBusyTiming(false)
+    , mDrainWorkers(0)
+    , mDrainDeadline(0)
+    , mDrain(nullptr)
+    , mDrainReport()
     {
         mQueue = Queue(new MsgQueue(msgQueueName, msgQueuePoolMaxSize), deleter<MsgQueue>());
         mThreadId = tid;
@@ -80,16 +108,22 @@ __BEGIN__
     }
 
    //------------------------------------------------------------------------//
-    Looper MsgLooper::prepare(int msgQueuePoolMaxSize /* = 50 */)
+    Looper MsgLooper::prepare(int msgQueuePoolMaxSize /* = 50 */, const char* journalPath /* = nullptr */)
     {
-        AutoMutex lock(&mMutex);
-
+        // the looper is thread local, only registration of a new looper need lock
         if (mThreadLocal == nullptr) 
         {
             uint64 tid = getCurrentThreadId();
             char name[64] = { 0 };
             SNPRINTF(name, 64, "%s%llu%s", "Thread_", tid, "_MsgQueue");
             mThreadLocal = Looper(new MsgLooper(name, msgQueuePoolMaxSize, tid), deleter<MsgLooper>());
+            if (journalPath && !mThreadLocal->mQueue->openJournal(journalPath))
+                LOGE("fail to open journal %s, durable messages won't be saved", journalPath);
+
+            AutoMutex lock(&mLoopersMutex);
+            mLoopers.erase(std::remove_if(mLoopers.begin(), mLoopers.end(), 
+                [](const std::weak_ptr<MsgLooper>& l) { return l.expired(); }), mLoopers.end());
+            mLoopers.push_back(mThreadLocal);
         }
 
         return mThreadLocal;
@@ -98,8 +132,6 @@ __BEGIN__
    //------------------------------------------------------------------------//
     Looper MsgLooper::myLooper(void)
     {
-        AutoMutex lock(&mMutex);
-
         if(mThreadLocal == nullptr)
         {
             LOGE("%s", "Error: current thread had not create MsgLooper, you should call MsgLooper.prepare() first");
@@ -109,6 +141,20 @@ __BEGIN__
         return mThreadLocal;
     }
 
+   //------------------------------------------------------------------------//
+    void MsgLooper::getLoopers(std::vector<Looper>& loopers)
+    {
+        AutoMutex lock(&mLoopersMutex);
+        loopers.clear();
+        loopers.reserve(mLoopers.size());
+        for (size_t i = 0; i < mLoopers.size(); i++)
+        {
+            Looper l = mLoopers[i].lock();
+            if (l)
+                loopers.push_back(l);
+        }
+    }
+
    //------------------------------------------------------------------------//
    // Note: operate message queues don't need to be mutually exclusive 
    // because operations on it are all secure, each step is akin to an atomic operation. 
@@ -116,13 +162,10 @@ __BEGIN__
    // data in multiple threads? 
     void MsgLooper::loop(void)
     {
+        if (mThreadLocal == nullptr)
         {
-            AutoMutex lock(&mMutex);
-            if (myLooper() == nullptr)
-            {
-                LOGW("%s", "No looper; MsgLooper.prepare() wasn't called on this thread.");
-                return;
-            }
+            LOGW("%s", "No looper; MsgLooper.prepare() wasn't called on this thread.");
+            return;
         }
 
         for(;;)
@@ -135,6 +178,7 @@ __BEGIN__
 
             if (mExit && mQueue->getQueueSize() == 0)
             {
+                finishDrain();
                 LOGW("%s", "Warning: Message looper had exited and Message queue is empty.");
                 return;
             }
@@ -152,26 +196,141 @@ __BEGIN__
                 sched_param sch;
                 pthread_getschedparam(pthread_self(), &policy, &sch);
                 sch.sched_priority += 1;
-                pthread_setschedparam(thread, policy, &sch);
+                pthread_setschedparam(pthread_self(), policy, &sch);
 #endif
                 mPromoteThrLevel = false;
+                if (mDrainWorkers > 0 || mDrainDeadline > 0)
+                    startDrain();
             }
+
+            // bounded drain, messages left at deadline are dropped
+            if (mDrain && mDrain->mDeadline && mQueue->uptimeMillis() >= mDrain->mDeadline)
+                mDrain->mDiscarded.fetch_add(mQueue->discardMessages(0), std::memory_order_relaxed);
             
             Message msg = mQueue->next();
             if(msg.get())
             {
                 assert(msg->mTarget);
+                if (mQueue->expireMessage(msg))
+                    continue;
+
+                bool timing = mBusyTiming.load(std::memory_order_relaxed);
+                uint64 begin = timing ? getNowTimeOfNs() : 0;
+                MSG_TRACE(TRACE_DISPATCH_BEGIN, msg.get(), mQueue.get());
                 msg->mTarget->dispatchMessage(msg);
-                mQueue->recycleMsg(std::move(msg));
+                MSG_TRACE(TRACE_DISPATCH_END, msg.get(), mQueue.get());
+                mQueue->finishMessage(std::move(msg));
+                if (timing)
+                {
+                    uint64 end = getNowTimeOfNs();
+                    if (end > begin)
+                        mBusyNanos.store(mBusyNanos.load(std::memory_order_relaxed) + end - begin, std::memory_order_relaxed);
+                }
+                mDispatched.store(mDispatched.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
             }
             else
             {
+                finishDrain();
                 LOGI("%s", "Message is null, exit looper");
                 return;
             }
         }
     }
 
+   //------------------------------------------------------------------------//
+    void MsgLooper::getStats(LooperStats& stats) const
+    {
+        stats.mDispatched = mDispatched.load(std::memory_order_relaxed);
+        stats.mBusyNanos = mBusyNanos.load(std::memory_order_relaxed);
+        stats.mWakeups = mQueue->getWakeupCount();
+        stats.mQueueSize = mQueue->getQueueSize();
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgLooper::setDrainPolicy(int workers, long deadlineMillis /* = 0 */)
+    {
+        mDrainWorkers = workers > 0 ? workers : 0;
+        mDrainDeadline = deadlineMillis > 0 ? deadlineMillis : 0;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgLooper::startDrain(void)
+    {
+        LooperDrain* d = new LooperDrain();
+        d->mQueue = mQueue.get();
+        d->mBegin = mQueue->uptimeMillis();
+        d->mDeadline = mDrainDeadline > 0 ? d->mBegin + mDrainDeadline : 0;
+        d->mSerialBase = mDispatched.load(std::memory_order_relaxed);
+
+        // messages due after deadline can't run anyway, looper needn't wait for them
+        if (d->mDeadline)
+            d->mDiscarded.store(mQueue->discardMessages(d->mDeadline), std::memory_order_relaxed);
+
+        if (mDrainWorkers > 0 && mQueue->takeReentrantMessages(d->mMessages, d->mBegin) > 0)
+        {
+            size_t n = d->mMessages.size() < (size_t)mDrainWorkers ? d->mMessages.size() : (size_t)mDrainWorkers;
+            for (size_t i = 0; i < n; i++)
+                d->mWorkers.push_back(std::thread(&MsgLooper::drainWorker, d));
+        }
+
+        mDrain = d;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgLooper::drainWorker(LooperDrain* drain)
+    {
+        size_t count = drain->mMessages.size();
+        for (;;)
+        {
+            size_t i = drain->mNext.fetch_add(1, std::memory_order_relaxed);
+            if (i >= count)
+                return;
+
+            Message& msg = drain->mMessages[i];
+            if (drain->mDeadline && drain->mQueue->uptimeMillis() >= drain->mDeadline)
+            {
+                drain->mQueue->discardMessage(std::move(msg));
+                drain->mDiscarded.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            msg->mTarget->dispatchMessage(msg);
+            drain->mQueue->finishMessage(std::move(msg));
+            drain->mParallel.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgLooper::finishDrain(void)
+    {
+        if (mDrain == nullptr)
+            return;
+
+        for (size_t i = 0; i < mDrain->mWorkers.size(); i++)
+            mDrain->mWorkers[i].join();
+
+        mDrainReport.mSerial = mDispatched.load(std::memory_order_relaxed) - mDrain->mSerialBase;
+        mDrainReport.mParallel = mDrain->mParallel.load(std::memory_order_relaxed);
+        mDrainReport.mDiscarded = mDrain->mDiscarded.load(std::memory_order_relaxed);
+        mDrainReport.mMillis = mQueue->uptimeMillis() - mDrain->mBegin;
+        if (mDrainReport.mDiscarded > 0)
+            LOGW("drain of %s passed deadline, %llu messages are discarded", mQueue->getQueueName(), (unsigned long long)mDrainReport.mDiscarded);
+        LOGI("drain of %s: serial = %llu, parallel = %llu, discarded = %llu, %llu ms", mQueue->getQueueName(),
+             (unsigned long long)mDrainReport.mSerial, (unsigned long long)mDrainReport.mParallel,
+             (unsigned long long)mDrainReport.mDiscarded, (unsigned long long)mDrainReport.mMillis);
+
+        delete mDrain;
+        mDrain = nullptr;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgLooper::setClock(const Clock& clock)
+    {
+        mQueue->setClock(clock);
+        if (clock)
+            clock->attach(mQueue);
+    }
+
    //------------------------------------------------------------------------//
     void MsgLooper::quit(bool safely /*= false */)
     {
@@ -9,9 +9,14 @@
 #include "../../inc/looper/MessageQueue.h"
 #include "../../inc/looper/MessageHandler.h"
 #include "../../inc/looper/MessageLooper.h"
+#include "../../inc/looper/MessageTrace.h"
+#include "../../inc/looper/MessageJournal.h"
+#include "../../inc/looper/MessageRecorder.h"
+#include "../../inc/looper/SharedMessageQueue.h"
 #include "../../inc/os/Logger.h"
 #include "../../inc/base/TimeUtil.h"
 #include <algorithm>
+#include <functional>
 
 //---------------------------------------------------------------------------//
 __BEGIN__
@@ -22,30 +27,27 @@ __BEGIN__
     #endif
     #define LOG_TAG (MessgeQueue):
 
+    // messages taken from shared ring per check of looper
+    #define SHARED_RECEIVE_BATCH    64
+
     //------------------------------------------------------------------------//
-    #define RECYCLEMIDDLE(p, prev, handler)  \
+    #define RECYCLEMIDDLE(p, handler)  \
         if (handler == nullptr || (handler && p->mTarget == handler))\
         {\
-              Message msg(nullptr); \
-              if (prev == p) { \
-                    msg = std::move(mMsgQueueHead); \
-                    mMsgQueueHead = std::move(p->mNext);\
-                    if (mMsgQueueTail == p) mMsgQueueTail = mMsgQueueHead.get();\
-              } \
-              else {\
-                    msg = std::move(prev->mNext); \
-                    prev->mNext = std::move(p->mNext); \
-                    if (mMsgQueueTail == p) mMsgQueueTail = prev;\
-              }\
-              recycleMsg(std::move(msg)); \
-              mMsgQueueSize--; \
+              releaseHandle(p); \
+              recycleMsg(unlinkMessage(p)); \
               break;\
          }\
         else {\
-              prev = p;\
               p = p->mNext.get();\
          }\
 
+   //------------------------------------------------------------------------//
+    static void freeJournalParam(void* obj, size_t bytes)
+    {
+        free(obj);
+    }
+
    //------------------------------------------------------------------------//
     MsgQueue::MsgQueue(const std::string& name, int MaxMsgPoolSize /* = 50 */)
     : mName(name)
@@ -64,6 +66,30 @@ __BEGIN__
     , mQuit(false)
     , mNotEnqueMsg(false)
     , mOutTimeTest(0)
+    , mJournal(nullptr)
+    , mRecorder(nullptr)
+    , mHandles()
+    , mFreeHandle(0)
+    , mDispatching(nullptr)
+    , mWakeups(0)
+    , mClock(nullptr)
+    , mFair(false)
+    , mLanes()
+    , mLaneOrder()
+    , mLaneCursor(0)
+    , mWeights()
+    , mDeadlineMode(false)
+    , mExpire(true)
+    , mPendingDeadlines()
+    , mReadyDeadlines()
+    , mExpiredCount(0)
+    , mExpiredHandler(nullptr)
+    , mExpiredContext(nullptr)
+    , mRateLimits()
+    , mThrottled(0)
+    , mShared(nullptr)
+    , mSharedWaiting(false)
+    , mSharedBatch()
     {
     }
 
@@ -95,6 +121,12 @@ __BEGIN__
 
         mMsgQueueTail = nullptr;
 
+        // messages dropped above are still live in journal, they are recovered next time
+        delete mJournal;
+        mJournal = nullptr;
+        delete mRecorder;
+        mRecorder = nullptr;
+
         LOGD("%s", "Message queue been destroyed!");   
     }
 
@@ -106,8 +138,11 @@ __BEGIN__
     }
 
    //------------------------------------------------------------------------//
-    bool MsgQueue::enqueueMessage(Message message, uint64 delayDoneTime /* = 0 */)
+    bool MsgQueue::enqueueMessage(Message message, uint64 delayDoneTime /* = 0 */, MsgHandle* handle /* = nullptr */)
     {
+        if (handle)
+            handle->mGen = 0;
+
         if(message->mTarget == nullptr)
         {
             LOGW("%s", "message handler is null. COULDN'T BEEN ADDED TO MESSAGE QUEUE!");
@@ -120,53 +155,752 @@ __BEGIN__
             return false;
         }   
 
-        AutoMutex critical(&mLock); 
-        
-        if(mQuit || mNotEnqueMsg)
         {
-            LOGE("%s", "Error: Message queue had exited.");
-            recycleMsg(std::move(message));
+            AutoMutex critical(&mLock);
+            if (message->mTarget->queue().get() == this)
+            {
+                if(mQuit || mNotEnqueMsg)
+                {
+                    LOGE("%s", "Error: Message queue had exited.");
+                    recycleMsg(std::move(message));
+                    return false;
+                }
+
+                if (handle)
+                {
+                    if (mFreeHandle == 0)
+                    {
+                        HandleSlot s = { nullptr, 1, 0 };
+                        mHandles.push_back(s);
+                        mFreeHandle = (uint32)mHandles.size();
+                    }
+
+                    uint32 index = mFreeHandle - 1;
+                    HandleSlot& s = mHandles[index];
+                    mFreeHandle = s.mNextFree;
+                    s.mMsg = message.get();
+                    message->mHandle = index + 1;
+                    handle->mIndex = index;
+                    handle->mGen = s.mGen;
+                }
+
+                acceptMessage(std::move(message), delayDoneTime);
+
+                mBlocked = false; 
+                notifyLooper();   
+
+                return true;
+            }
+        }
+
+        // handler migrated after sender read its queue, message follows it
+        const Queue& q = message->mTarget->queue();
+        if (handle)
+            handle->mQueue = q;
+        return q->enqueueMessage(std::move(message), delayDoneTime, handle);
+    }
+
+   //------------------------------------------------------------------------//
+    int MsgQueue::enqueueMessages(Message* messages, int count, uint64 delayDoneTime /* = 0 */)
+    {
+        int n = 0;
+        bool moved = false;
+        {
+            AutoMutex critical(&mLock);
+
+            for (int i = 0; i < count; i++)
+            {
+                Message& message = messages[i];
+                if (message.get() == nullptr || message->mTarget == nullptr || message->isInUse())
+                {
+                    LOGW("%s", "message is null, without handler or being used, it isn't added");
+                    continue;
+                }
+
+                // handler migrated, message is forwarded after unlocking
+                if (message->mTarget->queue().get() != this)
+                {
+                    moved = true;
+                    continue;
+                }
+
+                if (mQuit || mNotEnqueMsg)
+                {
+                    recycleMsg(std::move(message));
+                    continue;
+                }
+
+                acceptMessage(std::move(message), delayDoneTime);
+                n++;
+            }
+
+            // one wakeup for the whole batch
+            if (n > 0)
+            {
+                mBlocked = false;
+                notifyLooper();
+            }
+        }
+
+        for (int i = 0; moved && i < count; i++)
+        {
+            Message& message = messages[i];
+            if (message.get() && message->mTarget && !message->isInUse() && message->mTarget->queue().get() != this)
+                n += message->mTarget->queue()->enqueueMessage(std::move(message), delayDoneTime) ? 1 : 0;
+        }
+
+        return n;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::acceptMessage(Message message, uint64 delayDoneTime)
+    {
+        message->makeInUse();
+        message->mWhen = delayDoneTime;
+        if (mJournal && (message->mFlags & Msg::FLAGDURABLE) && message->mJournalSeq == 0)
+            message->mJournalSeq = mJournal->append(delayDoneTime, message->mTarget->getDurableId(), message->mWhat,
+                                                    message->mArg1, message->mArg2, message->mParam, message->mParamBytes);
+        MSG_TRACE(TRACE_ENQUEUE, message.get(), this);
+        if (mRecorder)
+            mRecorder->record(message.get(), delayDoneTime, uptimeMillis());
+
+        insertMessage(std::move(message));
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::insertMessage(Message message)
+    {
+        uint64 when = message->mWhen;
+        Msg* msg = message.get();
+
+        if(mMsgQueueHead.get() == nullptr || when == 0 || when < mMsgQueueHead->mWhen)
+        {
+            message->mPrev = nullptr;
+            message->mNext = std::move(mMsgQueueHead);
+            mMsgQueueHead = std::move(message);
+            if (msg->mNext)
+                msg->mNext->mPrev = msg;
+            else  // first add message to list
+                mMsgQueueTail = msg;
+        }
+        else
+        {
+            // most messages are later than others, so search from tail. The head is
+            // not later than the message here, so the loop stops at head at last
+            Msg* prev = mMsgQueueTail;
+            while (when < prev->mWhen)
+                prev = prev->mPrev;
+
+            message->mPrev = prev;
+            message->mNext = std::move(prev->mNext);
+            prev->mNext = std::move(message);
+            if (msg->mNext)
+                msg->mNext->mPrev = msg;
+            else
+                mMsgQueueTail = msg;
+        } 
+
+        mMsgQueueSize++;   
+        if (mFair)
+            laneInsert(msg);
+        if (mDeadlineMode && (msg->mFlags & Msg::FLAGDEADLINE))
+            deadlineInsert(msg);
+    }
+
+   //------------------------------------------------------------------------//
+    uint64 MsgQueue::coalescedWakeTime(void) const
+    {
+        // a message may be dispatched until its time plus slack, so wake at the earliest
+        // such deadline, every message due by then is dispatched in the same wakeup.
+        // List is sorted by time, messages later than the deadline can't lower it
+        Msg* p = mMsgQueueHead.get();
+        uint64 wake = p->mWhen + (p->mSlack > 0 ? p->mSlack : 0);
+        for (p = p->mNext.get(); p && p->mWhen < wake; p = p->mNext.get())
+        {
+            if (p->mSlack <= 0)
+                return p->mWhen;
+            if (p->mWhen + p->mSlack < wake)
+                wake = p->mWhen + p->mSlack;
+        }
+
+        return wake;
+    }
+
+   //------------------------------------------------------------------------//
+    uint64 MsgQueue::uptimeMillis(void) const
+    {
+        return mClock ? mClock->nowMillis() : getNowTimeOfNs() / PER_SEC_USEC;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::setClock(const Clock& clock)
+    {
+        AutoMutex critical(&mLock);
+        mClock = clock;
+        mBlocked = false;
+        notifyLooper();
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::onClockChanged(void)
+    {
+        AutoMutex critical(&mLock);
+        mBlocked = false;
+        notifyLooper();
+    }
+
+   //------------------------------------------------------------------------//
+    bool MsgQueue::attachShared(SharedMsgQueue* shared)
+    {
+        AutoMutex critical(&mLock);
+        if (mShared)
+        {
+            LOGE("%s", "looper already receives a shared message queue");
             return false;
         }
 
-        message->makeInUse();
-        message->mWhen = delayDoneTime;
-       
-        if(mMsgQueueHead.get() == nullptr || delayDoneTime == 0 || delayDoneTime < mMsgQueueHead->mWhen)
-        {
-            message->mNext = std::move(mMsgQueueHead);
-            mMsgQueueHead = std::move(message);
-            if (!mMsgQueueTail)  // first add message to list, mMsgQueueTail must is null
-                mMsgQueueTail = mMsgQueueHead.get();
-        }
-        else if (mMsgQueueTail && delayDoneTime >= mMsgQueueTail->mWhen)
+        mShared = shared;
+        mBlocked = false;
+        mWait.notifyAll();
+        return true;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::detachShared(SharedMsgQueue* shared)
+    {
+        AutoMutex critical(&mLock);
+        if (mShared != shared)
+            return;
+
+        mShared = nullptr;
+        while (mSharedWaiting)
+        {
+            shared->wake();
+            mWait.wait(&mLock, 10);
+        }
+        mBlocked = false;
+        mWait.notifyAll();
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::waitLooper(long timeoutMillis)
+    {
+        if (mShared == nullptr)
+        {
+            mWait.wait(&mLock, timeoutMillis);
+            return;
+        }
+
+        // senders of other processes couldn't signal condition, local ones wake futex too
+        mSharedWaiting = true;
+        mShared->waitMessage(&mLock, timeoutMillis);
+        mSharedWaiting = false;
+        mWait.notifyAll();
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::notifyLooper(void)
+    {
+        mWait.notifyAll();
+        if (mShared)
+            mShared->wake();
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::receiveShared(std::vector<Message>& forward)
+    {
+        if (mShared->takeMessages(mSharedBatch, SHARED_RECEIVE_BATCH) == 0)
+            return;
+
+        // time of slot is system millisecond, it is moved to clock of queue
+        uint64 wall = getNowTimeOfNs() / PER_SEC_USEC;
+        uint64 now = uptimeMillis();
+        for (size_t i = 0; i < mSharedBatch.size(); i++)
+        {
+            Message& message = mSharedBatch[i];
+            if (message->mTarget->queue().get() != this)
+                forward.push_back(std::move(message));
+            else if (mQuit || mNotEnqueMsg)
+                recycleMsg(std::move(message));
+            else
+            {
+                uint64 when = message->mWhen > wall ? now + (message->mWhen - wall) : now;
+                acceptMessage(std::move(message), when);
+                mBlocked = false;
+            }
+        }
+        mSharedBatch.clear();
+    }
+
+   //------------------------------------------------------------------------//
+    uint64 MsgQueue::getWakeupCount(void) const
+    {
+        AutoMutex critical(&mLock);
+        return mWakeups;
+    }
+
+   //------------------------------------------------------------------------//
+    Message MsgQueue::unlinkMessage(Msg* msg)
+    {
+        Msg* prev = msg->mPrev;
+        Message& link = prev ? prev->mNext : mMsgQueueHead;
+        Message ret = std::move(link);
+        link = std::move(ret->mNext);
+        if (link)
+            link->mPrev = prev;
+        else
+            mMsgQueueTail = prev;
+
+        ret->mPrev = nullptr;
+        mMsgQueueSize--;
+        if (mFair)
+            laneRemove(ret.get());
+        if (mDeadlineMode && (ret->mFlags & Msg::FLAGDEADLINE))
+            deadlineRemove(ret.get());
+        return ret;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::laneInsert(Msg* msg)
+    {
+        std::unordered_map<MsgHandler*, Lane>::iterator it = mLanes.find(msg->mTarget);
+        if (it == mLanes.end())
+        {
+            std::unordered_map<MsgHandler*, int>::const_iterator w = mWeights.find(msg->mTarget);
+            Lane lane = { nullptr, nullptr, w != mWeights.end() ? w->second : 1, 0 };
+            it = mLanes.insert(std::make_pair(msg->mTarget, lane)).first;
+            mLaneOrder.push_back(msg->mTarget);
+        }
+
+        // same position rule as list of queue, message at front has time 0
+        Lane& lane = it->second;
+        Msg* prev = msg->mWhen == 0 ? nullptr : lane.mTail;
+        while (prev && msg->mWhen < prev->mWhen)
+            prev = prev->mLanePrev;
+
+        msg->mLanePrev = prev;
+        msg->mLaneNext = prev ? prev->mLaneNext : lane.mHead;
+        if (msg->mLaneNext)
+            msg->mLaneNext->mLanePrev = msg;
+        else
+            lane.mTail = msg;
+        if (prev)
+            prev->mLaneNext = msg;
+        else
+            lane.mHead = msg;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::laneRemove(Msg* msg)
+    {
+        std::unordered_map<MsgHandler*, Lane>::iterator it = mLanes.find(msg->mTarget);
+        if (it == mLanes.end())
+            return;
+
+        Lane& lane = it->second;
+        if (msg->mLanePrev)
+            msg->mLanePrev->mLaneNext = msg->mLaneNext;
+        else
+            lane.mHead = msg->mLaneNext;
+        if (msg->mLaneNext)
+            msg->mLaneNext->mLanePrev = msg->mLanePrev;
+        else
+            lane.mTail = msg->mLanePrev;
+        msg->mLaneNext = nullptr;
+        msg->mLanePrev = nullptr;
+
+        if (lane.mHead)
+            return;
+
+        // empty lane leaves ring, it joins at the end when its handler sends again
+        size_t i = 0;
+        while (mLaneOrder[i] != msg->mTarget)
+            i++;
+        mLaneOrder.erase(mLaneOrder.begin() + i);
+        mLanes.erase(it);
+
+        if (i < mLaneCursor)
+            mLaneCursor--;
+        else if (i == mLaneCursor && !mLaneOrder.empty())
+        {
+            // turn passes to the lane which moved into the cursor
+            if (mLaneCursor >= mLaneOrder.size())
+                mLaneCursor = 0;
+            Lane& next = mLanes[mLaneOrder[mLaneCursor]];
+            next.mCredit = next.mWeight;
+        }
+    }
+
+   //------------------------------------------------------------------------//
+    Msg* MsgQueue::nextFairMessage(uint64 now)
+    {
+        // deficit round robin, lane of cursor dispatches up to its weight of ready
+        // messages then turn moves on, a lane without ready message loses its turn.
+        // The loop visits every lane with full credit, one of them is ready
+        size_t n = mLaneOrder.size();
+        for (size_t i = 0; i <= n; i++)
+        {
+            if (mLaneCursor >= n)
+                mLaneCursor = 0;
+
+            Lane& lane = mLanes[mLaneOrder[mLaneCursor]];
+            if (lane.mCredit > 0 && lane.mHead->mWhen <= now)
+            {
+                lane.mCredit--;
+                return lane.mHead;
+            }
+
+            lane.mCredit = 0;
+            mLaneCursor = (mLaneCursor + 1) % n;
+            Lane& next = mLanes[mLaneOrder[mLaneCursor]];
+            next.mCredit = next.mWeight;
+        }
+
+        return mMsgQueueHead.get();
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::setFairMode(bool enable)
+    {
+        AutoMutex critical(&mLock);
+        if (mFair == enable)
+            return;
+
+        mFair = enable;
+        mLanes.clear();
+        mLaneOrder.clear();
+        mLaneCursor = 0;
+        if (!enable)
+            return;
+
+        // list is in order, queued messages are appended to their lanes
+        for (Msg* p = mMsgQueueHead.get(); p; p = p->mNext.get())
+        {
+            std::unordered_map<MsgHandler*, Lane>::iterator it = mLanes.find(p->mTarget);
+            if (it == mLanes.end())
+            {
+                std::unordered_map<MsgHandler*, int>::const_iterator w = mWeights.find(p->mTarget);
+                Lane lane = { p, nullptr, w != mWeights.end() ? w->second : 1, 0 };
+                it = mLanes.insert(std::make_pair(p->mTarget, lane)).first;
+                mLaneOrder.push_back(p->mTarget);
+            }
+            else
+                it->second.mTail->mLaneNext = p;
+
+            p->mLanePrev = it->second.mTail;
+            p->mLaneNext = nullptr;
+            it->second.mTail = p;
+        }
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::deadlineInsert(Msg* msg)
+    {
+        DeadlineEntry e = { msg->mWhen, msg };
+        mPendingDeadlines.push_back(e);
+        std::push_heap(mPendingDeadlines.begin(), mPendingDeadlines.end(), std::greater<DeadlineEntry>());
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::deadlineRemove(Msg* msg)
+    {
+        // dispatched message is top of ready heap, others are removed or rescheduled
+        // ones, which are rare enough for a linear search
+        if (!mReadyDeadlines.empty() && mReadyDeadlines.front().mMsg == msg)
+        {
+            std::pop_heap(mReadyDeadlines.begin(), mReadyDeadlines.end(), std::greater<DeadlineEntry>());
+            mReadyDeadlines.pop_back();
+            return;
+        }
+
+        std::vector<DeadlineEntry>* heaps[2] = { &mReadyDeadlines, &mPendingDeadlines };
+        for (int i = 0; i < 2; i++)
+        {
+            std::vector<DeadlineEntry>& heap = *heaps[i];
+            for (size_t j = 0; j < heap.size(); j++)
+            {
+                if (heap[j].mMsg != msg)
+                    continue;
+
+                heap[j] = heap.back();
+                heap.pop_back();
+                std::make_heap(heap.begin(), heap.end(), std::greater<DeadlineEntry>());
+                return;
+            }
+        }
+    }
+
+   //------------------------------------------------------------------------//
+    Msg* MsgQueue::nextDeadlineMessage(uint64 now)
+    {
+        // messages become ready in time order, they move to heap of deadline then
+        while (!mPendingDeadlines.empty() && mPendingDeadlines.front().mKey <= now)
+        {
+            std::pop_heap(mPendingDeadlines.begin(), mPendingDeadlines.end(), std::greater<DeadlineEntry>());
+            DeadlineEntry e = mPendingDeadlines.back();
+            mPendingDeadlines.pop_back();
+
+            // deadline keeps low 32 bits, it is within 24 days around now
+            e.mKey = now + (int64)(int)(e.mMsg->mDeadline - (uint32)now);
+            mReadyDeadlines.push_back(e);
+            std::push_heap(mReadyDeadlines.begin(), mReadyDeadlines.end(), std::greater<DeadlineEntry>());
+        }
+
+        if (mReadyDeadlines.empty())
+            return nullptr;
+
+        const DeadlineEntry& top = mReadyDeadlines.front();
+        if (mExpire && top.mKey < now)
+        {
+            top.mMsg->mFlags |= Msg::FLAGEXPIRED;
+            mExpiredCount++;
+        }
+
+        return top.mMsg;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::setDeadlineMode(bool enable, bool expire /* = true */)
+    {
+        AutoMutex critical(&mLock);
+        mExpire = expire;
+        if (mDeadlineMode == enable)
+            return;
+
+        mDeadlineMode = enable;
+        mPendingDeadlines.clear();
+        mReadyDeadlines.clear();
+        if (!enable)
+            return;
+
+        // list is in time order, so it is a heap by time already
+        for (Msg* p = mMsgQueueHead.get(); p; p = p->mNext.get())
+        {
+            if (p->mFlags & Msg::FLAGDEADLINE)
+            {
+                DeadlineEntry e = { p->mWhen, p };
+                mPendingDeadlines.push_back(e);
+            }
+        }
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::setExpiredHandler(const msgExpiredHandler& handler, void* context /* = nullptr */)
+    {
+        AutoMutex critical(&mLock);
+        mExpiredHandler = handler;
+        mExpiredContext = context;
+    }
+
+   //------------------------------------------------------------------------//
+    uint64 MsgQueue::getExpiredCount(void) const
+    {
+        AutoMutex critical(&mLock);
+        return mExpiredCount;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::setRateLimit(MsgHandler* handler, double ratePerSec, int burst /* = 1 */)
+    {
+        AutoMutex critical(&mLock);
+        if (ratePerSec <= 0)
+        {
+            mRateLimits.erase(handler);
+            return;
+        }
+
+        if (burst < 1)
+            burst = 1;
+
+        RateLimit& r = mRateLimits[handler];
+        r.mInterval = (uint64)(1000000.0 / ratePerSec);
+        if (r.mInterval == 0)
+            r.mInterval = 1;
+        r.mTolerance = r.mInterval * (burst - 1);
+    }
+
+   //------------------------------------------------------------------------//
+    uint64 MsgQueue::getThrottledCount(MsgHandler* handler /* = nullptr */) const
+    {
+        AutoMutex critical(&mLock);
+        if (handler == nullptr)
+            return mThrottled;
+
+        std::unordered_map<MsgHandler*, RateLimit>::const_iterator it = mRateLimits.find(handler);
+        return it != mRateLimits.end() ? it->second.mThrottled : 0;
+    }
+
+   //------------------------------------------------------------------------//
+    bool MsgQueue::throttleMessage(Msg* msg, uint64 now)
+    {
+        // token of a moved message was taken when it was moved
+        if (msg->mFlags & Msg::FLAGTHROTTLED)
+        {
+            msg->mFlags &= ~Msg::FLAGTHROTTLED;
+            return false;
+        }
+
+        std::unordered_map<MsgHandler*, RateLimit>::iterator it = mRateLimits.find(msg->mTarget);
+        if (it == mRateLimits.end())
+            return false;
+
+        RateLimit& r = it->second;
+        uint64 t = now * 1000;
+        uint64 allowed = r.mTat > r.mTolerance ? r.mTat - r.mTolerance : 0;
+        if (allowed <= t)
+        {
+            r.mTat = (r.mTat > t ? r.mTat : t) + r.mInterval;
+            return false;
+        }
+
+        // take the token now, so later messages of handler queue up behind this one
+        // and each message is moved once
+        r.mTat += r.mInterval;
+        r.mThrottled++;
+        mThrottled++;
+
+        Message m = unlinkMessage(msg);
+        m->mWhen = (allowed + 999) / 1000;
+        m->mFlags |= Msg::FLAGTHROTTLED;
+        insertMessage(std::move(m));
+        return true;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::setHandlerWeight(MsgHandler* handler, int weight)
+    {
+        AutoMutex critical(&mLock);
+        if (weight < 1)
+            weight = 1;
+
+        if (weight == 1)
+            mWeights.erase(handler);
+        else
+            mWeights[handler] = weight;
+
+        std::unordered_map<MsgHandler*, Lane>::iterator it = mLanes.find(handler);
+        if (it != mLanes.end())
+            it->second.mWeight = weight;
+    }
+
+   //------------------------------------------------------------------------//
+    int MsgQueue::getHandlerWeight(MsgHandler* handler) const
+    {
+        AutoMutex critical(&mLock);
+        std::unordered_map<MsgHandler*, int>::const_iterator it = mWeights.find(handler);
+        return it != mWeights.end() ? it->second : 1;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::releaseHandle(Msg* msg)
+    {
+        if (msg->mHandle == 0)
+            return;
+
+        // changing generation makes all handles of the slot stale
+        uint32 index = msg->mHandle - 1;
+        HandleSlot& s = mHandles[index];
+        s.mMsg = nullptr;
+        s.mGen++;
+        s.mNextFree = mFreeHandle;
+        mFreeHandle = index + 1;
+        msg->mHandle = 0;
+    }
+
+   //------------------------------------------------------------------------//
+    Msg* MsgQueue::findHandle(uint32 index, uint32 gen) const
+    {
+        if (index >= mHandles.size() || mHandles[index].mGen != gen)
+            return nullptr;
+
+        // cancelled periodic message is still dispatching, but it isn't pending
+        Msg* msg = mHandles[index].mMsg;
+        return msg && !(msg->mFlags & Msg::FLAGCANCELED) ? msg : nullptr;
+    }
+
+   //------------------------------------------------------------------------//
+    Msg* MsgQueue::dispatchingOf(MsgHandler* handler) const
+    {
+        if (mDispatching == nullptr || (handler && mDispatching->mTarget != handler))
+            return nullptr;
+        return mDispatching;
+    }
+
+   //------------------------------------------------------------------------//
+    bool MsgQueue::cancelHandle(uint32 index, uint32 gen)
+    {
+        AutoMutex critical(&mLock);
+        Msg* msg = findHandle(index, gen);
+        if (msg == nullptr)
+            return false;
+
+        // it isn't in list, finishMessage() drops it after dispatching
+        if (msg->mFlags & Msg::FLAGDISPATCHING)
+        {
+            msg->mFlags |= Msg::FLAGCANCELED;
+            return true;
+        }
+
+        releaseHandle(msg);
+        recycleMsg(unlinkMessage(msg));
+        return true;
+    }
+
+   //------------------------------------------------------------------------//
+    bool MsgQueue::rescheduleHandle(uint32 index, uint32 gen, uint64 when)
+    {
+        AutoMutex critical(&mLock);
+        Msg* msg = findHandle(index, gen);
+        if (msg == nullptr)
+            return false;
+
+        if (msg->mFlags & Msg::FLAGDISPATCHING)
         {
-            mMsgQueueTail->mNext = std::move(message);
-            mMsgQueueTail = mMsgQueueTail->mNext.get();
+            msg->mWhen = when;
+            msg->mFlags |= Msg::FLAGRESCHEDULED;
+            return true;
         }
-        else
-        {
-            Msg* h = mMsgQueueHead.get();
-            Msg* prev;
-            for(;;)
-            {
-                prev = h;
-                h = h->mNext.get();
-                if(h == nullptr || delayDoneTime < h->mWhen)
-                    break;
-            }
 
-            message->mNext = std::move(prev->mNext);
-            prev->mNext = std::move(message);
-        } 
+        // handle is kept, the message only moves in list
+        Message m = unlinkMessage(msg);
+        m->mWhen = when;
+        insertMessage(std::move(m));
 
-        mMsgQueueSize++;   
-        mBlocked = false; 
-        mWait.notifyAll();   
-        
+        mBlocked = false;
+        notifyLooper();
         return true;
     }
 
+   //------------------------------------------------------------------------//
+    bool MsgHandle::cancel(void)
+    {
+        Queue q = mQueue.lock();
+        return q ? q->cancelHandle(mIndex, mGen) : false;
+    }
+
+   //------------------------------------------------------------------------//
+    bool MsgHandle::reschedule(long delayMillis)
+    {
+        Queue q = mQueue.lock();
+        if (q.get() == nullptr)
+            return false;
+
+        if (delayMillis < 0)
+            delayMillis = 0;
+        return q->rescheduleHandle(mIndex, mGen, q->uptimeMillis() + delayMillis);
+    }
+
+   //------------------------------------------------------------------------//
+    bool MsgHandle::isPending(void) const
+    {
+        Queue q = mQueue.lock();
+        if (q.get() == nullptr)
+            return false;
+
+        AutoMutex critical(&q->mLock);
+        return q->findHandle(mIndex, mGen) != nullptr;
+    }
+
    //------------------------------------------------------------------------//
     Message MsgQueue::obtain(void)
     {
@@ -342,7 +1076,6 @@ __BEGIN__
         }
 
         Msg* h = mMsgQueueHead.get();
-        Msg* prev = h;
         for(;;)
         {
             if(h == nullptr)
@@ -350,13 +1083,10 @@ __BEGIN__
 
             if (h == message.get())
             {
-                RECYCLEMIDDLE(h, prev, handler);
+                RECYCLEMIDDLE(h, handler);
             }
             else
-            {
-                prev = h;
                 h = h->mNext.get();
-            }
         }
     }
 
@@ -370,6 +1100,9 @@ __BEGIN__
         }
 
         AutoMutex critical(&mLock);
+        Msg* d = dispatchingOf(handler);
+        if (d && d->mCallback == r)
+            d->mFlags |= Msg::FLAGCANCELED;
 
         if(mMsgQueueHead.get() == nullptr)
         {
@@ -378,7 +1111,6 @@ __BEGIN__
         }
 
         Msg* h = mMsgQueueHead.get();
-        Msg* prev = h;
         for(;;)
         {
             if (h == nullptr)
@@ -386,13 +1118,10 @@ __BEGIN__
 
             if (h->mCallback == r)
             {
-                RECYCLEMIDDLE(h, prev, handler);
+                RECYCLEMIDDLE(h, handler);
             }
             else
-            {
-                prev = h;
                 h = h->mNext.get();
-            }
         }
     }
 
@@ -400,6 +1129,9 @@ __BEGIN__
     void MsgQueue::removeMessage(int what, MsgHandler* handler /* = nullptr */)  noexcept
     {
         AutoMutex critical(&mLock);
+        Msg* d = dispatchingOf(handler);
+        if (d && d->mWhat == what)
+            d->mFlags |= Msg::FLAGCANCELED;
 
         if(mMsgQueueHead.get() == nullptr)
         {
@@ -408,7 +1140,6 @@ __BEGIN__
         }
 
         Msg* h = mMsgQueueHead.get();
-        Msg* prev = h;
         for(;;)
         {
             if (h == nullptr)
@@ -416,13 +1147,10 @@ __BEGIN__
             
             if (h->mWhat == what)
             {
-                RECYCLEMIDDLE(h, prev, handler);
+                RECYCLEMIDDLE(h, handler);
             }
             else
-            {
-                prev = h;
                 h = h->mNext.get();
-            }
         }
     }
 
@@ -430,6 +1158,9 @@ __BEGIN__
     void MsgQueue::removeMessage(int minWhat, int maxWhat, runnable& r, MsgHandler* handler /* = nullptr */)  noexcept
     {
         AutoMutex critical(&mLock);
+        Msg* d = dispatchingOf(handler);
+        if (d && d->mWhat >= minWhat && d->mWhat <= maxWhat && d->mCallback == r)
+            d->mFlags |= Msg::FLAGCANCELED;
 
         if(mMsgQueueHead.get() == nullptr)
         {
@@ -438,7 +1169,6 @@ __BEGIN__
         }
 
         Msg* h = mMsgQueueHead.get();
-        Msg* prev = h;
         for(;;)
         {
             if (h == nullptr)
@@ -447,13 +1177,10 @@ __BEGIN__
             bool b = h->mWhat >= minWhat && h->mWhat <= maxWhat && h->mCallback == r; 
             if (b)
             {
-                RECYCLEMIDDLE(h, prev, handler);
+                RECYCLEMIDDLE(h, handler);
             }
             else
-            {
-                prev = h;
                 h = h->mNext.get();
-            }
         }
     }
 
@@ -461,6 +1188,9 @@ __BEGIN__
     void MsgQueue::removeMessage(int what, int arg1, int arg2, runnable& r, MsgHandler* handler /* = nullptr */)  noexcept
     {
         AutoMutex critical(&mLock);
+        Msg* d = dispatchingOf(handler);
+        if (d && d->mWhat == what && d->mArg1 == arg1 && d->mArg2 == arg2 && d->mCallback == r)
+            d->mFlags |= Msg::FLAGCANCELED;
 
         if(mMsgQueueHead.get() == nullptr)
         {
@@ -469,7 +1199,6 @@ __BEGIN__
         }
 
         Msg* h = mMsgQueueHead.get();
-        Msg* prev = h;
         for(;;)
         {
             if (h == nullptr)
@@ -478,13 +1207,10 @@ __BEGIN__
             bool b = h->mWhat == what && h->mArg1 == arg1 && h->mArg2 == arg2 && h->mCallback == r; 
             if (b)
             {
-                RECYCLEMIDDLE(h, prev, handler);
+                RECYCLEMIDDLE(h, handler);
             }
             else
-            {
-                prev = h;
                 h = h->mNext.get();
-            }
         }
     }
 
@@ -492,6 +1218,9 @@ __BEGIN__
     void MsgQueue::removeMessage(HandlerCallback* callback, MsgHandler* handler /* = nullptr */)  noexcept
     {
         AutoMutex critical(&mLock);
+        Msg* d = dispatchingOf(handler);
+        if (d && d->mHandleCallback == callback)
+            d->mFlags |= Msg::FLAGCANCELED;
 
         if(mMsgQueueHead.get() == nullptr)
         {
@@ -500,7 +1229,6 @@ __BEGIN__
         }
 
         Msg* h = mMsgQueueHead.get();
-        Msg* prev = h;
         for(;;)
         {
             if (h == nullptr)
@@ -508,13 +1236,10 @@ __BEGIN__
             
             if (h->mHandleCallback == callback)
             {
-                RECYCLEMIDDLE(h, prev, handler);
+                RECYCLEMIDDLE(h, handler);
             }
             else
-            {
-                prev = h;
                 h = h->mNext.get();
-            }
         }
     }
 
@@ -522,6 +1247,9 @@ __BEGIN__
     void MsgQueue::removeMessage(int what, HandlerCallback *callback, MsgHandler* handler /* = nullptr */)  noexcept
     {
         AutoMutex critical(&mLock);
+        Msg* d = dispatchingOf(handler);
+        if (d && d->mWhat == what && d->mHandleCallback == callback)
+            d->mFlags |= Msg::FLAGCANCELED;
 
         if(mMsgQueueHead.get() == nullptr)
         {
@@ -530,7 +1258,6 @@ __BEGIN__
         }
 
         Msg* h = mMsgQueueHead.get();
-        Msg* prev = h;
         for(;;)
         {
             if (h == nullptr)
@@ -539,13 +1266,10 @@ __BEGIN__
             bool b = h->mWhat == what && h->mHandleCallback == callback; 
             if (b)
             {
-                RECYCLEMIDDLE(h, prev, handler);
+                RECYCLEMIDDLE(h, handler);
             }
             else
-            {
-                prev = h;
                 h = h->mNext.get();
-            }
         }
     }
 
@@ -553,6 +1277,9 @@ __BEGIN__
     void MsgQueue::removeMessage(int minWhat, int maxWhat, HandlerCallback* callback, MsgHandler* handler /* = nullptr */)  noexcept
     {
         AutoMutex critical(&mLock);
+        Msg* d = dispatchingOf(handler);
+        if (d && d->mWhat >= minWhat && d->mWhat <= maxWhat && d->mHandleCallback == callback)
+            d->mFlags |= Msg::FLAGCANCELED;
 
         if(mMsgQueueHead.get() == nullptr)
         {
@@ -561,7 +1288,6 @@ __BEGIN__
         }
 
         Msg* h = mMsgQueueHead.get();
-        Msg* prev = h;
         for(;;)
         {
             if (h == nullptr)
@@ -570,13 +1296,10 @@ __BEGIN__
             bool b = (h->mWhat >= minWhat && h->mWhat <= maxWhat) && (h->mHandleCallback == callback); 
             if (b)
             {
-                RECYCLEMIDDLE(h, prev, handler);
+                RECYCLEMIDDLE(h, handler);
             }
             else
-            {
-                prev = h;
                 h = h->mNext.get();
-            }
         }
     }
 
@@ -584,6 +1307,9 @@ __BEGIN__
     void MsgQueue::removeMessage(int what, int arg1, int arg2, HandlerCallback* callback, MsgHandler* handler /* = nullptr */)  noexcept
     {
         AutoMutex critical(&mLock);
+        Msg* d = dispatchingOf(handler);
+        if (d && d->mWhat == what && d->mArg1 == arg1 && d->mArg2 == arg2 && d->mHandleCallback == callback)
+            d->mFlags |= Msg::FLAGCANCELED;
 
         if(mMsgQueueHead.get() == nullptr)
         {
@@ -592,7 +1318,6 @@ __BEGIN__
         }
 
         Msg* h = mMsgQueueHead.get();
-        Msg* prev = h;
         for(;;)
         {
             if (h == nullptr)
@@ -601,13 +1326,10 @@ __BEGIN__
             bool b = h->mWhat == what && h->mArg1 == arg1 && h->mArg2 == arg2 && h->mHandleCallback == callback; 
             if (b)
             {
-                RECYCLEMIDDLE(h, prev, handler);
+                RECYCLEMIDDLE(h, handler);
             }
             else
-            {
-                prev = h;
                 h = h->mNext.get();
-            }
         }
     }
 
@@ -615,6 +1337,9 @@ __BEGIN__
     void MsgQueue::removeAllMessages(MsgHandler* handler /* = nullptr */)  noexcept
     {
         AutoMutex critical(&mLock);
+        Msg* d = dispatchingOf(handler);
+        if (d)
+            d->mFlags |= Msg::FLAGCANCELED;
 
         if(mMsgQueueHead.get() == nullptr)
         {
@@ -623,59 +1348,15 @@ __BEGIN__
         }
 
         Msg* h = mMsgQueueHead.get();
-        Msg* prev = h;
-        for(;;)
+        while (h)
         {
-            if(handler)
-            {
-                if(h == nullptr)
-                    break;
-
-                if(h->mTarget == handler)
-                {
-                    Message msg(nullptr);
-
-                    if (h == mMsgQueueHead.get()) // head
-                    {
-                        msg = std::move(mMsgQueueHead);
-                        mMsgQueueHead = std::move(msg->mNext); 
-                    }
-                    else
-                    {
-                        msg = std::move(prev->mNext);
-                        prev->mNext = std::move(h->mNext);
-                    }
-
-                    recycleMsg(std::move(msg));
-                    mMsgQueueSize--;
-
-                    if (h == mMsgQueueTail) {
-                        mMsgQueueTail = prev;
-                        if (prev == h) // only one message in list, mMsgQueueTail should is nullptr after delete head
-                            mMsgQueueTail = nullptr;
-                    }
-
-                    h = prev ? prev->mNext.get() : mMsgQueueHead.get();
-                }
-                else
-                {
-                    prev = h;
-                    h = h->mNext.get();
-                }
-            }
-            else
+            Msg* next = h->mNext.get();
+            if (handler == nullptr || h->mTarget == handler)
             {
-                if (mMsgQueueHead.get() == nullptr)
-                    break;
-
-                Message msg = std::move(mMsgQueueHead);
-                mMsgQueueHead = std::move(mMsgQueueHead->mNext);
-                recycleMsg(std::move(msg));
-                mMsgQueueSize--;
-
-                if (mMsgQueueSize == 0)
-                    mMsgQueueTail = nullptr;
+                releaseHandle(h);
+                recycleMsg(unlinkMessage(h));
             }
+            h = next;
         }
     }
 
@@ -684,7 +1365,7 @@ __BEGIN__
     {
         bool ret = false;    
         AutoMutex critical(&mLock);
-        uint64 now = getNowTimeOfMs();
+        uint64 now = uptimeMillis();
         ret = (mMsgQueueHead.get() == nullptr || (now < mMsgQueueHead->mWhen));
 
         return ret;
@@ -709,6 +1390,7 @@ __BEGIN__
     {
         Message ret(nullptr);
         long nextPollMsgTimeoutMillis = -1;
+        std::vector<Message> forward;
 
         for(;;)
         {
@@ -733,20 +1415,25 @@ __BEGIN__
 
             if(nextPollMsgTimeoutMillis == -1)
             {
-                while (mBlocked)
-					mWait.wait(&mLock, nextPollMsgTimeoutMillis);
+                bool sleeping = mBlocked;
+                while (mBlocked && !(mShared && mShared->headReady()))
+					waitLooper(nextPollMsgTimeoutMillis);
 					
 #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
 				mLock.lock();
 #endif
+                if (sleeping)
+                    mWakeups++;
             }
             else
             {
-                mWait.wait(&mLock, nextPollMsgTimeoutMillis);
+                waitLooper(nextPollMsgTimeoutMillis);
 
 #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
                 mLock.lock();
 #endif
+                if (nextPollMsgTimeoutMillis > 0)
+                    mWakeups++;
                 // test outtime thread exit
                 if(mOutTimeTest > 0 && nextPollMsgTimeoutMillis == mOutTimeTest)
                 {
@@ -756,36 +1443,76 @@ __BEGIN__
                 }
             }
 
-            uint64 now = getNowTimeOfNs() / PER_SEC_USEC;
+            // messages of other processes are taken from ring on looper thread
+            if (mShared)
+            {
+                receiveShared(forward);
+                if (!forward.empty())
+                {
+                    mLock.unlock();
+                    for (size_t i = 0; i < forward.size(); i++)
+                    {
+                        uint64 when = forward[i]->mWhen;
+                        uint64 wall = getNowTimeOfNs() / PER_SEC_USEC;
+                        MsgHandler* target = forward[i]->mTarget;
+                        forward[i]->mWhen = 0;
+                        target->sendMessageDelayed(std::move(forward[i]), when > wall ? long(when - wall) : 0);
+                    }
+                    forward.clear();
+                    nextPollMsgTimeoutMillis = 0;
+                    continue;
+                }
+            }
+
+            uint64 now = uptimeMillis();
             Msg* h = mMsgQueueHead.get();
-            Msg* prev(nullptr);
 
             if(h)
             {
                 if(h->mWhen <= now)
                 {
-                    if (prev == nullptr)
-                    {
-                        ret = std::move(mMsgQueueHead);
-                        mMsgQueueHead = std::move(ret->mNext);
-                        if (mMsgQueueHead.get() == nullptr)
-                            mMsgQueueTail = nullptr;
-                    }
+                    // deadline mode takes ready message of earliest deadline, fair mode
+                    // takes ready message of the handler whose turn it is
+                    Msg* d = mDeadlineMode ? nextDeadlineMessage(now) : nullptr;
+                    if (d)
+                        h = d;
+                    else if (mFair)
+                        h = nextFairMessage(now);
+
+                    // handler out of tokens, its message is moved and new head is checked
+                    if (!mRateLimits.empty() && !(h->mFlags & Msg::FLAGEXPIRED) && throttleMessage(h, now))
+                        nextPollMsgTimeoutMillis = 0;
                     else
                     {
-                        ret = std::move(prev->mNext);
-                        prev->mNext = std::move(ret->mNext);
-                        if (mMsgQueueTail == ret.get())
-                            mMsgQueueTail = prev;
+                        // periodic message keeps its handle, it comes back after dispatching
+                        if (h->mFlags & Msg::FLAGPERIODIC)
+                        {
+                            h->mFlags |= Msg::FLAGDISPATCHING;
+                            mDispatching = h;
+                        }
+                        else
+                            releaseHandle(h);
+                        ret = unlinkMessage(h);
+                        MSG_TRACE(TRACE_DEQUEUE, ret.get(), this);
+
+                        mLock.unlock();
+                        break;
                     }
-                    mMsgQueueSize--;
-
-                    mLock.unlock();
-                    break;
+                }
+                else if (mClock && mClock->advanceTo(h->mWhen))
+                {
+                    // virtual time jumped to the head, no sleeping
+                    nextPollMsgTimeoutMillis = 0;
+                }
+                else if (mClock && mClock->isVirtual())
+                {
+                    // manual virtual time, wait for advancing or new message
+                    nextPollMsgTimeoutMillis = -1;
+                    mBlocked = true;
                 }
                 else
                 {
-                    nextPollMsgTimeoutMillis = long(mMsgQueueHead->mWhen - now);
+                    nextPollMsgTimeoutMillis = long(coalescedWakeTime() - now);
                 }
             }
             else
@@ -807,6 +1534,10 @@ __BEGIN__
             }
             
             mLock.unlock();
+
+            // nothing to dispatch now, journal worker may compact a file of done records
+            if (mJournal)
+                mJournal->maintain();
         }
 
         return ret;
@@ -815,6 +1546,9 @@ __BEGIN__
    //------------------------------------------------------------------------//
     void MsgQueue::recycleMsg(Message msg)  noexcept
     {
+        MSG_TRACE(TRACE_RECYCLE, msg.get(), this);
+        if (msg->mJournalSeq && mJournal)
+            mJournal->done(msg->mJournalSeq);
         msg->recycleUnchecked();
         AutoMutex critical((Mutex* const)&mMsgPoolMutex);
         
@@ -834,6 +1568,209 @@ __BEGIN__
     }
 
     //------------------------------------------------------------------------//
+    void MsgQueue::finishMessage(Message msg)  noexcept
+    {
+        if (!(msg->mFlags & Msg::FLAGPERIODIC))
+        {
+            recycleMsg(std::move(msg));
+            return;
+        }
+
+        {
+            AutoMutex critical(&mLock);
+            msg->mFlags &= ~Msg::FLAGDISPATCHING;
+            if (mDispatching == msg.get())
+                mDispatching = nullptr;
+            if (mQuit || mNotEnqueMsg || (msg->mFlags & Msg::FLAGCANCELED))
+            {
+                releaseHandle(msg.get());
+                recycleMsg(std::move(msg));
+                return;
+            }
+
+            uint64 now = uptimeMillis();
+            if (msg->mFlags & Msg::FLAGRESCHEDULED)
+                msg->mFlags &= ~Msg::FLAGRESCHEDULED;
+            else if (msg->mFlags & Msg::FLAGFIXEDRATE)
+            {
+                // next tick follows original schedule so it doesn't drift, the ticks
+                // missed by a slow dispatching are skipped instead of bursting
+                uint64 next = msg->mWhen + msg->mPeriod;
+                if (next < now)
+                    next = msg->mWhen + (now - msg->mWhen + msg->mPeriod - 1) / msg->mPeriod * msg->mPeriod;
+                msg->mWhen = next;
+            }
+            else
+                msg->mWhen = now + msg->mPeriod;
+
+            if (msg->mTarget->queue().get() == this)
+            {
+                // same message is reused, no obtaining and recycling per tick
+                insertMessage(std::move(msg));
+                mBlocked = false;
+                notifyLooper();
+                return;
+            }
+
+            releaseHandle(msg.get());
+        }
+
+        // handler migrated while message was running, next tick goes to new queue
+        uint64 when = msg->mWhen;
+        MsgQueue* to = msg->mTarget->queue().get();
+        msg->mFlags &= ~Msg::FLAGINUSE;
+        to->enqueueMessage(std::move(msg), when);
+    }
+
+     //------------------------------------------------------------------------//
+    bool MsgQueue::expireMessage(Message& msg)  noexcept
+    {
+        if (!(msg->mFlags & Msg::FLAGEXPIRED))
+            return false;
+
+        msgExpiredHandler handler = nullptr;
+        void* context = nullptr;
+        {
+            AutoMutex critical(&mLock);
+            handler = mExpiredHandler;
+            context = mExpiredContext;
+        }
+
+        if (handler)
+            handler(msg, context);
+        else
+            LOGW("message(what = %d) passed its deadline, it is dropped", msg->mWhat);
+        recycleMsg(std::move(msg));
+        return true;
+    }
+
+   //------------------------------------------------------------------------//
+    int MsgQueue::takeReentrantMessages(std::vector<Message>& messages, uint64 now)
+    {
+        AutoMutex critical(&mLock);
+        int n = 0;
+        for (Msg* p = mMsgQueueHead.get(); p && p->mWhen <= now; )
+        {
+            Msg* next = p->mNext.get();
+            if (p->mTarget->isReentrant())
+            {
+                // queue is quitting, periodic message isn't requeued after this run
+                releaseHandle(p);
+                messages.push_back(unlinkMessage(p));
+                n++;
+            }
+            p = next;
+        }
+
+        return n;
+    }
+
+   //------------------------------------------------------------------------//
+    int MsgQueue::discardMessages(uint64 from)
+    {
+        AutoMutex critical(&mLock);
+        int n = 0;
+        Msg* p = mMsgQueueTail;
+        while (p && p->mWhen >= from)
+        {
+            Msg* prev = p->mPrev;
+            releaseHandle(p);
+            discardMessage(unlinkMessage(p));
+            n++;
+            p = prev;
+        }
+
+        return n;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::discardMessage(Message msg)  noexcept
+    {
+        // not done in journal, durable message is recovered next time
+        msg->mJournalSeq = 0;
+        recycleMsg(std::move(msg));
+    }
+
+   //------------------------------------------------------------------------//
+    // a migration locks two queues, migrations one at a time can't lock them crosswise
+    static Mutex& migrateMutex(void)
+    {
+        static Mutex gMigrateMutex;
+        return gMigrateMutex;
+    }
+
+   //------------------------------------------------------------------------//
+    int MsgQueue::migrateHandler(MsgHandler* handler, MsgQueue* to, MsgBinding* binding)
+    {
+        AutoMutex order(&migrateMutex());
+        AutoMutex src(&mLock);
+        AutoMutex dst(&to->mLock);
+        if (to->mQuit || to->mNotEnqueMsg)
+        {
+            LOGE("%s", "Error: target queue had exited, handler isn't migrated");
+            return -1;
+        }
+
+        // a sender waiting for either lock sees the new binding, messages enqueued
+        // before are moved below, so none is left behind
+        handler->mBinding.store(binding, std::memory_order_release);
+
+        std::vector<Message> moved;
+        for (Msg* p = mMsgQueueHead.get(); p; )
+        {
+            Msg* next = p->mNext.get();
+            if (p->mTarget == handler)
+            {
+                releaseHandle(p);
+                moved.push_back(unlinkMessage(p));
+            }
+            p = next;
+        }
+
+        // messages sent at front have time 0 and each goes before the others, so they
+        // are inserted in reverse to keep order of list
+        size_t front = 0;
+        while (front < moved.size() && moved[front]->mWhen == 0)
+            front++;
+
+        for (size_t i = 0; i < moved.size(); i++)
+        {
+            Message& m = moved[i < front ? front - 1 - i : i];
+            if (m->mJournalSeq && mJournal)
+                mJournal->done(m->mJournalSeq);
+            m->mJournalSeq = 0;
+            if (to->mJournal && (m->mFlags & Msg::FLAGDURABLE))
+                m->mJournalSeq = to->mJournal->append(m->mWhen, handler->getDurableId(), m->mWhat,
+                                                      m->mArg1, m->mArg2, m->mParam, m->mParamBytes);
+            m->mFlags &= ~Msg::FLAGTHROTTLED;
+            to->insertMessage(std::move(m));
+        }
+
+        // limits of handler go with it
+        std::unordered_map<MsgHandler*, RateLimit>::iterator r = mRateLimits.find(handler);
+        if (r != mRateLimits.end())
+        {
+            to->mRateLimits[handler] = r->second;
+            mRateLimits.erase(r);
+        }
+
+        std::unordered_map<MsgHandler*, int>::iterator w = mWeights.find(handler);
+        if (w != mWeights.end())
+        {
+            to->mWeights[handler] = w->second;
+            mWeights.erase(w);
+        }
+
+        if (!moved.empty())
+        {
+            to->mBlocked = false;
+            to->notifyLooper();
+        }
+
+        return (int)moved.size();
+    }
+
+   //------------------------------------------------------------------------//
     void MsgQueue::clearMsgPool(void)
     {
         AutoMutex critical((Mutex* const)&mMsgPoolMutex);
@@ -861,7 +1798,7 @@ __BEGIN__
         {
             mNotEnqueMsg = true;
             mBlocked = false;
-            mWait.notifyAll();
+            notifyLooper();
             return;
         }
 
@@ -874,14 +1811,21 @@ __BEGIN__
         {
             pre = std::move(mMsgQueueHead);
             mMsgQueueHead = std::move(pre->mNext);
+            releaseHandle(pre.get());
             pre.reset();
         }
         
         mMsgQueueTail = nullptr;
+        mMsgQueueSize = 0;
+        mLanes.clear();
+        mLaneOrder.clear();
+        mLaneCursor = 0;
+        mPendingDeadlines.clear();
+        mReadyDeadlines.clear();
 
         mQuit = true;
         mBlocked = false;
-        mWait.notifyAll();
+        notifyLooper();
     }
 
    //------------------------------------------------------------------------//
@@ -891,6 +1835,76 @@ __BEGIN__
         mOutTimeTest = t;
     }
 
+   //------------------------------------------------------------------------//
+    bool MsgQueue::openJournal(const char* path)
+    {
+        if (mJournal)
+            return true;
+
+        mJournal = MsgJournal::open(path);
+        return mJournal != nullptr;
+    }
+
+   //------------------------------------------------------------------------//
+    int MsgQueue::recoverJournal(MsgHandler* handler)
+    {
+        if (mJournal == nullptr || handler == nullptr)
+            return 0;
+
+        std::vector<JournalEntry> entries;
+        mJournal->takeRecovered(handler->getDurableId(), entries);
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            JournalEntry& e = entries[i];
+            void* param = nullptr;
+            if (!e.mParam.empty())
+            {
+                param = malloc(e.mParam.size());
+                memcpy(param, e.mParam.data(), e.mParam.size());
+            }
+
+            // sequence is kept, so recovered message isn't appended to journal again
+            Message msg = Msg::obtain(handler);
+            msg->mTarget = handler;
+            msg->mWhat = e.mWhat;
+            msg->mArg1 = e.mArg1;
+            msg->mArg2 = e.mArg2;
+            msg->setParam(param, e.mParam.size(), param ? freeJournalParam : nullptr);
+            msg->mFlags |= Msg::FLAGDURABLE;
+            msg->mJournalSeq = e.mSeq;
+            enqueueMessage(std::move(msg), e.mWhen);
+        }
+
+        if (!entries.empty())
+            LOGI("recover %d durable messages for handler %d", (int)entries.size(), handler->getDurableId());
+        return (int)entries.size();
+    }
+
+   //------------------------------------------------------------------------//
+    bool MsgQueue::startRecording(const char* path)
+    {
+        MsgRecorder* recorder = MsgRecorder::create(path, uptimeMillis());
+        if (recorder == nullptr)
+            return false;
+
+        AutoMutex critical(&mLock);
+        delete mRecorder;
+        mRecorder = recorder;
+        return true;
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueue::stopRecording(void)
+    {
+        MsgRecorder* recorder;
+        {
+            AutoMutex critical(&mLock);
+            recorder = mRecorder;
+            mRecorder = nullptr;
+        }
+        delete recorder;
+    }
+
    //------------------------------------------------------------------------//
     void MsgQueue::addIdleHandler(const msgQueueIdleHandler& handler)
     {
@@ -905,53 +1919,125 @@ __BEGIN__
         mIdleHandlerFunc = nullptr;
     }
 
+   //------------------------------------------------------------------------//
+    void MsgQueue::snapshot(MsgQueueSnapshot& snap) const
+    {
+        // a little room for messages sent meanwhile, so copying under lock rarely grows it
+        int size = getQueueSize();
+        snap.mMessages.clear();
+        snap.mMessages.reserve(size + size / 8 + 16);
+        snap.mPoolSize = getMsgPoolSize();
+
+        {
+            AutoMutex critical(&mLock);
+            for (Msg* p = mMsgQueueHead.get(); p; p = p->mNext.get())
+            {
+                MsgDescriptor d;
+                d.mWhat = p->mWhat;
+                d.mTarget = p->mTarget;
+                d.mWhen = p->mWhen;
+                d.mOverdue = 0;
+                d.mWaiting = false;
+                snap.mMessages.push_back(d);
+            }
+        }
+
+        snap.mTakenAt = uptimeMillis();
+        std::unordered_map<int, size_t> whats;
+        std::unordered_map<MsgHandler*, size_t> targets;
+        snap.mByWhat.clear();
+        snap.mByTarget.clear();
+        for (size_t i = 0; i < snap.mMessages.size(); i++)
+        {
+            MsgDescriptor& d = snap.mMessages[i];
+            d.mWaiting = d.mWhen > snap.mTakenAt;
+            d.mOverdue = d.mWhen != 0 && !d.mWaiting ? snap.mTakenAt - d.mWhen : 0;
+
+            std::pair<std::unordered_map<int, size_t>::iterator, bool> w = whats.emplace(d.mWhat, snap.mByWhat.size());
+            if (w.second)
+                snap.mByWhat.push_back(MsgWhatCount{ d.mWhat, 0, 0, 0 });
+            MsgWhatCount& wc = snap.mByWhat[w.first->second];
+            wc.mCount++;
+            wc.mWaiting += d.mWaiting;
+            wc.mMaxOverdue = std::max(wc.mMaxOverdue, d.mOverdue);
+
+            std::pair<std::unordered_map<MsgHandler*, size_t>::iterator, bool> t = targets.emplace(d.mTarget, snap.mByTarget.size());
+            if (t.second)
+                snap.mByTarget.push_back(MsgTargetCount{ d.mTarget, 0, 0, 0 });
+            MsgTargetCount& tc = snap.mByTarget[t.first->second];
+            tc.mCount++;
+            tc.mWaiting += d.mWaiting;
+            tc.mMaxOverdue = std::max(tc.mMaxOverdue, d.mOverdue);
+        }
+
+        std::stable_sort(snap.mByWhat.begin(), snap.mByWhat.end(),
+            [](const MsgWhatCount& a, const MsgWhatCount& b) { return a.mCount > b.mCount; });
+        std::stable_sort(snap.mByTarget.begin(), snap.mByTarget.end(),
+            [](const MsgTargetCount& a, const MsgTargetCount& b) { return a.mCount > b.mCount; });
+    }
+
+   //------------------------------------------------------------------------//
+    void MsgQueueSnapshot::dump(const char* name, int top /* = 16 */) const
+    {
+        LOGI("queue %s: %d messages, %d in pool, at %llu", name ? name : "", (int)mMessages.size(), mPoolSize,
+            (unsigned long long)mTakenAt);
+
+        for (size_t i = 0; i < mByWhat.size() && (int)i < top; i++)
+            LOGI("  what = %d, count = %d, waiting = %d, max overdue = %llu ms", mByWhat[i].mWhat,
+                mByWhat[i].mCount, mByWhat[i].mWaiting, (unsigned long long)mByWhat[i].mMaxOverdue);
+
+        for (size_t i = 0; i < mByTarget.size() && (int)i < top; i++)
+            LOGI("  target = %p, count = %d, waiting = %d, max overdue = %llu ms", mByTarget[i].mTarget,
+                mByTarget[i].mCount, mByTarget[i].mWaiting, (unsigned long long)mByTarget[i].mMaxOverdue);
+    }
+
    //------------------------------------------------------------------------//
     void MsgQueue::dumpQueueList(void) const
     {
-        AutoMutex critical(&mLock);
-        Msg* p = mMsgQueueHead.get();
+        MsgQueueSnapshot snap;
+        snapshot(snap);
+
         printf("\n");
         LOGI("%s\n\n", "---------------------Message queue begin---------------------");
-        for(;;)
+        for (size_t i = 0; i < snap.mMessages.size(); i++)
         {
-            if (p)
-            {
-                std::string s;
-                if (p->mNext.get())
-                    s = "Message  of queue shared_ptr = %p, what = %d, when = %llu, Using = %s";
-                else
-                    s = "Message  of queue shared_ptr = %p, what = %d, when = %llu, Using = %s\n";
-                LOGI(s.c_str(), p, p->mWhat, p->mWhen, p->isInUse() ? "true" : "false");
-                p = p->mNext.get();       
-            }
-            else    
-                break;
+            const MsgDescriptor& d = snap.mMessages[i];
+            LOGI("Message  of queue target = %p, what = %d, when = %llu, overdue = %llu%s%s", d.mTarget,
+                d.mWhat, (unsigned long long)d.mWhen, (unsigned long long)d.mOverdue, d.mWaiting ? ", waiting" : "",
+                i + 1 == snap.mMessages.size() ? "\n" : "");
         }
 
         LOGI("%s\n", "----------------------Message queue end----------------------");
-    }   
+        snap.dump(mName.c_str());
+    }
 
    //------------------------------------------------------------------------//
     void MsgQueue::dumpQueuePool(void) const
     {
-        AutoMutex critical((Mutex* const)&mMsgPoolMutex);
-        Msg* p = mMsgPool.get();
+        // pooled messages are copied first, logging them under lock would stall obtain()
+        struct PoolEntry
+        {
+            const Msg*  mMsg;
+            int         mWhat;
+            uint64      mWhen;
+            bool        mInUse;
+        };
+
+        std::vector<PoolEntry> entries;
+        entries.reserve(mMsgPoolMaxSize + 1);
+        {
+            AutoMutex critical((Mutex* const)&mMsgPoolMutex);
+            for (Msg* p = mMsgPool.get(); p; p = p->mNext.get())
+                entries.push_back(PoolEntry{ p, p->mWhat, p->mWhen, p->isInUse() });
+        }
+
         printf("\n");
         LOGI("%s\n\n", "---------------------Message pool begin----------------------");
-        for(;;)
+        for (size_t i = 0; i < entries.size(); i++)
         {
-            if (p)
-            {
-                std::string s;
-                if (p->mNext.get())
-                    s = "Message of pool shared_ptr = %p, what = %d, when = %llu, Using = %s";
-                else
-                    s = "Message of pool shared_ptr = %p, what = %d, when = %llu, Using = %s\n";
-                LOGI(s.c_str(), p, p->mWhat, p->mWhen, p->isInUse() ? "true" : "false");
-                p = p->mNext.get();       
-            }
-            else
-                break;
+            const PoolEntry& e = entries[i];
+            LOGI("Message of pool shared_ptr = %p, what = %d, when = %llu, Using = %s%s", e.mMsg, e.mWhat,
+                (unsigned long long)e.mWhen, e.mInUse ? "true" : "false", i + 1 == entries.size() ? "\n" : "");
         }
 
         LOGI("%s\n", "----------------------Message pool end-----------------------");
@@ -0,0 +1,226 @@
+/*****************************************************************************
+* FileName    : MessageRecorder.cpp
+* Description : Record messages of queue into file and replay them implemention
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#include "../../inc/looper/MessageRecorder.h"
+#include "../../inc/looper/MessageHandler.h"
+#include "../../inc/os/AutoMutex.hpp"
+#include "../../inc/os/Logger.h"
+#include "../../inc/base/TimeUtil.h"
+#include <errno.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+   //------------------------------------------------------------------------//
+    #ifdef LOG_TAG
+        #undef LOG_TAG
+    #endif
+    #define LOG_TAG (MessageRecorder):
+
+    //------------------------------------------------------------------------//
+    #define RECORD_MAGIC            0x31434552  // "REC1"
+    #define RECORD_VERSION          2
+    #define RECORD_FLAG_CALLBACK    (1 << 0)    // message had runnable or callback object
+
+    struct RecordHeader
+    {
+        uint32  mMagic;
+        uint32  mVersion;
+        uint64  mStartTime;     // wall clock of millisecond
+    };
+
+    struct RecordEntry
+    {
+        uint64          mOffset;        // enqueue time of queue clock since recording started, millisecond
+        int             mDelayMillis;   // -1 is at front of queue
+        int             mWhat;
+        int             mArg1;
+        int             mArg2;
+        unsigned short  mTarget;
+        unsigned short  mFlags;
+        uint32          mBytes;         // param bytes follow the entry
+    };
+
+    //------------------------------------------------------------------------//
+    static void freeReplayParam(void* obj, size_t bytes)
+    {
+        free(obj);
+    }
+
+    //------------------------------------------------------------------------//
+    MsgRecorder::MsgRecorder(FILE* fp, uint64 startMillis)
+    : mFile(fp)
+    , mStartMillis(startMillis)
+    , mCount(0)
+    , mTargets()
+    , mMutex()
+    {
+    }
+
+    //------------------------------------------------------------------------//
+    MsgRecorder::~MsgRecorder(void)
+    {
+        AutoMutex lock(&mMutex);
+        if (mFile)
+            fclose(mFile);
+        mFile = nullptr;
+        LOGD("record %ld messages", mCount);
+    }
+
+    //------------------------------------------------------------------------//
+    MsgRecorder* MsgRecorder::create(const char* path, uint64 startMillis)
+    {
+        FILE* fp = fopen(path, "wb");
+        if (fp == nullptr)
+        {
+            LOGE("fail to create record file %s", path);
+            return nullptr;
+        }
+
+        RecordHeader h;
+        h.mMagic = RECORD_MAGIC;
+        h.mVersion = RECORD_VERSION;
+        h.mStartTime = getNowTimeOfMs();
+        fwrite(&h, sizeof(h), 1, fp);
+
+        return new MsgRecorder(fp, startMillis);
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgRecorder::record(const Msg* msg, uint64 when, uint64 now)
+    {
+        AutoMutex lock(&mMutex);
+        std::map<MsgHandler*, int>::iterator it = mTargets.find(msg->mTarget);
+        if (it == mTargets.end())
+            it = mTargets.insert(std::make_pair(msg->mTarget, (int)mTargets.size())).first;
+
+        RecordEntry e;
+        e.mOffset = now > mStartMillis ? now - mStartMillis : 0;
+        e.mDelayMillis = when == 0 ? -1 : (when > now ? int(when - now) : 0);
+        e.mWhat = msg->mWhat;
+        e.mArg1 = msg->mArg1;
+        e.mArg2 = msg->mArg2;
+        e.mTarget = (unsigned short)it->second;
+        e.mFlags = (msg->mCallback || msg->mHandleCallback) ? RECORD_FLAG_CALLBACK : 0;
+        e.mBytes = msg->getParam() ? (uint32)msg->ParamSize() : 0;
+
+        fwrite(&e, sizeof(e), 1, mFile);
+        if (e.mBytes)
+            fwrite(msg->getParam(), 1, e.mBytes, mFile);
+        mCount++;
+    }
+
+    //------------------------------------------------------------------------//
+    MsgReplayer::MsgReplayer(FILE* fp)
+    : mFile(fp)
+    , mHandlers()
+    , mDefault(nullptr)
+    {
+    }
+
+    //------------------------------------------------------------------------//
+    MsgReplayer::~MsgReplayer(void)
+    {
+        if (mFile)
+            fclose(mFile);
+        mFile = nullptr;
+    }
+
+    //------------------------------------------------------------------------//
+    MsgReplayer* MsgReplayer::open(const char* path)
+    {
+        FILE* fp = fopen(path, "rb");
+        if (fp == nullptr)
+        {
+            LOGE("fail to open record file %s", path);
+            return nullptr;
+        }
+
+        RecordHeader h;
+        if (fread(&h, sizeof(h), 1, fp) != 1 || h.mMagic != RECORD_MAGIC)
+        {
+            LOGE("%s isn't a message record file", path);
+            fclose(fp);
+            return nullptr;
+        }
+
+        if (h.mVersion != RECORD_VERSION)
+        {
+            LOGE("%s is record of version %u, only %u is replayed", path, h.mVersion, RECORD_VERSION);
+            fclose(fp);
+            return nullptr;
+        }
+
+        return new MsgReplayer(fp);
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgReplayer::bindHandler(int target, const Handler& h)
+    {
+        mHandlers[target] = h;
+    }
+
+    //------------------------------------------------------------------------//
+    long MsgReplayer::replay(double speed /* = 1.0 */)
+    {
+        fseek(mFile, sizeof(RecordHeader), SEEK_SET);
+
+        long count = 0;
+        std::vector<char> param;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        RecordEntry e;
+        while (fread(&e, sizeof(e), 1, mFile) == 1)
+        {
+            param.resize(e.mBytes);
+            if (e.mBytes && fread(param.data(), 1, e.mBytes, mFile) != e.mBytes)
+            {
+                LOGE("%s", "record file is truncated");
+                break;
+            }
+
+            std::map<int, Handler>::iterator it = mHandlers.find(e.mTarget);
+            Handler& h = it != mHandlers.end() ? it->second : mDefault;
+            if (h.get() == nullptr)
+                continue;
+
+            long delay = e.mDelayMillis;
+            if (speed > 0)
+            {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(uint64(e.mOffset * 1000000 / speed)));
+                if (delay > 0)
+                    delay = long(delay / speed);
+            }
+            else if (delay > 0)
+                delay = 0;
+
+            void* p = nullptr;
+            if (e.mBytes)
+            {
+                p = malloc(e.mBytes);
+                memcpy(p, param.data(), e.mBytes);
+            }
+
+            Message msg = Msg::obtain(e.mWhat, e.mArg1, e.mArg2, p, e.mBytes, p ? freeReplayParam : nullptr, h);
+            if (delay < 0)
+                h->sendMessageAtFrontOfQueue(std::move(msg));
+            else
+                h->sendMessageDelayed(std::move(msg), delay);
+            count++;
+        }
+
+        LOGI("replay %ld messages in %lld ms", count,
+             (long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+        return count;
+    }
+
+__END__
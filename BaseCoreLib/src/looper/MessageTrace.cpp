@@ -0,0 +1,188 @@
+/*****************************************************************************
+* FileName    : MessageTrace.cpp
+* Description : Message lifecycle tracing implemention
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#include "../../inc/looper/MessageTrace.h"
+#include "../../inc/looper/Message.h"
+#include "../../inc/looper/MessageQueue.h"
+#include "../../inc/looper/MessageLooper.h"
+#include "../../inc/os/CircularQueue.hpp"
+#include "../../inc/os/AutoMutex.hpp"
+#include "../../inc/os/Logger.h"
+#include "../../inc/base/TimeUtil.h"
+#include <vector>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+   //------------------------------------------------------------------------//
+    #ifdef LOG_TAG
+        #undef LOG_TAG
+    #endif
+    #define LOG_TAG (MessageTrace):
+
+    //------------------------------------------------------------------------//
+    #define TRACE_RING_SIZE     16384
+    #define TRACE_NAME_SIZE     40
+
+    // one record fills a cache line, the ring of a thread is about 1MB
+    struct TraceRecord
+    {
+        uint64  mTime;
+        uint64  mId;
+        int     mWhat;
+        int     mEvent;
+        char    mQueue[TRACE_NAME_SIZE];
+    };
+
+    struct TraceRing
+    {
+        uint64                                      mTid;
+        std::atomic<uint64>                         mDropped;
+        RingQueue<TraceRecord, TRACE_RING_SIZE>     mRecords;
+
+        explicit TraceRing(uint64 tid) : mTid(tid), mDropped(0) { }
+    };
+
+    //------------------------------------------------------------------------//
+    std::atomic<bool> MsgTrace::mEnabled(false);
+
+    static std::atomic<uint64>      gTraceId(0);
+    static Mutex                    gRingsMutex;
+    static std::vector<TraceRing*>  gRings;     // rings outlive their threads, so flush can still read them
+    static threadlocal TraceRing*   gThreadRing = nullptr;
+
+    //------------------------------------------------------------------------//
+    static TraceRing* threadRing(void)
+    {
+        if (gThreadRing == nullptr)
+        {
+            TraceRing* ring = new TraceRing(MsgLooper::getCurrentThreadId());
+            AutoMutex lock(&gRingsMutex);
+            gRings.push_back(ring);
+            gThreadRing = ring;
+        }
+
+        return gThreadRing;
+    }
+
+    //------------------------------------------------------------------------//
+    static void writeEscaped(FILE* fp, const char* s)
+    {
+        for (; *s; ++s)
+        {
+            if (*s == '"' || *s == '\\')
+                fputc('\\', fp);
+            if ((unsigned char)*s >= 0x20)
+                fputc(*s, fp);
+        }
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgTrace::enable(void)
+    {
+        mEnabled.store(true, std::memory_order_relaxed);
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgTrace::disable(void)
+    {
+        mEnabled.store(false, std::memory_order_relaxed);
+    }
+
+    //------------------------------------------------------------------------//
+    void MsgTrace::record(MsgTraceEvent event, Msg* msg, const MsgQueue* queue)
+    {
+        if (msg == nullptr)
+            return;
+
+        // the id links all events of one message, it is given when message is enqueued
+        if (msg->mTraceId == 0)
+            msg->mTraceId = (uint32)(gTraceId.fetch_add(1, std::memory_order_relaxed) + 1);
+
+        TraceRecord r;
+        r.mTime = getNowTimeOfNs();
+        r.mId = msg->mTraceId;
+        r.mWhat = msg->mWhat;
+        r.mEvent = event;
+        r.mQueue[0] = '\0';
+        if (queue)
+        {
+            strncpy(r.mQueue, queue->getQueueName(), TRACE_NAME_SIZE - 1);
+            r.mQueue[TRACE_NAME_SIZE - 1] = '\0';
+        }
+
+        TraceRing* ring = threadRing();
+        if (!ring->mRecords.push(r))
+            ring->mDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //------------------------------------------------------------------------//
+    long MsgTrace::flush(const char* path)
+    {
+        FILE* fp = fopen(path, "w");
+        if (fp == nullptr)
+        {
+            LOGE("fail to open trace file %s", path);
+            return -1;
+        }
+
+        long count = 0;
+        fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+        AutoMutex lock(&gRingsMutex);
+        for (size_t i = 0; i < gRings.size(); i++)
+        {
+            TraceRing* ring = gRings[i];
+            fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%llu,\"args\":{\"name\":\"Thread_%llu\"}}",
+                    count ? ",\n" : "", (unsigned long long)ring->mTid, (unsigned long long)ring->mTid);
+            count++;
+
+            TraceRecord r;
+            while (ring->mRecords.pop(r))
+            {
+                // enqueue/recycle open and close an async slice per message, so the
+                // latency between threads is visible, dispatch is a slice on its thread
+                const char* ph;
+                switch (r.mEvent)
+                {
+                    case TRACE_ENQUEUE:         ph = "b"; break;
+                    case TRACE_DEQUEUE:         ph = "n"; break;
+                    case TRACE_DISPATCH_BEGIN:  ph = "B"; break;
+                    case TRACE_DISPATCH_END:    ph = "E"; break;
+                    default:                    ph = "e"; break;
+                }
+
+                fprintf(fp, ",\n{\"name\":\"what_%d\",\"cat\":\"looper\",\"ph\":\"%s\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%llu",
+                        r.mWhat, ph, (unsigned long long)(r.mTime / 1000), (unsigned)(r.mTime % 1000), (unsigned long long)ring->mTid);
+                if (r.mEvent != TRACE_DISPATCH_BEGIN && r.mEvent != TRACE_DISPATCH_END)
+                    fprintf(fp, ",\"id\":\"0x%llx\"", (unsigned long long)r.mId);
+                fprintf(fp, ",\"args\":{\"msg\":%llu,\"what\":%d,\"queue\":\"", (unsigned long long)r.mId, r.mWhat);
+                writeEscaped(fp, r.mQueue);
+                fprintf(fp, "\"}}");
+                count++;
+            }
+        }
+
+        fprintf(fp, "\n]}\n");
+        fclose(fp);
+
+        LOGI("write %ld trace events to %s", count, path);
+        return count;
+    }
+
+    //------------------------------------------------------------------------//
+    uint64 MsgTrace::getDroppedEvents(void)
+    {
+        uint64 dropped = 0;
+        AutoMutex lock(&gRingsMutex);
+        for (size_t i = 0; i < gRings.size(); i++)
+            dropped += gRings[i]->mDropped.load(std::memory_order_relaxed);
+        return dropped;
+    }
+
+__END__
@@ -0,0 +1,457 @@
+/*****************************************************************************
+* FileName    : Pipeline.cpp
+* Description : Multi-stage pipeline linked with SPSC rings implemention
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#include "../../inc/looper/Pipeline.h"
+#include "../../inc/looper/MessageHandler.h"
+#include "../../inc/os/CircularQueue.hpp"
+#include "../../inc/os/Logger.h"
+#include "../../inc/os/SimpleFixedThreadpool.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+   //------------------------------------------------------------------------//
+    #ifdef LOG_TAG
+        #undef LOG_TAG
+    #endif
+    #define LOG_TAG (Pipeline):
+
+    //------------------------------------------------------------------------//
+    #define PIPELINE_RING_SIZE      1024
+    #define PIPELINE_SPINS          256
+    #define PIPELINE_YIELDS         64
+
+    //------------------------------------------------------------------------//
+    // source waits here for room of first ring, notifying costs a fence only until
+    // somebody sleeps
+    class PipeWaiter
+    {
+        public:
+            PipeWaiter(void) : mSleepers(0), mMutex(), mCond() { }
+
+            template <typename Ready>
+            void wait(Pipeline::WaitStrategy strategy, Ready ready)
+            {
+                for (int i = 0; ; i++)
+                {
+                    if (ready())
+                        return;
+                    if (strategy == Pipeline::WAIT_SPIN || i < PIPELINE_SPINS)
+                        continue;
+                    if (strategy == Pipeline::WAIT_YIELD || i < PIPELINE_SPINS + PIPELINE_YIELDS)
+                    {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    break;
+                }
+
+                std::unique_lock<std::mutex> lock(mMutex);
+                mSleepers.fetch_add(1);
+                // pairs with fence of notify, either ready is seen here or sleeper is seen there
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while (!ready())
+                    mCond.wait(lock);
+                mSleepers.fetch_sub(1);
+            }
+
+            void notify(void)
+            {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (mSleepers.load(std::memory_order_relaxed) == 0)
+                    return;
+
+                std::lock_guard<std::mutex> lock(mMutex);
+                mCond.notify_all();
+            }
+
+            // for the last signal before waiter destroys object, nothing is touched after
+            // unlocking and waitLast() sees it only after the unlock
+            template <typename Set>
+            void notifyLast(Set set)
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                set();
+                mCond.notify_all();
+            }
+
+            template <typename Ready>
+            void waitLast(Ready ready)
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                while (!ready())
+                    mCond.wait(lock);
+            }
+
+        private:
+            std::atomic<int>            mSleepers;
+            std::mutex                  mMutex;
+            std::condition_variable     mCond;
+    };
+
+    //------------------------------------------------------------------------//
+    struct PipeLink
+    {
+        RingQueue<void*, PIPELINE_RING_SIZE>    mRing;
+        PipeWaiter                              mNotFull;   // source sleeps
+        std::atomic<bool>                       mClosed;    // producer won't push any more
+        std::atomic<bool>                       mBlocked;   // producer stage is parked on full ring
+        PipeStage*                              mProducer;  // nullptr is source
+        PipeStage*                              mConsumer;
+
+        PipeLink(void) : mRing(), mNotFull(), mClosed(false), mBlocked(false), mProducer(nullptr), mConsumer(nullptr) { }
+    };
+
+    struct PipeStage
+    {
+        Pipeline*               mOwner;
+        pipelineStage           mFunc;
+        Looper                  mLooper;
+        Handler                 mHandler;
+        fixed_thread_pool*      mPool;
+        PipeLink*               mIn;
+        PipeLink*               mOut;       // nullptr is last stage
+        void*                   mPending;   // output which didn't fit into ring of next stage
+        std::atomic<bool>       mScheduled; // drain message or task is posted or running
+        std::atomic<uint64>     mCount;
+        std::atomic<bool>       mFinished;
+        std::atomic<bool>       mFenced;
+        PipeWaiter              mDone;
+
+        PipeStage(Pipeline* owner, const pipelineStage& fn, const Looper& looper, fixed_thread_pool* pool)
+        : mOwner(owner), mFunc(fn), mLooper(looper), mHandler(nullptr), mPool(pool), mIn(nullptr), mOut(nullptr)
+        , mPending(nullptr), mScheduled(false), mCount(0), mFinished(false), mFenced(false), mDone() { }
+    };
+
+    //------------------------------------------------------------------------//
+    Pipeline::Pipeline(WaitStrategy wait /* = WAIT_BLOCK */, int batch /* = 64 */)
+    : mWait(wait)
+    , mBatch(batch > 0 ? batch : 1)
+    , mStarted(false)
+    , mStopped(false)
+    , mInvalid(false)
+    , mStages()
+    , mLinks()
+    {
+    }
+
+    //------------------------------------------------------------------------//
+    Pipeline::~Pipeline(void)
+    {
+        stop();
+
+        for (size_t i = 0; i < mStages.size(); i++)
+            delete mStages[i];
+        for (size_t i = 0; i < mLinks.size(); i++)
+            delete mLinks[i];
+        mStages.clear();
+        mLinks.clear();
+    }
+
+    //------------------------------------------------------------------------//
+    Pipeline& Pipeline::addStage(const pipelineStage& fn, const Looper& looper)
+    {
+        if (looper.get() == nullptr)
+        {
+            LOGE("%s", "looper of stage is null, pipeline won't start");
+            mInvalid = true;
+            return *this;
+        }
+
+        return addStage(new PipeStage(this, fn, looper, nullptr));
+    }
+
+    //------------------------------------------------------------------------//
+    Pipeline& Pipeline::addStage(const pipelineStage& fn, fixed_thread_pool* pool)
+    {
+        if (pool == nullptr)
+        {
+            LOGE("%s", "pool of stage is null, pipeline won't start");
+            mInvalid = true;
+            return *this;
+        }
+
+        return addStage(new PipeStage(this, fn, Looper(nullptr), pool));
+    }
+
+    //------------------------------------------------------------------------//
+    Pipeline& Pipeline::addStage(PipeStage* stage)
+    {
+        if (mStarted)
+        {
+            LOGE("%s", "pipeline is running, stage can't be added");
+            delete stage;
+            return *this;
+        }
+
+        PipeLink* link = new PipeLink();
+        link->mConsumer = stage;
+        stage->mIn = link;
+        if (!mStages.empty())
+        {
+            mStages.back()->mOut = link;
+            link->mProducer = mStages.back();
+        }
+
+        mStages.push_back(stage);
+        mLinks.push_back(link);
+        return *this;
+    }
+
+    //------------------------------------------------------------------------//
+    bool Pipeline::start(void)
+    {
+        if (mStarted || mStages.empty())
+            return false;
+        if (mInvalid)
+        {
+            LOGE("%s", "a stage had no looper or pool, pipeline isn't started");
+            return false;
+        }
+
+        mStarted = true;
+        for (size_t i = 0; i < mStages.size(); i++)
+        {
+            PipeStage* stage = mStages[i];
+            if (stage->mLooper)
+                stage->mHandler = MsgHandler::createHandler(stage->mLooper, stage);
+        }
+
+        LOGD("pipeline of %d stages started", (int)mStages.size());
+        return true;
+    }
+
+    //------------------------------------------------------------------------//
+    bool Pipeline::push(void* item)
+    {
+        if (!mStarted || mStopped)
+            return false;
+
+        pushLink(mLinks[0], item, true);
+        wakeConsumer(mLinks[0]);
+        return true;
+    }
+
+    //------------------------------------------------------------------------//
+    bool Pipeline::tryPush(void* item)
+    {
+        if (!mStarted || mStopped || !pushLink(mLinks[0], item, false))
+            return false;
+
+        wakeConsumer(mLinks[0]);
+        return true;
+    }
+
+    //------------------------------------------------------------------------//
+    bool Pipeline::pushLink(PipeLink* link, void* item, bool block)
+    {
+        // only source pushes here, stages never wait for a ring
+        if (link->mRing.push(item))
+            return true;
+        if (!block)
+            return false;
+
+        // consumer must know about the full ring before producer waits for it
+        wakeConsumer(link);
+        link->mNotFull.wait(mWait, [link]() { return !link->mRing.isFull(); });
+        return link->mRing.push(item);   // the only producer, so there is room now
+    }
+
+    //------------------------------------------------------------------------//
+    void Pipeline::wakeConsumer(PipeLink* link)
+    {
+        // one drain at a time, it handles everything pushed before it runs
+        PipeStage* stage = link->mConsumer;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!stage->mScheduled.exchange(true))
+            postStage(stage);
+    }
+
+    //------------------------------------------------------------------------//
+    void Pipeline::postStage(PipeStage* stage)
+    {
+        if (stage->mPool)
+            stage->mPool->execute(std::function<void(void*)>(onPoolDrain), stage);
+        else
+            stage->mHandler->post(onLooperDrain);
+    }
+
+    //------------------------------------------------------------------------//
+    int Pipeline::drainStage(PipeStage* stage)
+    {
+        PipeLink* in = stage->mIn;
+        PipeLink* out = stage->mOut;
+        bool moved = false;
+        if (stage->mPending)
+        {
+            if (!out->mRing.push(stage->mPending))
+                return 0;
+            stage->mPending = nullptr;
+            moved = true;
+        }
+
+        int n = 0;
+        void* item = nullptr;
+        while (n < mBatch && in->mRing.pop(item))
+        {
+            void* result = stage->mFunc(item);
+            n++;
+            if (result == nullptr || out == nullptr)
+                continue;
+            if (!out->mRing.push(result))
+            {
+                stage->mPending = result;
+                break;
+            }
+            moved = true;
+        }
+
+        // neighbours are notified once per batch
+        if (n > 0)
+        {
+            stage->mCount.fetch_add(n, std::memory_order_relaxed);
+            in->mNotFull.notify();
+
+            // pairs with fence of parkStage(), either room is seen there or flag is seen here
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (in->mBlocked.load(std::memory_order_relaxed) && in->mBlocked.exchange(false))
+                postStage(in->mProducer);
+        }
+        if (moved)
+            wakeConsumer(out);
+
+        return n;
+    }
+
+    //------------------------------------------------------------------------//
+    bool Pipeline::parkStage(PipeStage* stage)
+    {
+        // stage stays scheduled while parked, consumer which takes items posts it again
+        PipeLink* out = stage->mOut;
+        out->mBlocked.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (out->mRing.isFull())
+        {
+            wakeConsumer(out);
+            return true;
+        }
+
+        // consumer took items meanwhile, whoever clears the flag posts the stage
+        return !out->mBlocked.exchange(false);
+    }
+
+    //------------------------------------------------------------------------//
+    void Pipeline::runStage(PipeStage* stage)
+    {
+        PipeLink* in = stage->mIn;
+        drainStage(stage);
+        if (stage->mPending)
+        {
+            if (!parkStage(stage))
+                postStage(stage);
+            return;
+        }
+
+        // closed is stored after the last push, so ring empty after it is final
+        bool closed = in->mClosed.load(std::memory_order_acquire);
+        if (in->mRing.isEmpty())
+        {
+            if (closed)
+            {
+                if (!stage->mFinished.load(std::memory_order_acquire))
+                    finishStage(stage);
+                return;
+            }
+
+            // producer which pushes after the check sees false and posts again
+            stage->mScheduled.store(false);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (in->mRing.isEmpty() && !in->mClosed.load(std::memory_order_acquire))
+                return;
+            if (stage->mScheduled.exchange(true))
+                return;
+        }
+
+        // rest of ring goes in next batch, other messages of looper or tasks of pool run
+        // between batches
+        postStage(stage);
+    }
+
+    //------------------------------------------------------------------------//
+    void Pipeline::finishStage(PipeStage* stage)
+    {
+        if (stage->mOut)
+        {
+            stage->mOut->mClosed.store(true, std::memory_order_release);
+            wakeConsumer(stage->mOut);
+        }
+
+        stage->mDone.notifyLast([stage]() { stage->mFinished = true; });
+    }
+
+    //------------------------------------------------------------------------//
+    void Pipeline::onLooperDrain(const Message& msg, void* context)
+    {
+        PipeStage* stage = static_cast<PipeStage*>(context);
+        stage->mOwner->runStage(stage);
+    }
+
+    //------------------------------------------------------------------------//
+    void Pipeline::onPoolDrain(void* context)
+    {
+        PipeStage* stage = static_cast<PipeStage*>(context);
+        stage->mOwner->runStage(stage);
+    }
+
+    //------------------------------------------------------------------------//
+    void Pipeline::onLooperFence(const Message& msg, void* context)
+    {
+        PipeStage* stage = static_cast<PipeStage*>(context);
+        stage->mDone.notifyLast([stage]() { stage->mFenced = true; });
+    }
+
+    //------------------------------------------------------------------------//
+    void Pipeline::stop(void)
+    {
+        if (!mStarted || mStopped)
+            return;
+
+        mStopped = true;
+        mLinks[0]->mClosed.store(true, std::memory_order_release);
+        wakeConsumer(mLinks[0]);
+
+        // close flows down stage by stage, each stage ends after its input is drained
+        for (size_t i = 0; i < mStages.size(); i++)
+        {
+            PipeStage* stage = mStages[i];
+            stage->mDone.waitLast([stage]() { return stage->mFinished.load(std::memory_order_acquire); });
+            if (stage->mPool)
+                continue;
+
+            // message which finished the stage may be still running, looper is in order
+            // so the fence runs after it
+            stage->mHandler->post(onLooperFence);
+            stage->mDone.waitLast([stage]() { return stage->mFenced.load(); });
+        }
+
+        LOGD("pipeline of %d stages stopped", (int)mStages.size());
+    }
+
+    //------------------------------------------------------------------------//
+    uint64 Pipeline::getProcessedCount(int stage) const
+    {
+        if (stage < 0 || stage >= (int)mStages.size())
+            return 0;
+
+        return mStages[stage]->mCount.load(std::memory_order_relaxed);
+    }
+
+__END__
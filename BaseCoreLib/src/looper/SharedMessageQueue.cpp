@@ -0,0 +1,817 @@
+/*****************************************************************************
+* FileName    : SharedMessageQueue.cpp
+* Description : Cross-process message queue in shared memory implemention
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#include "../../inc/looper/SharedMessageQueue.h"
+#include "../../inc/looper/MessageHandler.h"
+#include "../../inc/looper/MessageLooper.h"
+#include "../../inc/looper/MessageQueue.h"
+#include "../../inc/os/AutoMutex.hpp"
+#include "../../inc/os/Logger.h"
+#include "../../inc/base/TimeUtil.h"
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+   //------------------------------------------------------------------------//
+    #ifdef LOG_TAG
+        #undef LOG_TAG
+    #endif
+    #define LOG_TAG (SharedMessageQueue):
+
+    //------------------------------------------------------------------------//
+    #define SHARED_QUEUE_MAGIC      0x53514D42  // "BMQS"
+    #define SHARED_QUEUE_VERSION    3
+    #define CACHE_LINE_SIZE         64
+
+    // a head slot claimed but not published is checked at this interval, it is skipped
+    // only once the sender process that claimed it is gone
+    #define SHARED_STUCK_POLL_MSEC  10
+    #define NO_STUCK_POS            ((uint64)-1)
+
+    // a claim is low 40 bits of position, 16 bits of generation of sender entry and
+    // 8 bits of its index, written by one CAS so no slot is claimed by nobody
+    #define SHARED_MAX_SENDERS      64
+    #define CLAIM_POS_SHIFT         24
+    #define CLAIM_POS_MASK          ((1ULL << 40) - 1)
+    #define CLAIM_NONE              ((uint64)-1)
+    #define SENDER_GEN_MASK         0xFFFF
+    #define START_TIME_MASK         ((1ULL << 48) - 1)
+
+    // atomics in the segment are used by several processes, they must be lock free
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "shared queue needs lock free atomics");
+
+    // a sender process, pid is reused by system so start time is kept with it
+    struct SharedQueueSender
+    {
+        std::atomic<uint64> mId;        // generation << 32 | pid, pid 0 is free
+        std::atomic<uint64> mStartTime; // generation << 48 | start time in clock ticks since boot
+    };
+
+    struct SharedQueueHeader
+    {
+        uint32                                      mMagic;
+        uint32                                      mVersion;
+        uint32                                      mSlotCount;     // power of 2
+        uint32                                      mSlotBytes;     // slot stride, include param bytes
+        uint32                                      mMaxParamBytes;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64> mEnqueuePos;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64> mDequeuePos;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32> mFutex;        // bumped after every enqueue
+        std::atomic<uint32>                          mWaiters;
+        alignas(CACHE_LINE_SIZE) SharedQueueSender   mSenders[SHARED_MAX_SENDERS];
+    };
+
+    struct SharedQueueSlot
+    {
+        std::atomic<uint64> mSeq;
+        std::atomic<uint64> mClaim;     // position and sender which writes the slot
+        uint64              mWhen;      // absolute time of millisecond, 0 is immediately
+        int                 mWhat;
+        int                 mArg1;
+        int                 mArg2;
+        int                 mTarget;
+        uint32              mBytes;
+        char                mParam[1];
+    };
+
+    #define SHARED_HEADER_BYTES     ((sizeof(SharedQueueHeader) + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1))
+    #define SHARED_MAX_SLOT_COUNT   (1 << 30)
+
+    //------------------------------------------------------------------------//
+    // slots are a power of 2 of cache line strides which hold fields and param, and
+    // all of them lie in the segment
+    static bool validGeometry(uint32 slotCount, uint32 slotBytes, uint32 maxParamBytes, size_t segmentBytes)
+    {
+        if (slotCount <= 1 || slotCount > SHARED_MAX_SLOT_COUNT || (slotCount & (slotCount - 1)) != 0)
+            return false;
+
+        if (slotBytes % CACHE_LINE_SIZE != 0 || (size_t)slotBytes < offsetof(SharedQueueSlot, mParam) + (size_t)maxParamBytes)
+            return false;
+
+        if ((size_t)slotCount > (SIZE_MAX - SHARED_HEADER_BYTES) / slotBytes)
+            return false;
+
+        return SHARED_HEADER_BYTES + (size_t)slotCount * slotBytes <= segmentBytes;
+    }
+
+    //------------------------------------------------------------------------//
+    static void freeSharedParam(void* obj, size_t bytes)
+    {
+        free(obj);
+    }
+
+#if defined(__linux__)
+    //------------------------------------------------------------------------//
+    static long futexWait(std::atomic<uint32>* addr, uint32 val, long timeoutMillis)
+    {
+        struct timespec ts;
+        ts.tv_sec = timeoutMillis / PER_SEC_MSEC;
+        ts.tv_nsec = (timeoutMillis % PER_SEC_MSEC) * PER_SEC_USEC;
+        // shared futex (without FUTEX_PRIVATE_FLAG) because waker is in another process
+        return syscall(SYS_futex, (uint32*)addr, FUTEX_WAIT, val, timeoutMillis < 0 ? nullptr : &ts, nullptr, 0);
+    }
+
+    //------------------------------------------------------------------------//
+    static long futexWake(std::atomic<uint32>* addr, int count)
+    {
+        return syscall(SYS_futex, (uint32*)addr, FUTEX_WAKE, count, nullptr, nullptr, 0);
+    }
+
+    //------------------------------------------------------------------------//
+    // state and start time (field 22) of process, false if its stat isn't readable
+    static bool processStat(int pid, char& state, uint64& startTime)
+    {
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+        FILE* f = fopen(path, "r");
+        if (f == nullptr)
+            return false;
+
+        char buf[512];
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        fclose(f);
+        buf[n] = 0;
+
+        // command name may hold spaces and parentheses, fields follow its last ')'
+        char* p = strrchr(buf, ')');
+        unsigned long long start = 0;
+        if (p == nullptr || sscanf(p + 1, " %c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu", &state, &start) != 2)
+            return false;
+
+        startTime = start & START_TIME_MASK;
+        return true;
+    }
+
+    //------------------------------------------------------------------------//
+    // a zombie isn't reaped yet but it never publishes its slot either. Without
+    // readable /proc, a process that exists is taken for alive
+    static bool senderAlive(int pid, uint64 startTime)
+    {
+        if (kill(pid, 0) != 0 && errno == ESRCH)
+            return false;
+
+        char state = 0;
+        uint64 now = 0;
+        if (!processStat(pid, state, now))
+            return true;
+
+        return state != 'Z' && state != 'X' && now == startTime;
+    }
+
+    //------------------------------------------------------------------------//
+    // entry is alive while its process is, an entry whose start time isn't stored
+    // for its generation yet is being registered
+    static bool senderEntryAlive(const SharedQueueSender& e, uint64 id)
+    {
+        int pid = (int)(id & 0xFFFFFFFF);
+        if (pid == 0)
+            return false;
+
+        uint64 start = e.mStartTime.load(std::memory_order_acquire);
+        if ((start >> 48) != ((id >> 32) & SENDER_GEN_MASK))
+            return true;
+
+        return senderAlive(pid, start & START_TIME_MASK);
+    }
+
+    //------------------------------------------------------------------------//
+    // a forked child has its own pid, it registers again before it sends
+    static std::atomic<uint32> gForkGen(0);
+
+    static void onForkChild(void)
+    {
+        gForkGen.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void watchFork(void)
+    {
+        static bool watching = pthread_atfork(nullptr, nullptr, onForkChild) == 0;
+        (void)watching;
+    }
+#endif
+
+    //------------------------------------------------------------------------//
+    static uint64 makeClaim(uint64 pos, uint64 sender)
+    {
+        return ((pos & CLAIM_POS_MASK) << CLAIM_POS_SHIFT) | sender;
+    }
+
+    static bool claimedFor(uint64 claim, uint64 pos)
+    {
+        return (claim >> CLAIM_POS_SHIFT) == (pos & CLAIM_POS_MASK);
+    }
+
+    //------------------------------------------------------------------------//
+    SharedMsgQueue::SharedMsgQueue(int fd, void* addr, size_t bytes, bool owner)
+    : mFd(fd)
+    , mHeader(static_cast<SharedQueueHeader*>(addr))
+    , mBytes(bytes)
+    , mOwner(owner)
+    , mHandlersMutex()
+    , mHandlers()
+    , mReceiver(nullptr)
+    , mStuckPos(NO_STUCK_POS)
+    , mStuckSince(0)
+    , mSlotCount(mHeader->mSlotCount)
+    , mSlotBytes(mHeader->mSlotBytes)
+    , mMaxParamBytes(mHeader->mMaxParamBytes)
+    , mSenderMutex()
+    , mSenderId(0)
+    , mSenderClaim(0)
+    , mForkGen(0)
+    {
+    }
+
+    //------------------------------------------------------------------------//
+    SharedMsgQueue::~SharedMsgQueue(void)
+    {
+        stopReceiving();
+#if defined(__linux__)
+        // a forked child deleting its copy leaves the entry of parent alone
+        uint64 id = mSenderId;
+        if (mHeader && id && (int)(id & 0xFFFFFFFF) == (int)getpid())
+            mHeader->mSenders[mSenderClaim.load() & 0xFF].mId.compare_exchange_strong(id, id & ~0xFFFFFFFFULL);
+
+        if (mHeader)
+            munmap(mHeader, mBytes);
+        if (mFd >= 0)
+            close(mFd);
+#endif
+        mHeader = nullptr;
+        mFd = -1;
+        LOGD("%s", "Shared message queue been destroyed!");
+    }
+
+    //------------------------------------------------------------------------//
+    SharedMsgQueue* SharedMsgQueue::create(const char* name, int slotCount /* = 1024 */, int maxParamBytes /* = 256 */)
+    {
+#if defined(__linux__)
+        if (slotCount <= 1 || slotCount > SHARED_MAX_SLOT_COUNT || maxParamBytes < 0)
+        {
+            LOGE("%s", "slot count must larger than 1 and not too large, param bytes must not be negative");
+            return nullptr;
+        }
+
+        uint32 count = 1;
+        while (count < (uint32)slotCount)
+            count <<= 1;
+
+        uint32 slotBytes = (uint32)(offsetof(SharedQueueSlot, mParam) + maxParamBytes + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+        size_t bytes = SHARED_HEADER_BYTES + (size_t)slotBytes * count;
+        if (!validGeometry(count, slotBytes, maxParamBytes, bytes))
+        {
+            LOGE("%s", "slots of shared message queue are too large");
+            return nullptr;
+        }
+
+        int fd = name ? shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0600) : (int)syscall(SYS_memfd_create, "SharedMsgQueue", 0);
+        if (fd < 0)
+        {
+            LOGE("fail to create shared memory %s: %s", name ? name : "memfd", strerror(errno));
+            return nullptr;
+        }
+
+        if (ftruncate(fd, bytes) != 0)
+        {
+            LOGE("fail to resize shared memory: %s", strerror(errno));
+            close(fd);
+            return nullptr;
+        }
+
+        void* addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            LOGE("fail to map shared memory: %s", strerror(errno));
+            close(fd);
+            return nullptr;
+        }
+
+        SharedQueueHeader* h = new (addr) SharedQueueHeader();
+        h->mSlotCount = count;
+        h->mSlotBytes = slotBytes;
+        h->mMaxParamBytes = maxParamBytes;
+        h->mEnqueuePos.store(0, std::memory_order_relaxed);
+        h->mDequeuePos.store(0, std::memory_order_relaxed);
+        h->mFutex.store(0, std::memory_order_relaxed);
+        h->mWaiters.store(0, std::memory_order_relaxed);
+
+        SharedMsgQueue* q = new SharedMsgQueue(fd, addr, bytes, true);
+        for (uint32 i = 0; i < count; i++)
+        {
+            SharedQueueSlot* s = new (q->slotAt(i)) SharedQueueSlot();
+            s->mSeq.store(i, std::memory_order_relaxed);
+            s->mClaim.store(CLAIM_NONE, std::memory_order_relaxed);
+        }
+
+        // senders check magic at last, so they never see a half initialized queue
+        h->mVersion = SHARED_QUEUE_VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        h->mMagic = SHARED_QUEUE_MAGIC;
+
+        watchFork();
+        q->registerSender();
+        return q;
+#else
+        LOGE("%s", "shared message queue only support linux");
+        return nullptr;
+#endif
+    }
+
+    //------------------------------------------------------------------------//
+    SharedMsgQueue* SharedMsgQueue::open(const char* name)
+    {
+#if defined(__linux__)
+        int fd = shm_open(name, O_RDWR, 0600);
+        if (fd < 0)
+        {
+            LOGE("fail to open shared memory %s: %s", name, strerror(errno));
+            return nullptr;
+        }
+
+        return attach(fd);
+#else
+        LOGE("%s", "shared message queue only support linux");
+        return nullptr;
+#endif
+    }
+
+    //------------------------------------------------------------------------//
+    SharedMsgQueue* SharedMsgQueue::attach(int fd)
+    {
+#if defined(__linux__)
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)SHARED_HEADER_BYTES)
+        {
+            LOGE("%s", "shared memory is not a message queue");
+            close(fd);
+            return nullptr;
+        }
+
+        void* addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            LOGE("fail to map shared memory: %s", strerror(errno));
+            close(fd);
+            return nullptr;
+        }
+
+        SharedQueueHeader* h = static_cast<SharedQueueHeader*>(addr);
+        if (h->mMagic != SHARED_QUEUE_MAGIC || h->mVersion != SHARED_QUEUE_VERSION)
+        {
+            LOGE("%s", "shared memory is not a message queue or its version is different");
+            munmap(addr, st.st_size);
+            close(fd);
+            return nullptr;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // geometry is copied once and checked against the segment, ring is never
+        // indexed by values another process may change later
+        if (!validGeometry(h->mSlotCount, h->mSlotBytes, h->mMaxParamBytes, (size_t)st.st_size))
+        {
+            LOGE("%s", "geometry of shared message queue doesn't fit its segment");
+            munmap(addr, st.st_size);
+            close(fd);
+            return nullptr;
+        }
+
+        SharedMsgQueue* q = new SharedMsgQueue(fd, addr, st.st_size, false);
+        watchFork();
+        if (!q->registerSender())
+        {
+            delete q;
+            return nullptr;
+        }
+
+        return q;
+#else
+        LOGE("%s", "shared message queue only support linux");
+        return nullptr;
+#endif
+    }
+
+    //------------------------------------------------------------------------//
+    void SharedMsgQueue::unlink(const char* name)
+    {
+#if defined(__linux__)
+        shm_unlink(name);
+#endif
+    }
+
+    //------------------------------------------------------------------------//
+    int SharedMsgQueue::getMaxParamBytes(void) const
+    {
+        return mMaxParamBytes;
+    }
+
+    //------------------------------------------------------------------------//
+    SharedQueueSlot* SharedMsgQueue::slotAt(uint64 pos) const
+    {
+        char* base = reinterpret_cast<char*>(mHeader) + SHARED_HEADER_BYTES;
+        return reinterpret_cast<SharedQueueSlot*>(base + (pos & (mSlotCount - 1)) * mSlotBytes);
+    }
+
+    //------------------------------------------------------------------------//
+    bool SharedMsgQueue::sendMessage(Message msg, int target /* = 0 */)
+    {
+        return sendMessageDelayed(std::move(msg), 0, target);
+    }
+
+    //------------------------------------------------------------------------//
+    bool SharedMsgQueue::sendMessageDelayed(Message msg, long delayMillis, int target /* = 0 */)
+    {
+        if (msg.get() == nullptr)
+        {
+            LOGE("%s", "parameter of message is null");
+            return false;
+        }
+
+        uint64 when = delayMillis > 0 ? getNowTimeOfNs() / PER_SEC_USEC + delayMillis : 0;
+        // the message only lives in this process, it is freed with its param after copied
+        return enqueue(msg->mWhat, msg->mArg1, msg->mArg2, msg->getParam(), msg->ParamSize(), when, target);
+    }
+
+    //------------------------------------------------------------------------//
+    bool SharedMsgQueue::sendEmptyMessage(int what, int target /* = 0 */)
+    {
+        return enqueue(what, 0, 0, nullptr, 0, 0, target);
+    }
+
+    //------------------------------------------------------------------------//
+    bool SharedMsgQueue::sendEmptyMessage(int what, long delayMillis, int target /* = 0 */)
+    {
+        uint64 when = delayMillis > 0 ? getNowTimeOfNs() / PER_SEC_USEC + delayMillis : 0;
+        return enqueue(what, 0, 0, nullptr, 0, when, target);
+    }
+
+    //------------------------------------------------------------------------//
+    bool SharedMsgQueue::enqueue(int what, int arg1, int arg2, const void* param, size_t bytes, uint64 when, int target)
+    {
+        if (bytes > mMaxParamBytes || (bytes && param == nullptr))
+        {
+            LOGE("param of message is %zu bytes, the slot only holds %u bytes", bytes, mMaxParamBytes);
+            return false;
+        }
+
+#if defined(__linux__)
+        if (mForkGen.load(std::memory_order_relaxed) != gForkGen.load(std::memory_order_relaxed))
+        {
+            AutoMutex lock(&mSenderMutex);
+            if (mForkGen.load(std::memory_order_relaxed) != gForkGen.load(std::memory_order_relaxed) && !registerSender())
+                return false;
+        }
+#endif
+        uint64 sender = mSenderClaim.load(std::memory_order_relaxed);
+
+        // bounded MPMC ring: a slot is free for position pos when its sequence equals pos.
+        // Slot is claimed with its sender by one CAS, then position moves on
+        SharedQueueSlot* s;
+        uint64 pos = mHeader->mEnqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            s = slotAt(pos);
+            uint64 seq = s->mSeq.load(std::memory_order_acquire);
+            int64 diff = (int64)seq - (int64)pos;
+            if (diff == 0)
+            {
+                uint64 claim = s->mClaim.load(std::memory_order_acquire);
+                if (claimedFor(claim, pos))
+                {
+                    // claimed by another sender which hasn't moved position yet, help it
+                    mHeader->mEnqueuePos.compare_exchange_strong(pos, pos + 1, std::memory_order_relaxed);
+                    pos = mHeader->mEnqueuePos.load(std::memory_order_relaxed);
+                }
+                else if (s->mClaim.compare_exchange_strong(claim, makeClaim(pos, sender), std::memory_order_acq_rel))
+                {
+                    uint64 expected = pos;
+                    mHeader->mEnqueuePos.compare_exchange_strong(expected, pos + 1, std::memory_order_relaxed);
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                LOGD("%s", "shared message queue is full");
+                return false;
+            }
+            else
+                pos = mHeader->mEnqueuePos.load(std::memory_order_relaxed);
+        }
+
+        s->mWhen = when;
+        s->mWhat = what;
+        s->mArg1 = arg1;
+        s->mArg2 = arg2;
+        s->mTarget = target;
+        s->mBytes = (uint32)bytes;
+        if (bytes)
+            memcpy(s->mParam, param, bytes);
+
+        // receiver skips a claimed slot only when its sender is gone, so it is still
+        // ours unless this process was taken for dead, then message is dropped
+        uint64 expected = pos;
+        if (s->mClaim.load(std::memory_order_relaxed) != makeClaim(pos, sender)
+            || !s->mSeq.compare_exchange_strong(expected, pos + 1, std::memory_order_release, std::memory_order_relaxed))
+        {
+            LOGW("slot of shared message queue was taken back before it was published, drop message what = %d", what);
+            return false;
+        }
+
+        // receiver reads futex value before checking queue, so a bump here either
+        // makes its futex wait return at once or the message is already seen
+        mHeader->mFutex.fetch_add(1, std::memory_order_seq_cst);
+#if defined(__linux__)
+        if (mHeader->mWaiters.load(std::memory_order_seq_cst) > 0)
+            futexWake(&mHeader->mFutex, 1);
+#endif
+        return true;
+    }
+
+    //------------------------------------------------------------------------//
+    bool SharedMsgQueue::headReady(void)
+    {
+        for (;;)
+        {
+            uint64 pos = mHeader->mDequeuePos.load(std::memory_order_relaxed);
+            SharedQueueSlot* s = slotAt(pos);
+            uint64 seq = s->mSeq.load(std::memory_order_acquire);
+            if (seq != pos || !claimedFor(s->mClaim.load(std::memory_order_acquire), pos))
+            {
+                // published, or slot is free as nothing was claimed after the head
+                mStuckPos = NO_STUCK_POS;
+                return seq == pos + 1;
+            }
+
+            // claimed but not published, sender is writing it or died on the way
+            uint64 now = getNowTimeOfNs() / PER_SEC_USEC;
+            if (mStuckPos != pos)
+            {
+                mStuckPos = pos;
+                mStuckSince = now;
+                return false;
+            }
+
+            if (now - mStuckSince < SHARED_STUCK_POLL_MSEC)
+                return false;
+            mStuckSince = now;
+
+#if defined(__linux__)
+            if (claimAlive(s->mClaim.load(std::memory_order_acquire)))
+                return false;
+
+            // position may not have moved past a sender that died right after claiming
+            uint64 expected = pos;
+            mHeader->mEnqueuePos.compare_exchange_strong(expected, pos + 1, std::memory_order_relaxed);
+
+            expected = pos;
+            if (s->mSeq.compare_exchange_strong(expected, pos + mSlotCount, std::memory_order_acq_rel))
+            {
+                LOGW("sender of slot %llu died before publishing it, skip the slot", (unsigned long long)pos);
+                mHeader->mDequeuePos.store(pos + 1, std::memory_order_relaxed);
+            }
+            mStuckPos = NO_STUCK_POS;
+#else
+            return false;
+#endif
+        }
+    }
+
+#if defined(__linux__)
+   //------------------------------------------------------------------------//
+    bool SharedMsgQueue::registerSender(void)
+    {
+        uint64 start = 0;
+        char state = 0;
+        int pid = (int)getpid();
+        processStat(pid, state, start);
+
+        // take a free entry, or one whose process is gone, generation tells claims
+        // of its old owner from those of the new one
+        for (uint32 i = 0; i < SHARED_MAX_SENDERS; i++)
+        {
+            SharedQueueSender& e = mHeader->mSenders[i];
+            uint64 id = e.mId.load(std::memory_order_acquire);
+            if (senderEntryAlive(e, id))
+                continue;
+
+            uint64 gen = ((id >> 32) + 1) & SENDER_GEN_MASK;
+            uint64 mine = (gen << 32) | (uint32)pid;
+            if (!e.mId.compare_exchange_strong(id, mine, std::memory_order_acq_rel))
+                continue;
+
+            e.mStartTime.store((gen << 48) | start, std::memory_order_release);
+            mSenderId = mine;
+            mSenderClaim.store((gen << 8) | i, std::memory_order_relaxed);
+            mForkGen.store(gForkGen.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return true;
+        }
+
+        LOGE("more than %d processes send to shared message queue", SHARED_MAX_SENDERS);
+        return false;
+    }
+
+   //------------------------------------------------------------------------//
+    bool SharedMsgQueue::claimAlive(uint64 claim) const
+    {
+        uint32 index = claim & 0xFF;
+        if (index >= SHARED_MAX_SENDERS)
+            return false;
+
+        // entry released or taken by another process since the claim
+        const SharedQueueSender& e = mHeader->mSenders[index];
+        uint64 id = e.mId.load(std::memory_order_acquire);
+        if (((id >> 32) & SENDER_GEN_MASK) != ((claim >> 8) & SENDER_GEN_MASK))
+            return false;
+
+        return senderEntryAlive(e, id);
+    }
+#endif
+
+   //------------------------------------------------------------------------//
+    bool SharedMsgQueue::dequeue(Message& msg, int& target)
+    {
+        while (headReady())
+        {
+            // only one receiver, so the position needs no CAS
+            uint64 pos = mHeader->mDequeuePos.load(std::memory_order_relaxed);
+            SharedQueueSlot* s = slotAt(pos);
+            mHeader->mDequeuePos.store(pos + 1, std::memory_order_relaxed);
+
+            // size is read once, a sender can't make the copy run past the slot
+            uint32 bytes = s->mBytes;
+            if (bytes > mMaxParamBytes)
+            {
+                LOGW("slot %llu holds %u param bytes, more than %u, drop it", (unsigned long long)pos, bytes, mMaxParamBytes);
+                s->mSeq.store(pos + mSlotCount, std::memory_order_release);
+                continue;
+            }
+
+            void* param = nullptr;
+            if (bytes)
+            {
+                param = malloc(bytes);
+                memcpy(param, s->mParam, bytes);
+            }
+            msg = Msg::obtain(s->mWhat, s->mArg1, s->mArg2, param, bytes, param ? freeSharedParam : nullptr);
+            msg->mWhen = s->mWhen;
+            target = s->mTarget;
+
+            s->mSeq.store(pos + mSlotCount, std::memory_order_release);
+            return true;
+        }
+
+        return false;
+    }
+
+   //------------------------------------------------------------------------//
+    int SharedMsgQueue::takeMessages(std::vector<Message>& messages, int maxCount)
+    {
+        // handlers are looked up under one lock for the batch, unbound ones are
+        // released outside of it so a handler never dies under the queue lock
+        AutoMutex lock(&mHandlersMutex);
+
+        int n = 0;
+        Message msg(nullptr);
+        int target = 0;
+        while (n < maxCount && dequeue(msg, target))
+        {
+            std::map<int, Handler>::iterator it = mHandlers.find(target);
+            if (it == mHandlers.end() || it->second.get() == nullptr)
+            {
+                LOGW("no handler bound with target %d, drop message what = %d", target, msg->mWhat);
+                continue;
+            }
+
+            msg->mTarget = it->second.get();
+            messages.push_back(std::move(msg));
+            n++;
+        }
+
+        return n;
+    }
+
+   //------------------------------------------------------------------------//
+    void SharedMsgQueue::waitMessage(Mutex* lock, long timeoutMillis)
+    {
+#if defined(__linux__)
+        // futex value is read before checking ring, so a later publish or a local
+        // wake() under the lock makes the wait return at once
+        uint32 futexVal = mHeader->mFutex.load(std::memory_order_seq_cst);
+        if (timeoutMillis == 0 || headReady())
+            return;
+
+        // head is stuck, keep checking whether its sender is alive
+        if (mStuckPos != NO_STUCK_POS && (timeoutMillis < 0 || timeoutMillis > SHARED_STUCK_POLL_MSEC))
+            timeoutMillis = SHARED_STUCK_POLL_MSEC;
+
+        mHeader->mWaiters.fetch_add(1, std::memory_order_seq_cst);
+        lock->unlock();
+        futexWait(&mHeader->mFutex, futexVal, timeoutMillis);
+        lock->lock();
+        mHeader->mWaiters.fetch_sub(1, std::memory_order_seq_cst);
+#endif
+    }
+
+   //------------------------------------------------------------------------//
+    void SharedMsgQueue::wake(void)
+    {
+        mHeader->mFutex.fetch_add(1, std::memory_order_seq_cst);
+#if defined(__linux__)
+        if (mHeader->mWaiters.load(std::memory_order_seq_cst) > 0)
+            futexWake(&mHeader->mFutex, 1);
+#endif
+    }
+
+   //------------------------------------------------------------------------//
+    void SharedMsgQueue::bindHandler(const Handler& h, int target /* = 0 */)
+    {
+        Handler old(h);
+        {
+            AutoMutex lock(&mHandlersMutex);
+            mHandlers[target].swap(old);
+        }
+    }
+
+   //------------------------------------------------------------------------//
+    void SharedMsgQueue::unbindHandler(int target /* = 0 */)
+    {
+        Handler old(nullptr);
+        {
+            AutoMutex lock(&mHandlersMutex);
+            std::map<int, Handler>::iterator it = mHandlers.find(target);
+            if (it == mHandlers.end())
+                return;
+            old.swap(it->second);
+            mHandlers.erase(it);
+        }
+    }
+
+   //------------------------------------------------------------------------//
+    bool SharedMsgQueue::startReceiving(const Looper& looper)
+    {
+        if (!mOwner)
+        {
+            LOGE("%s", "only the process that created the queue could receive");
+            return false;
+        }
+
+        if (looper.get() == nullptr)
+        {
+            LOGE("%s", "looper is null, couldn't receive");
+            return false;
+        }
+
+        const Queue& queue = looper->getMsgQueue();
+        if (mReceiver)
+        {
+            if (mReceiver == queue)
+                return true;
+            LOGE("%s", "shared message queue is received by another looper");
+            return false;
+        }
+
+        if (!queue->attachShared(this))
+            return false;
+
+        mReceiver = queue;
+        return true;
+    }
+
+   //------------------------------------------------------------------------//
+    void SharedMsgQueue::stopReceiving(void)
+    {
+        if (mReceiver.get() == nullptr)
+            return;
+
+        // it returns after looper left the futex, so the ring may be unmapped then
+        mReceiver->detachShared(this);
+        mReceiver.reset();
+    }
+
+   //------------------------------------------------------------------------//
+    int SharedMsgQueue::getQueueSize(void) const
+    {
+        return (int)(mHeader->mEnqueuePos.load(std::memory_order_relaxed) - mHeader->mDequeuePos.load(std::memory_order_relaxed));
+    }
+
+__END__
@@ -0,0 +1,266 @@
+/*****************************************************************************
+* FileName    : Buffer.cpp
+* Description : Reference counted buffer implemention
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#include "../../inc/os/Buffer.h"
+#include "../../inc/os/AutoMutex.hpp"
+#include "../../inc/os/Logger.h"
+#include <new>
+#include <stdlib.h>
+
+//---------------------------------------------------------------------------//
+__BEGIN__
+
+   //------------------------------------------------------------------------//
+    #ifdef LOG_TAG
+        #undef LOG_TAG
+    #endif
+    #define LOG_TAG (Buffer):
+
+    //------------------------------------------------------------------------//
+    // shared by pool and its buffers, the last of them frees it
+    struct BufferPoolCore
+    {
+        Mutex               mMutex;
+        Buffer*             mFree;      // cached buffers linked through their bytes
+        int                 mCached;
+        int                 mMaxCached;
+        size_t              mBlockSize;
+        bool                mClosed;
+        std::atomic<int>    mRefs;      // pool itself and every live buffer
+
+        BufferPoolCore(size_t blockSize, int maxCached)
+        : mMutex(), mFree(nullptr), mCached(0), mMaxCached(maxCached), mBlockSize(blockSize), mClosed(false), mRefs(1) { }
+
+        void release(void)
+        {
+            if (mRefs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete this;
+        }
+    };
+
+    //------------------------------------------------------------------------//
+    Buffer::Buffer(size_t capacity, BufferPoolCore* pool)
+    : mRefs(1)
+    , mCapacity(capacity)
+    , mPool(pool)
+    {
+    }
+
+    //------------------------------------------------------------------------//
+    BufferRef Buffer::create(size_t capacity)
+    {
+        return BufferRef(alloc(capacity, nullptr), 0, 0);
+    }
+
+    //------------------------------------------------------------------------//
+    Buffer* Buffer::alloc(size_t capacity, BufferPoolCore* pool)
+    {
+        void* p = malloc(Buffer::headerSize() + capacity);
+        if (p == nullptr)
+        {
+            LOGE("out of memory, buffer of %llu bytes can't be created", (unsigned long long)capacity);
+            return nullptr;
+        }
+
+        return new (p) Buffer(capacity, pool);
+    }
+
+    //------------------------------------------------------------------------//
+    void Buffer::release(void)
+    {
+        if (mRefs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        BufferPoolCore* pool = mPool;
+        if (pool)
+        {
+            AutoMutex lock(&pool->mMutex);
+            if (!pool->mClosed && pool->mCached < pool->mMaxCached)
+            {
+                *(Buffer**)data() = pool->mFree;
+                pool->mFree = this;
+                pool->mCached++;
+                return;     // reference of pool core is kept by cached buffer
+            }
+        }
+
+        this->~Buffer();
+        free(this);
+        if (pool)
+            pool->release();
+    }
+
+    //------------------------------------------------------------------------//
+    BufferRef::BufferRef(const BufferRef& other)
+    : mBuffer(other.mBuffer)
+    , mOffset(other.mOffset)
+    , mSize(other.mSize)
+    {
+        if (mBuffer)
+            mBuffer->addRef();
+    }
+
+    //------------------------------------------------------------------------//
+    BufferRef::BufferRef(BufferRef&& other) noexcept
+    : mBuffer(other.mBuffer)
+    , mOffset(other.mOffset)
+    , mSize(other.mSize)
+    {
+        other.mBuffer = nullptr;
+        other.mOffset = 0;
+        other.mSize = 0;
+    }
+
+    //------------------------------------------------------------------------//
+    BufferRef& BufferRef::operator =(const BufferRef& other)
+    {
+        if (this != &other)
+        {
+            if (other.mBuffer)
+                other.mBuffer->addRef();
+            reset();
+            mBuffer = other.mBuffer;
+            mOffset = other.mOffset;
+            mSize = other.mSize;
+        }
+
+        return *this;
+    }
+
+    //------------------------------------------------------------------------//
+    BufferRef& BufferRef::operator =(BufferRef&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            mBuffer = other.mBuffer;
+            mOffset = other.mOffset;
+            mSize = other.mSize;
+            other.mBuffer = nullptr;
+            other.mOffset = 0;
+            other.mSize = 0;
+        }
+
+        return *this;
+    }
+
+    //------------------------------------------------------------------------//
+    bool BufferRef::setSize(size_t size)
+    {
+        if (size > capacity())
+        {
+            LOGE("size %llu is out of capacity %llu of buffer", (unsigned long long)size, (unsigned long long)capacity());
+            return false;
+        }
+
+        mSize = size;
+        return true;
+    }
+
+    //------------------------------------------------------------------------//
+    BufferRef BufferRef::slice(size_t offset, size_t length) const
+    {
+        if (mBuffer == nullptr || offset > mSize || length > mSize - offset)
+        {
+            LOGE("%s", "slice is out of buffer");
+            return BufferRef();
+        }
+
+        mBuffer->addRef();
+        return BufferRef(mBuffer, mOffset + offset, length);
+    }
+
+    //------------------------------------------------------------------------//
+    bool BufferRef::isUnique(void) const
+    {
+        return mBuffer && mBuffer->mRefs.load(std::memory_order_acquire) == 1;
+    }
+
+    //------------------------------------------------------------------------//
+    void BufferRef::reset(void)
+    {
+        if (mBuffer)
+            mBuffer->release();
+
+        mBuffer = nullptr;
+        mOffset = 0;
+        mSize = 0;
+    }
+
+    //------------------------------------------------------------------------//
+    BufferPool::BufferPool(size_t blockSize, int maxCached /* = 64 */)
+    : mCore(new BufferPoolCore(blockSize > sizeof(void*) ? blockSize : sizeof(void*), maxCached))
+    {
+    }
+
+    //------------------------------------------------------------------------//
+    BufferPool::~BufferPool(void)
+    {
+        Buffer* list = nullptr;
+        {
+            AutoMutex lock(&mCore->mMutex);
+            mCore->mClosed = true;
+            list = mCore->mFree;
+            mCore->mFree = nullptr;
+            mCore->mCached = 0;
+        }
+
+        while (list)
+        {
+            Buffer* b = list;
+            list = *(Buffer**)b->data();
+            b->~Buffer();
+            free(b);
+            mCore->release();
+        }
+
+        // buffers still in use free themselves and release the core at last
+        mCore->release();
+        mCore = nullptr;
+    }
+
+    //------------------------------------------------------------------------//
+    BufferRef BufferPool::obtain(size_t bytes /* = 0 */)
+    {
+        if (bytes > mCore->mBlockSize)
+            return Buffer::create(bytes);
+
+        {
+            AutoMutex lock(&mCore->mMutex);
+            Buffer* b = mCore->mFree;
+            if (b)
+            {
+                mCore->mFree = *(Buffer**)b->data();
+                mCore->mCached--;
+                b->mRefs.store(1, std::memory_order_relaxed);
+                return BufferRef(b, 0, 0);
+            }
+        }
+
+        Buffer* b = Buffer::alloc(mCore->mBlockSize, mCore);
+        if (b == nullptr)
+            return BufferRef();
+
+        mCore->mRefs.fetch_add(1, std::memory_order_relaxed);
+        return BufferRef(b, 0, 0);
+    }
+
+    //------------------------------------------------------------------------//
+    size_t BufferPool::getBlockSize(void) const
+    {
+        return mCore->mBlockSize;
+    }
+
+    //------------------------------------------------------------------------//
+    int BufferPool::getCachedCount(void) const
+    {
+        AutoMutex lock(&mCore->mMutex);
+        return mCore->mCached;
+    }
+
+__END__
@@ -25,6 +25,7 @@
 #include <dirent.h>
 #endif
 #include <stdarg.h>
+#include <string.h>
 #include <assert.h>
 
 //---------------------------------------------------------------------------//
@@ -641,6 +642,67 @@ __BEGIN__
         return nullptr;
     }
 
+    //-----------------------------------------------------------------------//
+    uint64 FileUtil::readFile(const char* filePath, BufferRef& buffer, BufferPool* pool /* = nullptr */)
+    {
+        buffer.reset();
+        int64 len = FileUtil::getFileSize(filePath);
+        if (len <= 0)
+        {
+            return 0;
+        }
+        FILE* file = nullptr;
+        #if (defined(_WIN32) || defined(_WIN64) || defined(__CYGWIN__))
+            fopen_s(&file, filePath, "rb");
+        #else
+            file = ::fopen(filePath, "rb");
+        #endif
+        if (!file)
+        {
+            return 0;
+        }
+        buffer = pool ? pool->obtain((size_t)len) : Buffer::create((size_t)len);
+        if (buffer.isValid())
+        {
+            buffer.setSize(::fread(buffer.data(), 1, (size_t)len, file));
+        }
+        ::fclose(file);
+        return buffer.size();
+    }
+
+    //-----------------------------------------------------------------------//
+    uint64 FileUtil::readFile(File* file, BufferRef& buffer, BufferPool* pool /* = nullptr */)
+    {
+        buffer.reset();
+        if (!file)
+        {
+            return 0;
+        }
+        long len = file->size();
+        if (len <= 0)
+        {
+            return 0;
+        }
+        buffer = pool ? pool->obtain((size_t)len) : Buffer::create((size_t)len);
+        if (!buffer.isValid())
+        {
+            return 0;
+        }
+        // from current read position to end, file may be read partly before
+        size_t total = 0;
+        while (total < (size_t)len && !file->eof())
+        {
+            size_t size = file->fread(buffer.data() + total, 1, (long)((size_t)len - total));
+            if (size == 0)
+            {
+                break;
+            }
+            total += size;
+        }
+        buffer.setSize(total);
+        return total;
+    }
+
     //-----------------------------------------------------------------------//
     bool FileUtil::saveFile(const char* filePath, void* data, uint64 size)
     {
@@ -698,7 +760,7 @@ __BEGIN__
         char absolutePath[500];
         if ((dir = opendir(dirPath)) == nullptr)
         {
-            OS_TRACE_ERROR("no exit: %s\n", dirPath);
+            LOGE("no exit: %s\n", dirPath);
             return false;
         }
         int typeSize = type ? ::strlen(type) : 0, len;
@@ -726,7 +788,7 @@ __BEGIN__
                         //                            files.push_back(ptr->d_name);
                         files.push_back(absolutePath);
                         //                            OS_TRACE_DEBUG("file = %s\n", ptr->d_name);
-                        OS_TRACE_DEBUG("push_back, ptr->d_name = %s,file absolutePath = %s",
+                        LOGD("push_back, ptr->d_name = %s,file absolutePath = %s",
                                        ptr->d_name, absolutePath);
                     }
                 }
@@ -737,7 +799,7 @@ __BEGIN__
                 strcpy(absolutePath, dirPath);
                 strcat(absolutePath, "/");
                 strcat(absolutePath, ptr->d_name);
-                OS_TRACE_DEBUG("ptr->d_name = %s,dir absolutePath = %s", ptr->d_name, absolutePath);
+                LOGD("ptr->d_name = %s,dir absolutePath = %s", ptr->d_name, absolutePath);
                 getAllFiles(absolutePath, files, type);
             }
         }
@@ -266,7 +266,7 @@ __BEGIN__
                 }
                 else
                 {
-                    len = ::strlen(ptr->d_name);
+                    size_t len = ::strlen(ptr->d_name);
                     if ((len > typeSize) && (0 == ::strcmp(type, ptr->d_name + (len - typeSize))))
                     {
 
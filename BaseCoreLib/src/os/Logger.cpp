@@ -11,6 +11,7 @@
 #include "../../thirdparty/spdlog-1.x/include/spdlog/spdlog.h"
 #include "../../thirdparty/spdlog-1.x/include/spdlog/sinks/stdout_color_sinks.h"
 #include <assert.h>
+#include <stdarg.h>
 
 //---------------------------------------------------------------------------//
 __BEGIN__
@@ -275,7 +275,7 @@ __BEGIN__
         {
             pthread_detach(mHandle);
             mHandle = 0;
-            mIsNotAttach = false;
+            mIsAttached = false;
         }
     }
     
@@ -35,6 +35,7 @@ __BEGIN__
         }
 
         mHandler = MsgHandler::createHandler();
+        mHandler->on(TIMER_MESSAGE, onTimerTaskFuncHandler);
         mLoop->loop();
     }
     
@@ -59,27 +60,17 @@ __BEGIN__
     
         Message msg = Msg::obtain(what, arg1, arg2, data, bytes, fnFree, mHandler);
         mHandler->sendMessageDelayed(std::move(msg), timeout);
-        mHandler->setMsgHandlerFunc(onTimerTaskFuncHandler);
     }
     
     //-----------------------------------------------------------------------//
     void onTimerTaskFuncHandler(const Message& msg, void* context)
     {
-        switch (msg->mWhat)
+        // only TIMER_MESSAGE is routed here, see MsgHandler::on()
+        void *p = msg->getParam();
+        if (p)
         {
-            case TIMER_MESSAGE:
-            {
-                void *p = msg->getParam();
-                if (p)
-                {
-                    TimerTaskFunc *timerTask = (TimerTaskFunc *)p;
-                    timerTask->onResponse();
-                }
-            }
-            break;
-    
-            default:
-            break;
+            TimerTaskFunc *timerTask = (TimerTaskFunc *)p;
+            timerTask->onResponse();
         }
     }
 
@@ -0,0 +1,147 @@
+#include "test_common.h"
+#include "inc/looper/Actor.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+#define MSG_DATA        1
+#define MSG_GATE        2
+
+#define TELLERS         4
+#define PER_TELLER      5000
+
+static std::atomic<int> gReceived(0);
+static std::atomic<int> gOutOfOrder(0);
+static std::atomic<int> gDeleted(0);
+static std::atomic<bool> gInGate(false);
+static std::atomic<bool> gGateOpen(false);
+
+class CountActor : public Actor
+{
+    public:
+        CountActor(void) { for (int i = 0; i < TELLERS; i++) mLast[i] = -1; }
+
+        ~CountActor(void) { gDeleted++; }
+
+        void onReceive(const Message& msg)
+        {
+            if (msg->mWhat == MSG_GATE)
+            {
+                gInGate = true;
+                while (!gGateOpen.load())
+                    usleep(1000);
+                return;
+            }
+
+            // state of actor needs no lock, one message at a time
+            if (msg->mArg2 != mLast[msg->mArg1] + 1)
+                gOutOfOrder++;
+            mLast[msg->mArg1] = msg->mArg2;
+            gReceived++;
+        }
+
+    private:
+        int mLast[TELLERS];
+};
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// messages of every teller come in order, stopped actor is deleted after them
+static void testOrder(void)
+{
+    ActorSystem system(2);
+    Actor* actor = system.spawn(new CountActor());
+    TEST_CHECK(actor != nullptr);
+    TEST_CHECK_EQ(system.getActorCount(), 1);
+    gReceived = 0;
+    gOutOfOrder = 0;
+    gDeleted = 0;
+
+    std::vector<std::thread> tellers;
+    for (int t = 0; t < TELLERS; t++)
+        tellers.push_back(std::thread([actor, t]() {
+            for (int i = 0; i < PER_TELLER; i++)
+                actor->tell(MSG_DATA, t, i);
+        }));
+    for (size_t t = 0; t < tellers.size(); t++)
+        tellers[t].join();
+
+    system.stop(actor);
+    TEST_CHECK(waitUntil([]() { return gDeleted.load() == 1; }, 2000));
+    TEST_CHECK_EQ(gReceived.load(), TELLERS * PER_TELLER);
+    TEST_CHECK_EQ(gOutOfOrder.load(), 0);
+    TEST_CHECK_EQ(system.getActorCount(), 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// tellers race with stop() while looper is held in a gate, every accepted message is
+// handled, later ones fail and actor is deleted only after gate
+static void testStopRace(void)
+{
+    ActorSystem system(1);
+    Actor* actor = system.spawn(new CountActor());
+    gReceived = 0;
+    gOutOfOrder = 0;
+    gDeleted = 0;
+    gInGate = false;
+    gGateOpen = false;
+
+    actor->tell(MSG_GATE);
+    TEST_CHECK(waitUntil([]() { return gInGate.load(); }, 2000));
+
+    std::atomic<int> accepted(0);
+    std::vector<std::thread> tellers;
+    for (int t = 0; t < TELLERS; t++)
+        tellers.push_back(std::thread([actor, t, &accepted]() {
+            for (int i = 0; ; i++)
+            {
+                if (!actor->tell(MSG_DATA, t, i))
+                    break;
+                accepted++;
+            }
+        }));
+
+    usleep(5 * 1000);
+    system.stop(actor);
+    system.stop(actor);
+    for (size_t t = 0; t < tellers.size(); t++)
+        tellers[t].join();
+
+    TEST_CHECK(!actor->tell(MSG_DATA, 0, 0));
+    TEST_CHECK_EQ(gDeleted.load(), 0);
+    TEST_CHECK(accepted.load() > 0);
+
+    gGateOpen = true;
+    TEST_CHECK(waitUntil([]() { return gDeleted.load() == 1; }, 5000));
+    TEST_CHECK_EQ(gReceived.load(), accepted.load());
+    TEST_CHECK_EQ(gOutOfOrder.load(), 0);
+    TEST_CHECK_EQ(system.getActorCount(), 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// actors not stopped are deleted with their system
+static void testSystemDeletes(void)
+{
+    gDeleted = 0;
+    {
+        ActorSystem system(2);
+        for (int i = 0; i < 10; i++)
+        {
+            Actor* actor = system.spawn(new CountActor());
+            actor->tell(MSG_DATA, 0, 0);
+        }
+        TEST_CHECK_EQ(system.getActorCount(), 10);
+    }
+    TEST_CHECK_EQ(gDeleted.load(), 10);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testOrder();
+    testStopRace();
+    testSystemDeletes();
+    return testResult("test_actor");
+}
@@ -0,0 +1,143 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/os/Buffer.h"
+#include <atomic>
+#include <string.h>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static std::atomic<bool> gDispatched(false);
+static std::atomic<int> gBad(0);
+static const char* gSentData = nullptr;
+static BufferRef gKept;
+
+// handler keeps a reference of buffer after its message is recycled
+static void onBuffer(const Message& msg, void* context)
+{
+    BufferRef b = msg->getBuffer();
+    if (!b.isValid() || b.data() != gSentData || msg->getParam() != gSentData || msg->ParamSize() != 5
+        || memcmp(b.data(), "world", 5) != 0)
+        gBad++;
+    gKept = b;
+    gDispatched = true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// copies share one count, slices share bytes and keep buffer alive
+static void testRefs(void)
+{
+    BufferRef a = Buffer::create(64);
+    TEST_CHECK(a.isValid());
+    TEST_CHECK(a.isUnique());
+    TEST_CHECK_EQ(a.size(), 0);
+    TEST_CHECK(a.capacity() >= 64);
+    TEST_CHECK(!a.setSize(a.capacity() + 1));
+    TEST_CHECK(a.setSize(11));
+    memcpy(a.data(), "hello world", 11);
+
+    BufferRef copy = a;
+    TEST_CHECK(!a.isUnique());
+    TEST_CHECK(copy.data() == a.data());
+    copy.reset();
+    TEST_CHECK(!copy.isValid());
+    TEST_CHECK(a.isUnique());
+
+    BufferRef s = a.slice(6, 5);
+    TEST_CHECK(s.isValid());
+    TEST_CHECK(s.data() == a.data() + 6);
+    TEST_CHECK_EQ(s.size(), 5);
+    TEST_CHECK(!a.slice(6, 6).isValid());
+    TEST_CHECK(!a.slice(12, 0).isValid());
+
+    // slice alone holds the bytes now
+    a.reset();
+    TEST_CHECK(s.isUnique());
+    TEST_CHECK(memcmp(s.data(), "world", 5) == 0);
+
+    BufferRef moved = std::move(s);
+    TEST_CHECK(!s.isValid());
+    TEST_CHECK(moved.isUnique());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// released buffers go back to pool up to its limit, a bigger one and those released after
+// pool is gone are freed
+static void testPool(void)
+{
+    BufferPool* pool = new BufferPool(256, 2);
+    TEST_CHECK_EQ(pool->getCachedCount(), 0);
+
+    BufferRef a = pool->obtain();
+    BufferRef b = pool->obtain(100);
+    BufferRef c = pool->obtain();
+    BufferRef big = pool->obtain(1024);
+    TEST_CHECK(a.capacity() >= 256 && b.capacity() >= 256);
+    TEST_CHECK(big.capacity() >= 1024);
+
+    char* first = a.data();
+    a.reset();
+    TEST_CHECK_EQ(pool->getCachedCount(), 1);
+    big.reset();
+    TEST_CHECK_EQ(pool->getCachedCount(), 1);
+    b.reset();
+    c.reset();
+    TEST_CHECK_EQ(pool->getCachedCount(), 2);
+
+    // cached block is reused, list is last released first
+    BufferRef again = pool->obtain();
+    BufferRef again2 = pool->obtain();
+    TEST_CHECK(again.data() == first || again2.data() == first);
+    TEST_CHECK_EQ(pool->getCachedCount(), 0);
+    TEST_CHECK(again.isUnique() && again.size() == 0);
+
+    delete pool;
+    again.reset();
+    again2.reset();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// message carries a slice to another looper without copying, buffer goes back to pool
+// only after both message and handler let it go
+static void testMessage(void)
+{
+    LooperThread thread("buffer");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onBuffer, nullptr);
+    BufferPool pool(256, 4);
+
+    {
+        BufferRef b = pool.obtain();
+        b.setSize(11);
+        memcpy(b.data(), "hello world", 11);
+        BufferRef s = b.slice(6, 5);
+        gSentData = s.data();
+
+        Message msg = Msg::obtain(1, h);
+        msg->setBuffer(std::move(s));
+        TEST_CHECK(!s.isValid());
+        TEST_CHECK(!b.isUnique());
+        h->sendMessage(std::move(msg));
+    }
+
+    TEST_CHECK(waitUntil([]() { return gDispatched.load(); }, 2000));
+    TEST_CHECK_EQ(gBad.load(), 0);
+    usleep(20 * 1000);
+    TEST_CHECK_EQ(pool.getCachedCount(), 0);
+    TEST_CHECK(gKept.isUnique());
+    TEST_CHECK(memcmp(gKept.data(), "world", 5) == 0);
+
+    gKept.reset();
+    TEST_CHECK_EQ(pool.getCachedCount(), 1);
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testRefs();
+    testPool();
+    testMessage();
+    return testResult("test_buffer");
+}
@@ -0,0 +1,104 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/MessageQueue.h"
+#include "inc/looper/MessageClock.h"
+#include <atomic>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+#define START           1000
+#define HOUR            (3600 * 1000)
+
+static std::atomic<int> gDispatched(0);
+static std::atomic<uint64> gDispatchedAt[4];
+
+// context is the clock, virtual time of dispatch is kept by what
+static void onTimer(const Message& msg, void* context)
+{
+    gDispatchedAt[msg->mWhat] = static_cast<MsgClock*>(context)->nowMillis();
+    gDispatched++;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// manual clock only moves by advance(), messages are dispatched at their virtual time and
+// real time doesn't matter. Auto advance then jumps an hour at once
+static void testManualThenAuto(void)
+{
+    std::shared_ptr<VirtualClock> clock(new VirtualClock(START, false));
+    LooperThread thread("clock");
+    thread.getLooper()->setClock(clock);
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onTimer, clock.get());
+    gDispatched = 0;
+
+    h->sendEmptyMessage(0, 100);
+    h->sendEmptyMessage(1, 200);
+    h->sendEmptyMessage(2, HOUR);
+    usleep(150 * 1000);
+    TEST_CHECK_EQ(gDispatched.load(), 0);
+    TEST_CHECK_EQ(clock->nowMillis(), START);
+
+    clock->advance(100);
+    TEST_CHECK(waitUntil([]() { return gDispatched.load() == 1; }, 1000));
+    TEST_CHECK_EQ(gDispatchedAt[0].load(), START + 100);
+
+    clock->advance(99);
+    usleep(50 * 1000);
+    TEST_CHECK_EQ(gDispatched.load(), 1);
+    clock->advance(1);
+    TEST_CHECK(waitUntil([]() { return gDispatched.load() == 2; }, 1000));
+    TEST_CHECK_EQ(gDispatchedAt[1].load(), START + 200);
+
+    // an hour of virtual time takes no real time
+    uint64 jumps = clock->getJumpCount();
+    uint64 real = getNowTimeOfMs();
+    clock->setAutoAdvance(true);
+    TEST_CHECK(waitUntil([]() { return gDispatched.load() == 3; }, 1000));
+    TEST_CHECK(getNowTimeOfMs() - real < 1000);
+    TEST_CHECK_EQ(gDispatchedAt[2].load(), START + HOUR);
+    TEST_CHECK_EQ(clock->nowMillis(), START + HOUR);
+    TEST_CHECK(clock->getJumpCount() > jumps);
+
+    // time never goes back
+    TEST_CHECK(clock->advanceTo(START));
+    TEST_CHECK_EQ(clock->nowMillis(), START + HOUR);
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// loopers sharing a manual clock are both woken by one advance
+static void testSharedClock(void)
+{
+    std::shared_ptr<VirtualClock> clock(new VirtualClock(0, false));
+    LooperThread a("clock-a");
+    LooperThread b("clock-b");
+    a.getLooper()->setClock(clock);
+    b.getLooper()->setClock(clock);
+    Handler ha = MsgHandler::createHandler(a.getLooper(), onTimer, clock.get());
+    Handler hb = MsgHandler::createHandler(b.getLooper(), onTimer, clock.get());
+    gDispatched = 0;
+
+    ha->sendEmptyMessage(0, 500);
+    hb->sendEmptyMessage(1, 500);
+    TEST_CHECK_EQ(a.getLooper()->getMsgQueue()->uptimeMillis(), 0);
+    usleep(50 * 1000);
+    TEST_CHECK_EQ(gDispatched.load(), 0);
+
+    clock->advance(500);
+    TEST_CHECK(waitUntil([]() { return gDispatched.load() == 2; }, 1000));
+    TEST_CHECK_EQ(gDispatchedAt[0].load(), 500);
+    TEST_CHECK_EQ(gDispatchedAt[1].load(), 500);
+
+    a.quit();
+    b.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testManualThenAuto();
+    testSharedClock();
+    return testResult("test_clock");
+}
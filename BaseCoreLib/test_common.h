@@ -0,0 +1,64 @@
+/*****************************************************************************
+* FileName    : test_common.h
+* Description : Checks shared by tests of looper
+* Author      : Joe.Bi
+* Date        : 2026-10
+* Version     : v1.0
+* Copyright (c)  xxx . All rights reserved.
+******************************************************************************/
+#ifndef __test_common_h__
+#define __test_common_h__
+#include "inc/base/TimeUtil.h"
+#include <stdio.h>
+#include <unistd.h>
+
+//---------------------------------------------------------------------------//
+// a failed check is reported and counted, the test goes on so one run shows all
+static int gTestFailures = 0;
+
+#define TEST_CHECK(cond) \
+    do \
+    { \
+        if (!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            gTestFailures++; \
+        } \
+    } while (0)
+
+#define TEST_CHECK_EQ(a, b) \
+    do \
+    { \
+        long long va = (long long)(a), vb = (long long)(b); \
+        if (va != vb) \
+        { \
+            fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, va, vb); \
+            gTestFailures++; \
+        } \
+    } while (0)
+
+// poll condition every millisecond, return false if it is still false at timeout
+template <typename Fn>
+static bool waitUntil(Fn fn, long timeoutMillis)
+{
+    uint64 end = Root::Core::getNowTimeOfMs() + timeoutMillis;
+    while (!fn())
+    {
+        if (Root::Core::getNowTimeOfMs() >= end)
+            return fn();
+        usleep(1000);
+    }
+
+    return true;
+}
+
+static int testResult(const char* name)
+{
+    if (gTestFailures)
+        fprintf(stderr, "%s: %d checks failed\n", name, gTestFailures);
+    else
+        fprintf(stderr, "%s: passed\n", name);
+    return gTestFailures ? 1 : 0;
+}
+
+#endif // __test_common_h__
@@ -0,0 +1,93 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/LooperCoroutine.h"
+#include <atomic>
+#include <thread>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static std::thread::id gThreadA;
+static std::thread::id gThreadB;
+static std::atomic<int> gWrongThread(0);
+static std::atomic<int> gResult(0);
+static std::atomic<long> gSlept(-1);
+static std::atomic<int> gInvoked(0);
+
+static void onThreadA(const Message& msg, void* context) { gThreadA = std::this_thread::get_id(); }
+static void onThreadB(const Message& msg, void* context) { gThreadB = std::this_thread::get_id(); }
+
+static void expectThread(const std::thread::id& id)
+{
+    if (std::this_thread::get_id() != id)
+        gWrongThread++;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// child task awaited on looper a, its invoke runs on looper b and it comes back to a
+static Task<int> compute(Handler b)
+{
+    expectThread(gThreadA);
+    int v = co_await b->invoke([]() {
+        expectThread(gThreadB);
+        gInvoked++;
+        return 41;
+    });
+    expectThread(gThreadA);
+    co_return v + 1;
+}
+
+static Task<void> run(Handler a, Handler b, Looper loopB)
+{
+    co_await a->resumeOn();
+    expectThread(gThreadA);
+
+    int r = co_await compute(b);
+    expectThread(gThreadA);
+
+    // sleeping on another looper continues there
+    uint64 start = getNowTimeOfMs();
+    co_await sleepFor(loopB, 50);
+    expectThread(gThreadB);
+    gSlept = (long)(getNowTimeOfMs() - start);
+
+    co_await a->resumeOn();
+    expectThread(gThreadA);
+    gResult = r;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static void testCrossLoopers(void)
+{
+    LooperThread threadA("co-a");
+    LooperThread threadB("co-b");
+    Handler a = MsgHandler::createHandler(threadA.getLooper(), onThreadA, nullptr);
+    Handler b = MsgHandler::createHandler(threadB.getLooper(), onThreadB, nullptr);
+    a->sendEmptyMessage(0);
+    b->sendEmptyMessage(0);
+    TEST_CHECK(waitUntil([]() { return gThreadA != std::thread::id() && gThreadB != std::thread::id(); }, 2000));
+
+    // started on a thread without looper, task is lazy until start
+    Task<void> task = run(a, b, threadB.getLooper());
+    TEST_CHECK(task.isValid());
+    TEST_CHECK_EQ(gInvoked.load(), 0);
+    task.start();
+    TEST_CHECK(!task.isValid());
+
+    TEST_CHECK(waitUntil([]() { return gResult.load() != 0; }, 2000));
+    TEST_CHECK_EQ(gResult.load(), 42);
+    TEST_CHECK_EQ(gInvoked.load(), 1);
+    TEST_CHECK(gSlept.load() >= 45);
+    TEST_CHECK_EQ(gWrongThread.load(), 0);
+
+    threadA.quit();
+    threadB.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testCrossLoopers();
+    return testResult("test_coroutine");
+}
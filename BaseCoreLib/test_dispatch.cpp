@@ -0,0 +1,101 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include <atomic>
+#include <thread>
+#if defined(__linux__)
+#include <malloc.h>
+#endif
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static std::atomic<int> gEven(0), gOdd(0), gBig(0), gDefault(0);
+
+static void onEven(const Message& msg, void* context) { gEven++; }
+static void onOdd(const Message& msg, void* context) { gOdd++; }
+static void onBig(const Message& msg, void* context) { gBig++; }
+static void onDefault(const Message& msg, void* context) { gDefault++; }
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static void testTable(void)
+{
+    LooperThread thread("dispatch");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onDefault, nullptr);
+
+    h->on({ { 0, onEven }, { 1, onOdd }, { 2, onEven }, { 3, onOdd }, { 0x10000, onBig }, { -5, onBig } });
+    for (int what = 0; what < 5; what++)
+        h->sendEmptyMessage(what);
+    h->sendEmptyMessage(0x10000);
+    h->sendEmptyMessage(-5);
+    TEST_CHECK(waitUntil([]() { return gEven + gOdd + gBig + gDefault == 7; }, 2000));
+    TEST_CHECK_EQ(gEven.load(), 2);
+    TEST_CHECK_EQ(gOdd.load(), 2);
+    TEST_CHECK_EQ(gBig.load(), 2);
+    TEST_CHECK_EQ(gDefault.load(), 1);
+
+    // null removes, codes left in table still go to their callbacks
+    gEven = gOdd = gBig = gDefault = 0;
+    h->on({ { 1, nullptr }, { 3, nullptr }, { 0x10000, nullptr } });
+    h->on(2, onOdd);
+    for (int what = 0; what < 4; what++)
+        h->sendEmptyMessage(what);
+    h->sendEmptyMessage(0x10000);
+    h->sendEmptyMessage(-5);
+    TEST_CHECK(waitUntil([]() { return gEven + gOdd + gBig + gDefault == 6; }, 2000));
+    TEST_CHECK_EQ(gEven.load(), 1);
+    TEST_CHECK_EQ(gOdd.load(), 1);
+    TEST_CHECK_EQ(gBig.load(), 1);
+    TEST_CHECK_EQ(gDefault.load(), 3);
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// single on() calls while looper dispatches, replaced records are freed as readers leave
+// instead of piling up until handler destroyed, a record with code 1000 holds 8K table
+static void testRetired(void)
+{
+    LooperThread thread("dispatch");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onDefault, nullptr);
+    gEven = gOdd = gBig = gDefault = 0;
+
+    std::atomic<bool> done(false);
+    std::thread sender([&]() {
+        int sent = 0;
+        while (!done.load())
+        {
+            if (sent - (gEven + gOdd + gDefault) < 64)
+            {
+                h->sendEmptyMessage(1000);
+                sent++;
+            }
+            else
+                std::this_thread::yield();
+        }
+        TEST_CHECK(waitUntil([sent]() { return gEven + gOdd + gDefault == sent; }, 2000));
+    });
+
+#if defined(__linux__)
+    size_t before = mallinfo2().uordblks;
+#endif
+    for (int i = 0; i < 20000; i++)
+        h->on(1000, (i & 1) ? onOdd : onEven);
+#if defined(__linux__)
+    size_t after = mallinfo2().uordblks;
+    TEST_CHECK(after < before + 16 * 1024 * 1024);
+#endif
+
+    done = true;
+    sender.join();
+    TEST_CHECK(gEven.load() + gOdd.load() > 0);
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testTable();
+    testRetired();
+    return testResult("test_dispatch");
+}
@@ -0,0 +1,151 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include <atomic>
+#include <thread>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+#define MSG_GATE        1
+#define MSG_SERIAL      2
+#define MSG_WORK        3
+#define WORKS           64
+#define WORK_MILLIS     10
+
+static std::atomic<bool> gInGate(false);
+static std::atomic<bool> gGateOpen(false);
+static std::thread::id gLooperThread;
+static std::atomic<int> gRunning(0);
+static std::atomic<int> gMaxRunning(0);
+static std::atomic<int> gWorked(0);
+static std::atomic<int> gSerial(0);
+static std::atomic<int> gBad(0);
+
+// gate and serial messages are of a handler which isn't reentrant
+static void onSerial(const Message& msg, void* context)
+{
+    if (msg->mWhat == MSG_GATE)
+    {
+        gLooperThread = std::this_thread::get_id();
+        gInGate = true;
+        while (!gGateOpen.load())
+            usleep(1000);
+        return;
+    }
+
+    // still on looper and in sending order
+    if (std::this_thread::get_id() != gLooperThread || msg->mArg1 != gSerial.load())
+        gBad++;
+    gSerial++;
+}
+
+static void onWork(const Message& msg, void* context)
+{
+    int running = ++gRunning;
+    int max = gMaxRunning.load();
+    while (running > max && !gMaxRunning.compare_exchange_weak(max, running))
+        ;
+    usleep(msg->mArg1 * 1000);
+    gRunning--;
+    gWorked++;
+}
+
+static void reset(void)
+{
+    gInGate = false;
+    gGateOpen = false;
+    gRunning = 0;
+    gMaxRunning = 0;
+    gWorked = 0;
+    gSerial = 0;
+    gBad = 0;
+}
+
+// looper is held by gate while queue is filled
+static void holdLooper(const Handler& serial)
+{
+    serial->sendEmptyMessage(MSG_GATE);
+    TEST_CHECK(waitUntil([]() { return gInGate.load(); }, 2000));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// reentrant messages run on several workers at once, the others still on looper in order
+static void testParallel(void)
+{
+    reset();
+    LooperThread* thread = new LooperThread("drain");
+    Looper looper = thread->getLooper();
+    Handler serial = MsgHandler::createHandler(looper, onSerial, nullptr);
+    Handler work = MsgHandler::createHandler(looper, onWork, nullptr);
+    work->setReentrant(true);
+    TEST_CHECK(work->isReentrant());
+    looper->setDrainPolicy(8);
+
+    holdLooper(serial);
+    for (int i = 0; i < WORKS; i++)
+    {
+        work->sendMessage(Msg::obtain(MSG_WORK, WORK_MILLIS, 0));
+        if (i % 8 == 0)
+            serial->sendMessage(Msg::obtain(MSG_SERIAL, i / 8, 0));
+    }
+
+    thread->quitSafely();
+    gGateOpen = true;
+    delete thread;
+
+    DrainReport r;
+    looper->getDrainReport(r);
+    TEST_CHECK_EQ(gWorked.load(), WORKS);
+    TEST_CHECK_EQ(gSerial.load(), WORKS / 8);
+    TEST_CHECK_EQ(gBad.load(), 0);
+    TEST_CHECK(gMaxRunning.load() > 1);
+    TEST_CHECK_EQ(r.mParallel, WORKS);
+    TEST_CHECK_EQ(r.mSerial, WORKS / 8);
+    TEST_CHECK_EQ(r.mDiscarded, 0);
+
+    // serial drain would take WORKS * WORK_MILLIS
+    TEST_CHECK(r.mMillis < WORKS * WORK_MILLIS / 2);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// what isn't done by deadline is discarded and counted, a message due after deadline is
+// dropped at once
+static void testDeadline(void)
+{
+    reset();
+    LooperThread* thread = new LooperThread("drain");
+    Looper looper = thread->getLooper();
+    Handler serial = MsgHandler::createHandler(looper, onSerial, nullptr);
+    Handler work = MsgHandler::createHandler(looper, onWork, nullptr);
+    work->setReentrant(true);
+    looper->setDrainPolicy(2, 100);
+
+    holdLooper(serial);
+    for (int i = 0; i < 40; i++)
+        work->sendMessage(Msg::obtain(MSG_WORK, 20, 0));
+    serial->sendMessageDelayed(Msg::obtain(MSG_SERIAL, 0, 0), 5000);
+
+    uint64 start = getNowTimeOfMs();
+    thread->quitSafely();
+    gGateOpen = true;
+    delete thread;
+
+    DrainReport r;
+    looper->getDrainReport(r);
+    TEST_CHECK(getNowTimeOfMs() - start < 1000);
+    TEST_CHECK(r.mMillis < 300);
+    TEST_CHECK_EQ(gSerial.load(), 0);
+    TEST_CHECK_EQ(r.mParallel, (uint64)gWorked.load());
+    TEST_CHECK(r.mParallel > 0 && r.mParallel < 40);
+    TEST_CHECK_EQ(r.mParallel + r.mDiscarded, 41);
+    TEST_CHECK_EQ(r.mSerial, 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testParallel();
+    testDeadline();
+    return testResult("test_drain");
+}
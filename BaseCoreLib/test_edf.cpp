@@ -0,0 +1,130 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/MessageQueue.h"
+#include <atomic>
+#include <vector>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+#define MSG_GATE        999
+
+static std::atomic<bool> gInGate(false);
+static std::atomic<bool> gGateOpen(false);
+static std::atomic<int> gDispatched(0);
+static std::atomic<int> gExpired(0);
+static std::atomic<int> gExpiredWhat(-1);
+static std::vector<int> gOrder;     // written on looper only, read after it is idle
+
+static void onMessage(const Message& msg, void* context)
+{
+    if (msg->mWhat == MSG_GATE)
+    {
+        gInGate = true;
+        while (!gGateOpen.load())
+            usleep(1000);
+        return;
+    }
+
+    gOrder.push_back(msg->mWhat);
+    gDispatched++;
+}
+
+static void onExpired(const Message& msg, void* context)
+{
+    gExpiredWhat = msg->mWhat;
+    gExpired++;
+}
+
+// looper is held by a gate message while the queue is filled
+static void holdLooper(const Handler& h)
+{
+    gInGate = false;
+    gGateOpen = false;
+    h->sendEmptyMessage(MSG_GATE);
+    TEST_CHECK(waitUntil([]() { return gInGate.load(); }, 2000));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// ready messages run by deadline, not by sending order, plain ones after them. A cancelled
+// deadline message leaves both heaps
+static void testOrder(void)
+{
+    LooperThread thread("edf");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onMessage, nullptr);
+    Queue queue = thread.getLooper()->getMsgQueue();
+    queue->setDeadlineMode(true, false);
+    TEST_CHECK(queue->isDeadlineMode());
+    gOrder.clear();
+    gDispatched = 0;
+
+    holdLooper(h);
+    MsgHandle cancelled;
+    h->sendEmptyMessage(1);
+    h->sendMessageWithDeadline(Msg::obtain(500), 0, 500);
+    h->sendMessageWithDeadline(Msg::obtain(100), 0, 100);
+    h->sendMessageWithDeadline(Msg::obtain(50), 0, 50, &cancelled);
+    h->sendEmptyMessage(2);
+    h->sendMessageWithDeadline(Msg::obtain(300), 0, 300);
+    TEST_CHECK(cancelled.cancel());
+    gGateOpen = true;
+
+    TEST_CHECK(waitUntil([]() { return gDispatched.load() == 5; }, 2000));
+    int expected[] = { 100, 300, 500, 1, 2 };
+    TEST_CHECK_EQ(gOrder.size(), 5);
+    for (size_t i = 0; i < gOrder.size() && i < 5; i++)
+        TEST_CHECK_EQ(gOrder[i], expected[i]);
+
+    // earlier deadline which isn't due yet doesn't hold back a ready one
+    gOrder.clear();
+    gDispatched = 0;
+    h->sendMessageWithDeadline(Msg::obtain(10), 80, 100);
+    h->sendMessageWithDeadline(Msg::obtain(20), 0, 1000);
+    TEST_CHECK(waitUntil([]() { return gDispatched.load() == 2; }, 2000));
+    TEST_CHECK_EQ(gOrder.size(), 2);
+    if (gOrder.size() == 2)
+    {
+        TEST_CHECK_EQ(gOrder[0], 20);
+        TEST_CHECK_EQ(gOrder[1], 10);
+    }
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// message whose deadline passed while looper was busy goes to expired handler only
+static void testExpire(void)
+{
+    LooperThread thread("edf");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onMessage, nullptr);
+    Queue queue = thread.getLooper()->getMsgQueue();
+    queue->setDeadlineMode(true, true);
+    queue->setExpiredHandler(onExpired, nullptr);
+    gOrder.clear();
+    gDispatched = 0;
+    gExpired = 0;
+
+    holdLooper(h);
+    h->sendMessageWithDeadline(Msg::obtain(1), 0, 20);
+    h->sendMessageWithDeadline(Msg::obtain(2), 0, 5000);
+    usleep(100 * 1000);
+    gGateOpen = true;
+
+    TEST_CHECK(waitUntil([]() { return gDispatched.load() == 1 && gExpired.load() == 1; }, 2000));
+    TEST_CHECK_EQ(gExpiredWhat.load(), 1);
+    TEST_CHECK_EQ(gOrder.size(), 1);
+    if (gOrder.size() == 1)
+        TEST_CHECK_EQ(gOrder[0], 2);
+    TEST_CHECK_EQ(queue->getExpiredCount(), 1);
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testOrder();
+    testExpire();
+    return testResult("test_edf");
+}
@@ -0,0 +1,127 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/EventBus.h"
+#include <atomic>
+#include <string.h>
+#if defined(__linux__)
+#include <malloc.h>
+#endif
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+#define TOPIC_PRICE     7
+#define TOPIC_OTHER     8
+#define SUBSCRIBERS     3
+#define EVENTS          1000
+
+struct Price
+{
+    int     mId;
+    char    mName[4096 - sizeof(int)];
+};
+
+static std::atomic<int> gReceived[SUBSCRIBERS];
+static std::atomic<int> gBad(0);
+static std::atomic<const void*> gPayload[SUBSCRIBERS];
+static std::atomic<void*> gRetained(nullptr);
+
+// context is index of subscriber, first one keeps payload of event 1
+static void onEvent(const Message& msg, void* context)
+{
+    int index = (int)(intptr_t)context;
+    const Price* p = static_cast<const Price*>(msg->getParam());
+    if (msg->mWhat != TOPIC_PRICE || msg->ParamSize() != sizeof(Price) || p->mId != msg->mArg1
+        || msg->mArg2 != 5 || strcmp(p->mName, "ACME") != 0)
+        gBad++;
+
+    gPayload[index] = p;
+    if (index == 0 && msg->mArg1 == 1)
+        gRetained = EventBus::retain(const_cast<void*>(msg->getParam()));
+    gReceived[index]++;
+}
+
+static bool receivedAll(int count)
+{
+    for (int i = 0; i < SUBSCRIBERS; i++)
+        if (gReceived[i].load() != count)
+            return false;
+    return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// two subscribers share a looper and one is on another, all get the same block and it is
+// freed once every message is recycled and retain is released
+static void testFanOut(void)
+{
+    LooperThread a("bus-a");
+    LooperThread b("bus-b");
+    Handler h[SUBSCRIBERS] = {
+        MsgHandler::createHandler(a.getLooper(), onEvent, (void*)0),
+        MsgHandler::createHandler(a.getLooper(), onEvent, (void*)1),
+        MsgHandler::createHandler(b.getLooper(), onEvent, (void*)2),
+    };
+
+    EventBus bus;
+    for (int i = 0; i < SUBSCRIBERS; i++)
+    {
+        gReceived[i] = 0;
+        TEST_CHECK(bus.subscribe(TOPIC_PRICE, h[i]));
+    }
+    TEST_CHECK(bus.subscribe(TOPIC_OTHER, h[0]));
+    TEST_CHECK_EQ(bus.getSubscriberCount(TOPIC_PRICE), SUBSCRIBERS);
+
+    Price price;
+    memset(&price, 0, sizeof(price));
+    strcpy(price.mName, "ACME");
+    price.mId = 1;
+    TEST_CHECK_EQ(bus.publish(TOPIC_PRICE, &price, sizeof(price), 1, 5), SUBSCRIBERS);
+    TEST_CHECK(waitUntil([]() { return receivedAll(1); }, 2000));
+    TEST_CHECK(gPayload[0].load() != (const void*)&price);
+    TEST_CHECK(gPayload[0].load() == gPayload[1].load() && gPayload[1].load() == gPayload[2].load());
+
+    // retained block outlives its messages, nobody may change it meanwhile
+    price.mId = 2;
+    TEST_CHECK(waitUntil([]() { return gRetained.load() != nullptr; }, 1000));
+    const Price* kept = static_cast<const Price*>(gRetained.load());
+    TEST_CHECK_EQ(kept->mId, 1);
+    TEST_CHECK(strcmp(kept->mName, "ACME") == 0);
+
+#if defined(__linux__)
+    size_t before = mallinfo2().uordblks;
+#endif
+    for (int i = 1; i < EVENTS; i++)
+    {
+        price.mId = i + 1;
+        bus.publish(TOPIC_PRICE, &price, sizeof(price), price.mId, 5);
+    }
+    TEST_CHECK(waitUntil([]() { return receivedAll(EVENTS); }, 5000));
+#if defined(__linux__)
+    // 4K of each event is freed with its last message, a leak would be 4M
+    TEST_CHECK(mallinfo2().uordblks < before + 1024 * 1024);
+#endif
+    TEST_CHECK_EQ(kept->mId, 1);
+    EventBus::release(gRetained.exchange(nullptr));
+    TEST_CHECK_EQ(gBad.load(), 0);
+
+    // removed subscriber gets nothing, handler leaves every topic at once
+    bus.unsubscribe(TOPIC_PRICE, h[2]);
+    TEST_CHECK_EQ(bus.publish(TOPIC_PRICE, &price, sizeof(price), price.mId, 5), SUBSCRIBERS - 1);
+    bus.unsubscribe(h[0]);
+    TEST_CHECK_EQ(bus.getSubscriberCount(TOPIC_PRICE), 1);
+    TEST_CHECK_EQ(bus.getSubscriberCount(TOPIC_OTHER), 0);
+    TEST_CHECK_EQ(bus.publish(TOPIC_OTHER, nullptr, 0), 0);
+    TEST_CHECK(waitUntil([]() { return gReceived[1].load() == EVENTS + 1; }, 2000));
+    TEST_CHECK_EQ(gReceived[2].load(), EVENTS);
+
+    a.quit();
+    b.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testFanOut();
+    return testResult("test_eventbus");
+}
@@ -0,0 +1,122 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/MessageQueue.h"
+#include <atomic>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+#define FLOOD_COUNT     20000
+
+static std::atomic<bool> gBlocked(false);
+static std::atomic<bool> gRelease(false);
+static std::atomic<int> gCountA(0), gCountB(0);
+static int gLastA = -1, gLastB = -1;
+static int gOutOfOrder = 0;
+static int gBAtThousandA = -1;
+static std::atomic<int> gBeforeQuiet(-1);
+
+static void onBlock(const Message& msg, void* context)
+{
+    gBlocked = true;
+    while (!gRelease.load())
+        usleep(1000);
+}
+
+static void onA(const Message& msg, void* context)
+{
+    if (msg->mArg1 != gLastA + 1)
+        gOutOfOrder++;
+    gLastA = msg->mArg1;
+    if (++gCountA == 1000)
+        gBAtThousandA = gCountB;
+}
+
+static void onB(const Message& msg, void* context)
+{
+    if (msg->mArg1 != gLastB + 1)
+        gOutOfOrder++;
+    gLastB = msg->mArg1;
+    gCountB++;
+}
+
+static void onQuiet(const Message& msg, void* context)
+{
+    gBeforeQuiet = gCountA + gCountB;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// two handlers flood the queue while looper is blocked, then a quiet one sends one message
+static void runFlood(bool fair, int weightB)
+{
+    LooperThread thread("fair");
+    Queue queue = thread.getLooper()->getMsgQueue();
+    Handler blocker = MsgHandler::createHandler(thread.getLooper(), onBlock, nullptr);
+    Handler a = MsgHandler::createHandler(thread.getLooper(), onA, nullptr);
+    Handler b = MsgHandler::createHandler(thread.getLooper(), onB, nullptr);
+    Handler quiet = MsgHandler::createHandler(thread.getLooper(), onQuiet, nullptr);
+
+    queue->setFairMode(fair);
+    queue->setHandlerWeight(b.get(), weightB);
+    gBlocked = false;
+    gRelease = false;
+    gCountA = gCountB = 0;
+    gLastA = gLastB = -1;
+    gOutOfOrder = 0;
+    gBAtThousandA = -1;
+    gBeforeQuiet = -1;
+
+    // the looper is held before floods are sent, so all lanes are full when it goes on
+    blocker->sendEmptyMessage(0);
+    TEST_CHECK(waitUntil([]() { return gBlocked.load(); }, 2000));
+    for (int i = 0; i < FLOOD_COUNT; i++)
+        a->sendMessage(Msg::obtain(0, i, 0, a));
+    for (int i = 0; i < FLOOD_COUNT; i++)
+        b->sendMessage(Msg::obtain(0, i, 0, b));
+    quiet->sendEmptyMessage(0);
+    gRelease = true;
+
+    TEST_CHECK(waitUntil([]() { return gCountA == FLOOD_COUNT && gCountB == FLOOD_COUNT && gBeforeQuiet >= 0; }, 10000));
+    TEST_CHECK_EQ(gOutOfOrder, 0);
+    if (fair)
+    {
+        // lanes are served in turn, b gets weight messages per turn
+        TEST_CHECK(gBeforeQuiet.load() <= 1 + weightB);
+        TEST_CHECK(gBAtThousandA >= 1000 * weightB - weightB && gBAtThousandA <= 1000 * weightB);
+    }
+    else
+    {
+        TEST_CHECK_EQ(gBeforeQuiet.load(), 2 * FLOOD_COUNT);
+        TEST_CHECK_EQ(gBAtThousandA, 0);
+    }
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// queue keys weight by address of handler, it is dropped with the handler
+static void testWeightDiesWithHandler(void)
+{
+    LooperThread thread("fair");
+    Queue queue = thread.getLooper()->getMsgQueue();
+    Handler b = MsgHandler::createHandler(thread.getLooper(), onB, nullptr);
+    MsgHandler* key = b.get();
+
+    queue->setHandlerWeight(key, 4);
+    TEST_CHECK_EQ(queue->getHandlerWeight(key), 4);
+    b.reset();
+    TEST_CHECK_EQ(queue->getHandlerWeight(key), 1);
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    runFlood(false, 1);
+    runFlood(true, 1);
+    runFlood(true, 3);
+    testWeightDiesWithHandler();
+    return testResult("test_fair");
+}
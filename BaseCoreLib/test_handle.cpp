@@ -0,0 +1,136 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/MessageQueue.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static std::mutex gMutex;
+static std::vector<int> gOrder;
+
+static void onMessage(const Message& msg, void* context)
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    gOrder.push_back(msg->mWhat);
+}
+
+static int dispatched(void)
+{
+    std::lock_guard<std::mutex> lock(gMutex);
+    return (int)gOrder.size();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// cancel and reschedule reach pending messages, and only them
+static void testCancelAndReschedule(void)
+{
+    LooperThread thread("handle");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onMessage, nullptr);
+    gOrder.clear();
+
+    const int count = 300;
+    std::vector<MsgHandle> handles(count);
+    for (int i = 0; i < count; i++)
+        h->sendEmptyMessage(i, 400 + i % 50, &handles[i]);
+
+    int pending = 0;
+    for (int i = 0; i < count; i++)
+        pending += handles[i].isPending() ? 1 : 0;
+    TEST_CHECK_EQ(pending, count);
+
+    int canceled = 0, rescheduled = 0;
+    for (int i = 0; i < count; i += 3)
+        canceled += handles[i].cancel() ? 1 : 0;
+    for (int i = 1; i < count; i += 3)
+        rescheduled += handles[i].reschedule(50) ? 1 : 0;
+
+    TEST_CHECK_EQ(canceled, count / 3);
+    TEST_CHECK_EQ(rescheduled, count / 3);
+    TEST_CHECK(!handles[0].isPending());
+    TEST_CHECK(!handles[0].cancel());
+    TEST_CHECK_EQ(thread.getLooper()->getMsgQueue()->getQueueSize(), count - canceled);
+
+    TEST_CHECK(waitUntil([&]() { return dispatched() == count - canceled; }, 3000));
+    {
+        // rescheduled messages are due first
+        std::lock_guard<std::mutex> lock(gMutex);
+        for (int i = 0; i < rescheduled && i < (int)gOrder.size(); i++)
+            TEST_CHECK_EQ(gOrder[i] % 3, 1);
+    }
+
+    // every handle is stale once its message left the queue
+    for (int i = 0; i < count; i++)
+    {
+        TEST_CHECK(!handles[i].isPending());
+        TEST_CHECK(!handles[i].cancel());
+        TEST_CHECK(!handles[i].reschedule(10));
+    }
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// a slot is reused by a later message, the stale handle of the slot must not reach it
+static void testGenerationReuse(void)
+{
+    LooperThread thread("generation");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onMessage, nullptr);
+    gOrder.clear();
+
+    MsgHandle first;
+    h->sendEmptyMessage(1, 0L, &first);
+    TEST_CHECK(waitUntil([&]() { return dispatched() == 1; }, 1000));
+    TEST_CHECK(!first.isPending());
+
+    // slot of first message is free now, so these take it over
+    std::vector<MsgHandle> later(8);
+    for (size_t i = 0; i < later.size(); i++)
+        h->sendEmptyMessage(2, 200L, &later[i]);
+
+    TEST_CHECK(!first.isPending());
+    TEST_CHECK(!first.cancel());
+    TEST_CHECK(!first.reschedule(0));
+    for (size_t i = 0; i < later.size(); i++)
+        TEST_CHECK(later[i].isPending());
+
+    TEST_CHECK(waitUntil([&]() { return dispatched() == 1 + (int)later.size(); }, 2000));
+
+    // handle of removed message is stale too
+    MsgHandle removed;
+    h->sendEmptyMessage(3, 1000L, &removed);
+    h->removeMessage(3);
+    TEST_CHECK(!removed.isPending());
+    TEST_CHECK(!removed.cancel());
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// handle may outlive queue of its message
+static void testOrphanHandle(void)
+{
+    MsgHandle orphan;
+    {
+        LooperThread thread("orphan");
+        Handler h = MsgHandler::createHandler(thread.getLooper(), onMessage, nullptr);
+        h->sendEmptyMessage(4, 5000L, &orphan);
+        TEST_CHECK(orphan.isPending());
+        thread.quit();
+    }
+
+    TEST_CHECK(!orphan.isPending());
+    TEST_CHECK(!orphan.cancel());
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testCancelAndReschedule();
+    testGenerationReuse();
+    testOrphanHandle();
+    return testResult("test_handle");
+}
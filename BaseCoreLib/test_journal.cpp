@@ -0,0 +1,128 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/MessageLooper.h"
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+#define MSG_BULK        1
+#define MSG_DURABLE     2
+#define MSG_FILL        3
+#define MSG_CHECK       98
+#define MSG_EXIT        99
+
+#define BULK_COUNT      40000
+#define BULK_BATCH      1000
+#define DURABLE_COUNT   3
+
+static std::string gPath;
+static Handler gWriter;
+static int gBulk = 0;
+static int gSent = 0;
+static int gDurable = 0;
+static long gSum = 0;
+
+static long fileSize(void)
+{
+    struct stat st;
+    return stat(gPath.c_str(), &st) == 0 ? (long)st.st_size : -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// first process: done records fill the file until it is compacted, then it dies with
+// durable messages pending
+static void onWriter(const Message& msg, void* context)
+{
+    if (msg->mWhat == MSG_BULK)
+        gBulk++;
+    else if (msg->mWhat == MSG_FILL)
+    {
+        // a batch at a time, so few records are live while many go through
+        for (int i = 0; i < BULK_BATCH; i++, gSent++)
+        {
+            int v = 1;
+            gWriter->sendDurableMessageDelayed(Msg::obtain(MSG_BULK, 1, 0, &v, sizeof(v), nullptr), 0);
+        }
+        if (gSent < BULK_COUNT)
+            gWriter->sendEmptyMessage(MSG_FILL);
+        else
+            gWriter->sendEmptyMessage(MSG_CHECK, 300L);   // queue is idle before check, so journal is maintained
+    }
+    else if (msg->mWhat == MSG_CHECK)
+    {
+        // about 4MB of records went through the journal
+        TEST_CHECK_EQ(gBulk, BULK_COUNT);
+        TEST_CHECK(fileSize() > 0 && fileSize() <= (2 << 20));
+
+        for (int i = 0; i < DURABLE_COUNT; i++)
+        {
+            int v = 10;
+            gWriter->sendDurableMessageDelayed(Msg::obtain(MSG_DURABLE, 100, 0, &v, sizeof(v), nullptr), 500);
+        }
+        gWriter->sendEmptyMessage(MSG_EXIT, 50L);
+    }
+    else if (msg->mWhat == MSG_EXIT)
+        _exit(gTestFailures ? 1 : 0);   // no clean shutdown, as if process crashed
+}
+
+static void runWriter(void)
+{
+    Looper looper = MsgLooper::prepare(50, gPath.c_str());
+    gWriter = MsgHandler::createHandler(looper, onWriter);
+    gWriter->setDurableId(1);
+    gWriter->sendEmptyMessage(MSG_FILL);
+    looper->loop();
+    _exit(2);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static void onReader(const Message& msg, void* context)
+{
+    if (msg->mWhat == MSG_BULK)
+        gBulk++;
+    else if (msg->mWhat == MSG_DURABLE)
+    {
+        gDurable++;
+        gSum += msg->mArg1 + (msg->ParamSize() == sizeof(int) ? *(int*)msg->getParam() : 0);
+    }
+    else if (msg->mWhat == MSG_EXIT)
+        MsgLooper::myLooper()->quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_journal_%d.journal", (int)getpid());
+    gPath = path;
+    unlink(gPath.c_str());
+
+    pid_t pid = fork();
+    if (pid == 0)
+        runWriter();
+
+    int status = -1;
+    waitpid(pid, &status, 0);
+    TEST_CHECK(WIFEXITED(status));
+    TEST_CHECK_EQ(WEXITSTATUS(status), 0);
+
+    // restart: pending durable messages come back with their params, done ones don't
+    gBulk = 0;
+    Looper looper = MsgLooper::prepare(50, gPath.c_str());
+    Handler h = MsgHandler::createHandler(looper);
+    h->setMsgHandlerFunc(onReader);
+    h->setDurableId(1);
+    h->sendEmptyMessage(MSG_EXIT, 1500L);
+    looper->loop();
+
+    TEST_CHECK_EQ(gBulk, 0);
+    TEST_CHECK_EQ(gDurable, DURABLE_COUNT);
+    TEST_CHECK_EQ(gSum, DURABLE_COUNT * 110);
+
+    unlink(gPath.c_str());
+    unlink((gPath + ".compact").c_str());
+    return testResult("test_journal");
+}
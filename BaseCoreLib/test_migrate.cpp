@@ -0,0 +1,125 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/MessageQueue.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+#define MSG_DATA        1
+#define MSG_HOP         2
+
+#define SENDERS         4
+#define PER_SENDER      20000
+
+static Looper gLoopers[2];
+static Handler gHandler;
+static int gLast[SENDERS];
+static std::atomic<int> gReceived(0);
+static std::atomic<int> gOutOfOrder(0);
+static std::atomic<int> gHops(0);
+
+// it runs on the looper which dispatches handler, so no message overlaps a move
+static void onMessage(const Message& msg, void* context)
+{
+    if (msg->mWhat == MSG_HOP)
+    {
+        const Looper& to = gHandler->getLooper() == gLoopers[0] ? gLoopers[1] : gLoopers[0];
+        if (gHandler->migrateTo(to) >= 0)
+            gHops++;
+        return;
+    }
+
+    int sender = msg->mArg2;
+    if (msg->mArg1 != gLast[sender] + 1)
+        gOutOfOrder++;
+    gLast[sender] = msg->mArg1;
+    gReceived++;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static void runMoveUnderConcurrentSend(void)
+{
+    LooperThread a("migrate-a"), b("migrate-b");
+    gLoopers[0] = a.getLooper();
+    gLoopers[1] = b.getLooper();
+    gHandler = MsgHandler::createHandler(gLoopers[0], onMessage, nullptr);
+    for (int i = 0; i < SENDERS; i++)
+        gLast[i] = -1;
+
+    std::vector<std::thread> senders;
+    for (int s = 0; s < SENDERS; s++)
+    {
+        senders.emplace_back([s]()
+        {
+            for (int i = 0; i < PER_SENDER; i++)
+                gHandler->sendMessage(Msg::obtain(MSG_DATA, i, s, gHandler));
+        });
+    }
+
+    while (gReceived.load() < SENDERS * PER_SENDER / 2)
+    {
+        gHandler->sendEmptyMessage(MSG_HOP);
+        usleep(200);
+    }
+
+    for (size_t i = 0; i < senders.size(); i++)
+        senders[i].join();
+
+    TEST_CHECK(waitUntil([]() { return gReceived.load() == SENDERS * PER_SENDER; }, 30000));
+    TEST_CHECK_EQ(gReceived.load(), SENDERS * PER_SENDER);
+    TEST_CHECK_EQ(gOutOfOrder.load(), 0);
+    TEST_CHECK(gHops.load() > 0);
+
+    LooperStats sa, sb;
+    gLoopers[0]->getStats(sa);
+    gLoopers[1]->getStats(sb);
+    TEST_CHECK(sa.mDispatched > 0 && sb.mDispatched > 0);
+}
+
+// hops may still be pending when loopers quit, so handler outlives their threads
+static void testMoveUnderConcurrentSend(void)
+{
+    runMoveUnderConcurrentSend();
+    gHandler.reset();
+    gLoopers[0].reset();
+    gLoopers[1].reset();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// pending messages move with their order and times, later sends follow the handler
+static void testPendingMessagesMove(void)
+{
+    LooperThread a("pending-a"), b("pending-b");
+    Handler h = MsgHandler::createHandler(a.getLooper(), onMessage, nullptr);
+    gReceived = 0;
+    gOutOfOrder = 0;
+    gLast[0] = -1;
+
+    for (int i = 0; i < 100; i++)
+        h->sendMessageDelayed(Msg::obtain(MSG_DATA, i, 0, h), 100);
+
+    TEST_CHECK_EQ(h->migrateTo(b.getLooper()), 100);
+    TEST_CHECK(h->getLooper() == b.getLooper());
+    TEST_CHECK_EQ(a.getLooper()->getMsgQueue()->getQueueSize(), 0);
+    TEST_CHECK_EQ(b.getLooper()->getMsgQueue()->getQueueSize(), 100);
+
+    h->sendMessageDelayed(Msg::obtain(MSG_DATA, 100, 0, h), 150);
+    TEST_CHECK(waitUntil([]() { return gReceived.load() == 101; }, 2000));
+    TEST_CHECK_EQ(gOutOfOrder.load(), 0);
+    TEST_CHECK_EQ(h->migrateTo(Looper(nullptr)), -1);
+
+    a.quit();
+    b.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testMoveUnderConcurrentSend();
+    testPendingMessagesMove();
+    return testResult("test_migrate");
+}
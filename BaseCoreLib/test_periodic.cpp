@@ -0,0 +1,153 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/MessageQueue.h"
+#include <atomic>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static std::atomic<int> gTicks(0);
+static MsgHandle gSelf;
+static Handler gHandler;
+
+static void onTick(const Message& msg, void* context)
+{
+    gTicks++;
+}
+
+static void onTickCancelSelf(const Message& msg, void* context)
+{
+    if (++gTicks == 3)
+        gSelf.cancel();
+}
+
+static void onTickRemoveAll(const Message& msg, void* context)
+{
+    if (++gTicks == 3)
+        gHandler->removeAllMessages();
+}
+
+static void onTickRemoveSelf(const Message& msg, void* context)
+{
+    if (++gTicks == 3)
+    {
+        runnable r = onTickRemoveSelf;
+        gHandler->removeMessage(r);
+    }
+}
+
+static void onTickRemoveWhat(const Message& msg, void* context)
+{
+    if (++gTicks == 3)
+        gHandler->removeMessage(msg->mWhat);
+}
+
+// ticks stop and stay stopped
+static bool stopped(int settleMillis)
+{
+    int ticks = gTicks.load();
+    usleep(settleMillis * 1000);
+    return gTicks.load() == ticks;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static void testCancelByHandle(void)
+{
+    LooperThread thread("periodic");
+    Handler h = MsgHandler::createHandler(thread.getLooper());
+    Queue queue = thread.getLooper()->getMsgQueue();
+
+    gTicks = 0;
+    MsgHandle handle;
+    h->postAtFixedRate(onTick, 0, 5, &handle);
+    TEST_CHECK(waitUntil([]() { return gTicks.load() >= 5; }, 2000));
+    TEST_CHECK(handle.isPending());
+    TEST_CHECK(handle.cancel());
+    TEST_CHECK(!handle.isPending());
+    TEST_CHECK(!handle.cancel());
+    TEST_CHECK(stopped(50));
+    TEST_CHECK_EQ(queue->getQueueSize(), 0);
+
+    // fixed delay and cancel from its own tick
+    gTicks = 0;
+    h->postWithFixedDelay(onTickCancelSelf, 0, 5, &gSelf);
+    TEST_CHECK(waitUntil([]() { return gTicks.load() >= 3; }, 2000));
+    TEST_CHECK(stopped(50));
+    TEST_CHECK_EQ(gTicks.load(), 3);
+    TEST_CHECK(!gSelf.isPending());
+    TEST_CHECK_EQ(queue->getQueueSize(), 0);
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static void testRemoveMessages(void)
+{
+    LooperThread thread("periodic");
+    Handler h = MsgHandler::createHandler(thread.getLooper());
+    Queue queue = thread.getLooper()->getMsgQueue();
+
+    // without handle, removing messages of handler stops it
+    gTicks = 0;
+    h->postAtFixedRate(onTick, 0, 5);
+    TEST_CHECK(waitUntil([]() { return gTicks.load() >= 3; }, 2000));
+    h->removeAllMessages();
+    TEST_CHECK(stopped(50));
+    TEST_CHECK_EQ(queue->getQueueSize(), 0);
+
+    gTicks = 0;
+    runnable r = onTick;
+    h->postWithFixedDelay(r, 0, 5);
+    TEST_CHECK(waitUntil([]() { return gTicks.load() >= 3; }, 2000));
+    h->removeMessage(r);
+    TEST_CHECK(stopped(50));
+    TEST_CHECK_EQ(queue->getQueueSize(), 0);
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// message is out of queue while its tick runs, removing it there stops the next tick
+static void testRemoveFromOwnTick(void)
+{
+    LooperThread thread("periodic");
+    gHandler = MsgHandler::createHandler(thread.getLooper());
+    Queue queue = thread.getLooper()->getMsgQueue();
+
+    runnable ticks[] = { onTickRemoveAll, onTickRemoveSelf, onTickRemoveWhat };
+    for (int i = 0; i < 3; i++)
+    {
+        gTicks = 0;
+        MsgHandle handle;
+        if (i % 2)
+            gHandler->postWithFixedDelay(ticks[i], 0, 5, &handle);
+        else
+            gHandler->postAtFixedRate(ticks[i], 0, 5, &handle);
+        TEST_CHECK(waitUntil([]() { return gTicks.load() >= 3; }, 2000));
+        TEST_CHECK(stopped(50));
+        TEST_CHECK_EQ(gTicks.load(), 3);
+        TEST_CHECK(!handle.isPending());
+        TEST_CHECK_EQ(queue->getQueueSize(), 0);
+    }
+
+    // other handler's message is left running
+    Handler other = MsgHandler::createHandler(thread.getLooper());
+    gTicks = 0;
+    other->postAtFixedRate(onTickRemoveAll, 0, 5);
+    TEST_CHECK(waitUntil([]() { return gTicks.load() >= 6; }, 2000));
+    other->removeAllMessages();
+    TEST_CHECK(stopped(50));
+
+    thread.quit();
+    gHandler.reset();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testCancelByHandle();
+    testRemoveMessages();
+    testRemoveFromOwnTick();
+    return testResult("test_periodic");
+}
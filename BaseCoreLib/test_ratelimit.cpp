@@ -0,0 +1,99 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/MessageQueue.h"
+#include <atomic>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static std::atomic<int> gCount(0);
+static std::atomic<int> gOutOfOrder(0);
+static int gLast = -1;
+static uint64 gStart = 0;
+static std::atomic<uint64> gEnd(0);
+static std::atomic<uint64> gOther(0);
+
+static void onLimited(const Message& msg, void* context)
+{
+    if (msg->mArg1 != gLast + 1)
+        gOutOfOrder++;
+    gLast = msg->mArg1;
+    gEnd = getNowTimeOfMs() - gStart;
+    gCount++;
+}
+
+static void onOther(const Message& msg, void* context)
+{
+    gOther = getNowTimeOfMs() - gStart;
+}
+
+static void sendLimited(const Handler& h, int count)
+{
+    gCount = 0;
+    gLast = -1;
+    gStart = getNowTimeOfMs();
+    for (int i = 0; i < count; i++)
+        h->sendMessage(Msg::obtain(0, i, 0, h));
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+static void testTokenBucket(void)
+{
+    LooperThread thread("ratelimit");
+    Handler limited = MsgHandler::createHandler(thread.getLooper(), onLimited, nullptr);
+    Handler other = MsgHandler::createHandler(thread.getLooper(), onOther, nullptr);
+
+    // burst of 5 at once, then one per 10ms
+    limited->setRateLimit(100, 5);
+    sendLimited(limited, 50);
+    other->sendEmptyMessage(0);
+
+    TEST_CHECK(waitUntil([]() { return gCount.load() == 50; }, 3000));
+    TEST_CHECK_EQ(gOutOfOrder.load(), 0);
+    TEST_CHECK(gEnd.load() >= 400);
+    TEST_CHECK(gEnd.load() < 1500);
+    TEST_CHECK(gOther.load() < 100);   // a throttled handler doesn't hold up others
+    TEST_CHECK_EQ(limited->getThrottledCount(), 45);
+    TEST_CHECK_EQ(other->getThrottledCount(), 0);
+    TEST_CHECK_EQ(thread.getLooper()->getMsgQueue()->getThrottledCount(), 45);
+
+    // rate 0 removes the limit
+    limited->setRateLimit(0);
+    sendLimited(limited, 50);
+    TEST_CHECK(waitUntil([]() { return gCount.load() == 50; }, 1000));
+    TEST_CHECK(gEnd.load() < 100);
+    TEST_CHECK_EQ(gOutOfOrder.load(), 0);
+    TEST_CHECK_EQ(limited->getThrottledCount(), 0);
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// queue keys limit by address of handler, it is dropped with the handler
+static void testLimitDiesWithHandler(void)
+{
+    LooperThread thread("ratelimit");
+    Queue queue = thread.getLooper()->getMsgQueue();
+    Handler limited = MsgHandler::createHandler(thread.getLooper(), onLimited, nullptr);
+    MsgHandler* key = limited.get();
+
+    limited->setRateLimit(1000, 1);
+    sendLimited(limited, 10);
+    TEST_CHECK(waitUntil([]() { return gCount.load() == 10; }, 1000));
+    TEST_CHECK(queue->getThrottledCount(key) > 0);
+
+    limited.reset();
+    TEST_CHECK_EQ(queue->getThrottledCount(key), 0);
+    TEST_CHECK(queue->getThrottledCount() > 0);
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testTokenBucket();
+    testLimitDiesWithHandler();
+    return testResult("test_ratelimit");
+}
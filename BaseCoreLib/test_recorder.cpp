@@ -0,0 +1,89 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/MessageQueue.h"
+#include "inc/looper/MessageClock.h"
+#include "inc/looper/MessageRecorder.h"
+#include <atomic>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+#define MSG_LATE        1
+#define MSG_EARLY       2
+
+static uint64 gStart = 0;
+static std::atomic<long> gLate(-1), gEarly(-1);
+
+static void onPlay(const Message& msg, void* context)
+{
+    long t = long(getNowTimeOfMs() - gStart);
+    if (msg->mWhat == MSG_LATE)
+        gLate = t;
+    else if (msg->mWhat == MSG_EARLY)
+        gEarly = t;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// traffic of virtual timeline is recorded in its own time and replayed in real time
+static void testVirtualClockRecording(void)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_recorder_%d.rec", (int)getpid());
+
+    {
+        LooperThread thread("record");
+        std::shared_ptr<VirtualClock> clock = std::make_shared<VirtualClock>(0, false);
+        thread.getLooper()->setClock(clock);
+        Handler h = MsgHandler::createHandler(thread.getLooper());
+        Queue queue = thread.getLooper()->getMsgQueue();
+
+        TEST_CHECK(queue->startRecording(path));
+        h->sendEmptyMessage(MSG_LATE, 3000L);
+        clock->advance(1000);
+        h->sendEmptyMessage(MSG_EARLY);
+        queue->stopRecording();
+
+        h->removeAllMessages();
+        thread.quit();
+    }
+
+    // 10 times faster: early is sent at 100ms, late is due at 300ms
+    LooperThread thread("replay");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onPlay, nullptr);
+    MsgReplayer* replayer = MsgReplayer::open(path);
+    TEST_CHECK(replayer != nullptr);
+    if (replayer)
+    {
+        replayer->setDefaultHandler(h);
+        gStart = getNowTimeOfMs();
+        TEST_CHECK_EQ(replayer->replay(10.0), 2);
+        delete replayer;
+    }
+
+    TEST_CHECK(waitUntil([]() { return gLate.load() >= 0 && gEarly.load() >= 0; }, 2000));
+    TEST_CHECK(gEarly.load() >= 80 && gEarly.load() < 250);
+    TEST_CHECK(gLate.load() >= 280 && gLate.load() < 600);
+
+    // record of another version is refused, version follows magic in header
+    FILE* fp = fopen(path, "r+b");
+    TEST_CHECK(fp != nullptr);
+    if (fp)
+    {
+        uint32 version = 1;
+        fseek(fp, sizeof(uint32), SEEK_SET);
+        fwrite(&version, sizeof(version), 1, fp);
+        fclose(fp);
+        TEST_CHECK(MsgReplayer::open(path) == nullptr);
+    }
+
+    thread.quit();
+    unlink(path);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testVirtualClockRecording();
+    return testResult("test_recorder");
+}
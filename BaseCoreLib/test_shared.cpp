@@ -0,0 +1,294 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/SharedMessageQueue.h"
+#include <atomic>
+#include <thread>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+#define MSG_DATA        1
+#define MSG_DELAYED     2
+#define MSG_LOCAL       3
+
+#define TARGETS         2
+#define PER_TARGET      20000
+
+struct Payload
+{
+    int     mIndex;
+    uint64  mSentMs;
+};
+
+static std::thread::id gLooperThread;
+static std::atomic<int> gReceived(0);
+static std::atomic<int> gOutOfOrder(0);
+static std::atomic<int> gOffThread(0);
+static std::atomic<int> gBadParam(0);
+static std::atomic<long> gDelayedAfter(-1);
+static std::atomic<long> gLocalAfter(-1);
+static uint64 gLocalSent = 0;
+static int gLast[TARGETS];
+static void* gSlowPage = nullptr;
+
+static void onMessage(const Message& msg, void* context)
+{
+    if (std::this_thread::get_id() != gLooperThread)
+        gOffThread++;
+
+    if (msg->mWhat == MSG_LOCAL)
+    {
+        gLocalAfter = (long)(getNowTimeOfMs() - gLocalSent);
+        return;
+    }
+
+    if (msg->ParamSize() != sizeof(Payload))
+    {
+        gBadParam++;
+        return;
+    }
+
+    const Payload* p = static_cast<const Payload*>(msg->getParam());
+    if (msg->mWhat == MSG_DELAYED)
+    {
+        gDelayedAfter = (long)(getNowTimeOfMs() - p->mSentMs);
+        return;
+    }
+
+    int target = msg->mArg2;
+    if (p->mIndex != msg->mArg1 || p->mIndex != gLast[target] + 1)
+        gOutOfOrder++;
+    gLast[target] = p->mIndex;
+    gReceived++;
+}
+
+static void onThreadId(const Message& msg, void* context)
+{
+    gLooperThread = std::this_thread::get_id();
+}
+
+// ring is full while receiver is behind, sender retries
+static void sendAll(SharedMsgQueue* q, int what, int index, int target, long delayMillis)
+{
+    Payload p = { index, getNowTimeOfMs() };
+    while (!q->sendMessageDelayed(Msg::obtain(what, index, target, &p, sizeof(p), nullptr), delayMillis, target))
+        usleep(100);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// child process sends to two handlers of one looper, which takes messages from ring itself
+static void testTwoProcesses(void)
+{
+    LooperThread thread("shared");
+    Handler h0 = MsgHandler::createHandler(thread.getLooper(), onMessage, nullptr);
+    Handler h1 = MsgHandler::createHandler(thread.getLooper(), onMessage, nullptr);
+    Handler id = MsgHandler::createHandler(thread.getLooper(), onThreadId, nullptr);
+    id->sendEmptyMessage(0);
+
+    SharedMsgQueue* q = SharedMsgQueue::create(nullptr, 256, sizeof(Payload));
+    TEST_CHECK(q != nullptr);
+    q->bindHandler(h0, 0);
+    q->bindHandler(h1, 1);
+    TEST_CHECK(q->startReceiving(thread.getLooper()));
+    for (int i = 0; i < TARGETS; i++)
+        gLast[i] = -1;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        SharedMsgQueue* s = SharedMsgQueue::attach(dup(q->getFd()));
+        if (s == nullptr)
+            _exit(1);
+        sendAll(s, MSG_DELAYED, 0, 0, 200);
+        for (int i = 0; i < PER_TARGET; i++)
+            for (int t = 0; t < TARGETS; t++)
+                sendAll(s, MSG_DATA, i, t, 0);
+        delete s;
+        _exit(0);
+    }
+
+    int status = -1;
+    waitpid(pid, &status, 0);
+    TEST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    TEST_CHECK(waitUntil([]() { return gReceived.load() == TARGETS * PER_TARGET && gDelayedAfter.load() >= 0; }, 10000));
+    TEST_CHECK_EQ(gOutOfOrder.load(), 0);
+    TEST_CHECK_EQ(gBadParam.load(), 0);
+    TEST_CHECK(gDelayedAfter.load() >= 190);
+    TEST_CHECK_EQ(q->getQueueSize(), 0);
+
+    // looper sleeps on futex of ring now, a local message still wakes it
+    usleep(50 * 1000);
+    gLocalSent = getNowTimeOfMs();
+    h0->sendMessage(Msg::obtain(MSG_LOCAL, 0, 0, h0));
+    TEST_CHECK(waitUntil([]() { return gLocalAfter.load() >= 0; }, 1000));
+    TEST_CHECK(gLocalAfter.load() < 50);
+
+    // detached while looper sleeps, it goes on with its own queue
+    usleep(50 * 1000);
+    q->stopReceiving();
+    delete q;
+    gLocalAfter = -1;
+    gLocalSent = getNowTimeOfMs();
+    h0->sendMessage(Msg::obtain(MSG_LOCAL, 0, 0, h0));
+    TEST_CHECK(waitUntil([]() { return gLocalAfter.load() >= 0; }, 1000));
+    TEST_CHECK_EQ(gOffThread.load(), 0);
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// child claims a slot and crashes before publishing it, receiver skips the slot
+static void testDeadSender(void)
+{
+    LooperThread thread("shared");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onMessage, nullptr);
+    Handler id = MsgHandler::createHandler(thread.getLooper(), onThreadId, nullptr);
+    id->sendEmptyMessage(0);
+
+    SharedMsgQueue* q = SharedMsgQueue::create(nullptr, 16, sizeof(Payload));
+    TEST_CHECK(q != nullptr);
+    q->bindHandler(h);
+    TEST_CHECK(q->startReceiving(thread.getLooper()));
+    gReceived = 0;
+    gOutOfOrder = 0;
+    gLast[0] = -1;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        struct rlimit core = { 0, 0 };
+        setrlimit(RLIMIT_CORE, &core);
+        SharedMsgQueue* s = SharedMsgQueue::attach(dup(q->getFd()));
+        if (s == nullptr)
+            _exit(1);
+        sendAll(s, MSG_DATA, 0, 0, 0);
+
+        // param can't be read, sender dies while copying it into the claimed slot
+        void* bad = mmap(nullptr, 4096, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        s->sendMessage(Msg::obtain(MSG_DATA, 1, 0, bad, sizeof(Payload), nullptr));
+        _exit(0);
+    }
+
+    // slot stays claimed after first message is taken, child isn't reaped yet and a
+    // zombie counts as dead
+    TEST_CHECK(waitUntil([]() { return gReceived.load() == 1; }, 2000));
+    TEST_CHECK(waitUntil([q]() { return q->getQueueSize() == 1; }, 2000));
+    usleep(50 * 1000);
+    sendAll(q, MSG_DATA, 1, 0, 0);
+    TEST_CHECK(waitUntil([]() { return gReceived.load() == 2; }, 2000));
+    TEST_CHECK_EQ(gOutOfOrder.load(), 0);
+    TEST_CHECK_EQ(q->getQueueSize(), 0);
+    TEST_CHECK_EQ(gOffThread.load(), 0);
+
+    int status = -1;
+    waitpid(pid, &status, 0);
+    TEST_CHECK(!(WIFEXITED(status) && WEXITSTATUS(status) == 0));
+
+    // ring goes on after the skipped slot
+    for (int i = 2; i < 100; i++)
+        sendAll(q, MSG_DATA, i, 0, 0);
+    TEST_CHECK(waitUntil([]() { return gReceived.load() == 100; }, 2000));
+    TEST_CHECK_EQ(gOutOfOrder.load(), 0);
+
+    delete q;
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// sender stalls between claiming and publishing for longer than any timeout, param page
+// is given back by fault handler at last and memcpy goes on
+static void onSlowFault(int sig)
+{
+    struct timespec ts = { 1, 500 * 1000 * 1000 };
+    nanosleep(&ts, nullptr);
+    mprotect(gSlowPage, 4096, PROT_READ | PROT_WRITE);
+    Payload* p = static_cast<Payload*>(gSlowPage);
+    p->mIndex = 0;
+    p->mSentMs = 0;
+}
+
+static void testSlowSender(void)
+{
+    LooperThread thread("shared");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onMessage, nullptr);
+    Handler id = MsgHandler::createHandler(thread.getLooper(), onThreadId, nullptr);
+    id->sendEmptyMessage(0);
+
+    SharedMsgQueue* q = SharedMsgQueue::create(nullptr, 16, sizeof(Payload));
+    TEST_CHECK(q != nullptr);
+    q->bindHandler(h);
+    TEST_CHECK(q->startReceiving(thread.getLooper()));
+    gReceived = 0;
+    gOutOfOrder = 0;
+    gLast[0] = -1;
+
+    uint64 start = getNowTimeOfMs();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        SharedMsgQueue* s = SharedMsgQueue::attach(dup(q->getFd()));
+        if (s == nullptr)
+            _exit(1);
+
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = onSlowFault;
+        sigaction(SIGSEGV, &sa, nullptr);
+        gSlowPage = mmap(nullptr, 4096, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        bool sent = s->sendMessage(Msg::obtain(MSG_DATA, 0, 0, gSlowPage, sizeof(Payload), nullptr));
+        sendAll(s, MSG_DATA, 1, 0, 0);
+        delete s;
+        _exit(sent ? 0 : 1);
+    }
+
+    // the slot isn't skipped while its sender lives, both messages come in order
+    TEST_CHECK(waitUntil([]() { return gReceived.load() == 2; }, 5000));
+    TEST_CHECK(getNowTimeOfMs() - start >= 1400);
+    TEST_CHECK_EQ(gOutOfOrder.load(), 0);
+
+    int status = -1;
+    waitpid(pid, &status, 0);
+    TEST_CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    delete q;
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// segment cut short of the slots its header describes is refused
+static void testTruncatedSegment(void)
+{
+    SharedMsgQueue* q = SharedMsgQueue::create(nullptr, 64, sizeof(Payload));
+    TEST_CHECK(q != nullptr);
+
+    SharedMsgQueue* s = SharedMsgQueue::attach(dup(q->getFd()));
+    TEST_CHECK(s != nullptr);
+    delete s;
+
+    struct stat st;
+    TEST_CHECK(fstat(q->getFd(), &st) == 0);
+    TEST_CHECK(ftruncate(q->getFd(), st.st_size - 1) == 0);
+    TEST_CHECK(SharedMsgQueue::attach(dup(q->getFd())) == nullptr);
+    TEST_CHECK(ftruncate(q->getFd(), 64) == 0);
+    TEST_CHECK(SharedMsgQueue::attach(dup(q->getFd())) == nullptr);
+
+    delete q;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testTwoProcesses();
+    testDeadSender();
+    testSlowSender();
+    testTruncatedSegment();
+    return testResult("test_shared");
+}
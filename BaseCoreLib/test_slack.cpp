@@ -0,0 +1,110 @@
+#include "test_common.h"
+#include "inc/looper/MessageHandler.h"
+#include "inc/looper/LooperThread.h"
+#include "inc/looper/MessageQueue.h"
+#include <atomic>
+
+using namespace Root::Core;
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+#define TIMERS          10
+#define FIRST_DELAY     100
+#define STEP            5
+#define SLACK           50
+#define MSG_EXACT       100
+
+static uint64 gSentAt = 0;
+static std::atomic<int> gDispatched(0);
+static std::atomic<int> gEarly(0);
+static std::atomic<int> gTooLate(0);
+static std::atomic<long> gExactLate(-1);
+
+static void onTimer(const Message& msg, void* context)
+{
+    long late = (long)(getNowTimeOfMs() - gSentAt) - msg->mArg1;
+    if (msg->mWhat == MSG_EXACT)
+    {
+        gExactLate = late;
+        return;
+    }
+
+    // a message may wait for its slack, never less than its delay
+    if (late < -2)
+        gEarly++;
+    if (late > SLACK + 30)
+        gTooLate++;
+    gDispatched++;
+}
+
+// timers 5ms apart, return wakeups of looper taken to dispatch them
+static uint64 runTimers(long slack)
+{
+    LooperThread thread("slack");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onTimer, nullptr);
+    h->setTimerSlack(slack);
+    Queue queue = thread.getLooper()->getMsgQueue();
+    gDispatched = 0;
+    gEarly = 0;
+    gTooLate = 0;
+
+    gSentAt = getNowTimeOfMs();
+    for (int i = 0; i < TIMERS; i++)
+    {
+        long delay = FIRST_DELAY + i * STEP;
+        h->sendMessageDelayed(Msg::obtain(0, (int)delay, 0), delay);
+    }
+
+    // wakeups by sending are over before first timer is due
+    usleep(50 * 1000);
+    uint64 before = queue->getWakeupCount();
+    TEST_CHECK(waitUntil([]() { return gDispatched.load() == TIMERS; }, 2000));
+    uint64 wakeups = queue->getWakeupCount() - before;
+
+    TEST_CHECK_EQ(gEarly.load(), 0);
+    TEST_CHECK_EQ(gTooLate.load(), 0);
+    thread.quit();
+    return wakeups;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// with slack nearby timers share wakeups, without it each one wakes looper
+static void testCoalescing(void)
+{
+    uint64 exact = runTimers(0);
+    uint64 coalesced = runTimers(SLACK);
+    TEST_CHECK(exact >= TIMERS / 2);
+    TEST_CHECK(coalesced <= 2);
+    TEST_CHECK(coalesced < exact);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+// a message with slack 0 among slack timers is dispatched on time and wakes looper for
+// those due by then
+static void testZeroSlackMessage(void)
+{
+    LooperThread thread("slack");
+    Handler h = MsgHandler::createHandler(thread.getLooper(), onTimer, nullptr);
+    h->setTimerSlack(SLACK);
+    gDispatched = 0;
+    gExactLate = -1;
+
+    gSentAt = getNowTimeOfMs();
+    h->sendMessageDelayed(Msg::obtain(0, FIRST_DELAY, 0), FIRST_DELAY);
+    Message exact = Msg::obtain(MSG_EXACT, FIRST_DELAY + 20, 0);
+    exact->mSlack = 0;
+    h->sendMessageDelayed(std::move(exact), FIRST_DELAY + 20);
+
+    TEST_CHECK(waitUntil([]() { return gExactLate.load() >= 0; }, 2000));
+    TEST_CHECK(gExactLate.load() < 15);
+    TEST_CHECK_EQ(gDispatched.load(), 1);
+
+    thread.quit();
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////
+int main(void)
+{
+    testCoalescing();
+    testZeroSlackMessage();
+    return testResult("test_slack");
+}